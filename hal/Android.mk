@@ -169,6 +169,7 @@ LOCAL_SRC_FILES := \
     audio_hw.c \
     audio_hw_lvacfs.c \
     audio_hw_lvimfs.c \
+    audio_hw_lvfs_pipeline.c \
     acdb.c \
     platform_info.c \
     $(AUDIO_PLATFORM)/platform.c \
@@ -1240,4 +1240,31 @@ endif
 
 include $(BUILD_SHARED_LIBRARY)
 endif
+
+#-------------------------------------------
+#            Build DEVICE_UTILS_BENCH
+#-------------------------------------------
+ifeq ($(strip $(AUDIO_FEATURE_ENABLED_DEVICE_UTILS_BENCH)),true)
+include $(CLEAR_VARS)
+
+LOCAL_MODULE := device_utils_bench
+LOCAL_VENDOR_MODULE := true
+
+LOCAL_SRC_FILES:= device_utils_bench.c \
+                  device_utils.c
+
+LOCAL_CFLAGS += \
+    -Wall \
+    -Werror
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    liblog
+
+LOCAL_C_INCLUDES := \
+    $(PRIMARY_HAL_PATH) \
+    system/media/audio/include
+
+include $(BUILD_EXECUTABLE)
+endif
 endif
@@ -80,6 +80,11 @@ struct cin_private_data {
 
 typedef struct cin_private_data cin_private_data_t;
 
+/* the input stream arena reserves this much inline for it */
+_Static_assert(STREAM_ARENA_ALIGN_UP(sizeof(cin_private_data_t)) <=
+               STREAM_IN_ARENA_CIN_PRIVATE_SIZE,
+               "cin_private_data outgrew STREAM_IN_ARENA_CIN_PRIVATE_SIZE");
+
 static unsigned int cin_usecases_state;
 
 static const audio_usecase_t cin_usecases[] = {
@@ -265,10 +270,31 @@ void cin_free_input_stream_resources(struct stream_in *in)
     cin_private_data_t *cin_data = (cin_private_data_t *) in->cin_extn;
 
     ALOGV("%s: in %p, cin_data %p", __func__, in, cin_data);
-    if (cin_data) {
-        free(cin_data->compr_config.codec);
-        free(cin_data);
+    /* cin_data and its codec live in the stream arena, released on close */
+    in->cin_extn = NULL;
+}
+
+/*
+ * A read may span several fragments (batched timestamp reads), each of
+ * which carries its own metadata header in front of the payload.
+ */
+static int cin_convert_fragments(cin_private_data_t *cin_data, char *buffer,
+                                 size_t bytes, size_t mdata_size)
+{
+    size_t frag_size = cin_data->compr_config.fragment_size;
+    size_t offset = 0, payload_size = 0;
+
+    if (!mdata_size || frag_size <= mdata_size)
+        return (audio_extn_utils_convert_format_24_8_to_8_24(buffer, bytes)
+                        == bytes) ? 0 : -EIO;
+
+    payload_size = frag_size - mdata_size;
+    for (offset = 0; offset + frag_size <= bytes; offset += frag_size) {
+        if (audio_extn_utils_convert_format_24_8_to_8_24(
+                    buffer + offset + mdata_size, payload_size) != payload_size)
+            return -EIO;
     }
+    return 0;
 }
 
 int cin_read(struct stream_in *in, void *buffer,
@@ -294,11 +320,9 @@ int cin_read(struct stream_in *in, void *buffer,
                 ret = 0;
                 *bytes_read = bytes;
                 /* data from DSP comes in 24_8 format, convert it to 8_24 */
-                if (in->format == AUDIO_FORMAT_PCM_8_24_BIT) {
-                    if (audio_extn_utils_convert_format_24_8_to_8_24(
-                                          (char *)buffer + mdata_size, bytes) != bytes)
-                        ret = -EIO;
-                }
+                if (in->format == AUDIO_FORMAT_PCM_8_24_BIT)
+                    ret = cin_convert_fragments(cin_data, (char *)buffer,
+                                                bytes, mdata_size);
             } else {
                 ret = errno;
                 ALOGE("%s: failed error = %d, read = %zd, err_str %s", __func__,
@@ -324,7 +348,8 @@ int cin_configure_input_stream(struct stream_in *in, struct audio_config *in_con
         return -EINVAL;
     }
 
-    cin_data = (cin_private_data_t *) calloc(1, sizeof(cin_private_data_t));
+    cin_data = (cin_private_data_t *) stream_arena_alloc(&in->arena,
+                                                         sizeof(cin_private_data_t));
     in->cin_extn = (void *)cin_data;
     if (!cin_data) {
         ALOGE("%s, allocation for private data failed!", __func__);
@@ -332,7 +357,7 @@ int cin_configure_input_stream(struct stream_in *in, struct audio_config *in_con
     }
 
     cin_data->compr_config.codec = (struct snd_codec *)
-                              calloc(1, sizeof(struct snd_codec));
+            stream_arena_alloc(&in->arena, sizeof(struct snd_codec));
     if (!cin_data->compr_config.codec) {
         ALOGE("%s, allocation for codec data failed!", __func__);
         ret = -ENOMEM;
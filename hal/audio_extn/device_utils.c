@@ -79,6 +79,37 @@ static const uint32_t AUDIO_DEVICE_OUT_CODEC_BACKEND_CNT =
 static const uint32_t AUDIO_DEVICE_IN_CODEC_BACKEND_CNT =
                     AUDIO_ARRAY_SIZE(AUDIO_DEVICE_IN_ALL_CODEC_BACKEND_ARRAY);
 
+/*
+ * Collects the device types of a list as output and input bitmasks, so
+ * the set comparisons below take one pass per list instead of a lookup in
+ * the other list per entry. Returns false if an entry holds more than one
+ * device bit, for which only the entry wise comparison is exact.
+ */
+static bool get_device_masks(const struct listnode *devices,
+                             uint32_t *out_mask, uint32_t *in_mask,
+                             int *count)
+{
+    struct listnode *node;
+    struct audio_device_info *item = NULL;
+    uint32_t bits;
+
+    *out_mask = 0;
+    *in_mask = 0;
+    *count = 0;
+    list_for_each (node, devices) {
+        item = node_to_item(node, struct audio_device_info, list);
+        bits = item->type & ~AUDIO_DEVICE_BIT_IN;
+        if (bits == 0 || (bits & (bits - 1)) != 0)
+            return false;
+        if (item->type & AUDIO_DEVICE_BIT_IN)
+            *in_mask |= bits;
+        else
+            *out_mask |= bits;
+        ++*count;
+    }
+    return true;
+}
+
 
 int list_length(struct listnode *list)
 {
@@ -411,10 +442,16 @@ bool compare_devices_for_any_match(struct listnode *d1, struct listnode *d2)
 {
     struct listnode *node;
     struct audio_device_info *item = NULL;
+    uint32_t out1, in1, out2, in2;
+    int cnt1, cnt2;
 
     if (d1 == NULL || d2 == NULL)
         return false;
 
+    if (get_device_masks(d1, &out1, &in1, &cnt1) &&
+            get_device_masks(d2, &out2, &in2, &cnt2))
+        return ((out1 & out2) | (in1 & in2)) != 0;
+
     list_for_each (node, d1) {
         item = node_to_item(node, struct audio_device_info, list);
         if (item != NULL && compare_device_type(d2, item->type))
@@ -477,12 +514,21 @@ bool compare_devices(struct listnode *d1, struct listnode *d2)
 {
     struct listnode *node;
     struct audio_device_info *item = NULL;
+    uint32_t out1, in1, out2, in2;
+    int cnt1, cnt2;
 
     if (d1 == NULL && d2 == NULL)
         return true;
 
-    if (d1 == NULL || d2 == NULL ||
-            (list_length(d1) != list_length(d2)))
+    if (d1 == NULL || d2 == NULL)
+        return false;
+
+    /* entries are unique per type, so equal masks mean equal lists */
+    if (get_device_masks(d1, &out1, &in1, &cnt1) &&
+            get_device_masks(d2, &out2, &in2, &cnt2))
+        return cnt1 == cnt2 && out1 == out2 && in1 == in2;
+
+    if (list_length(d1) != list_length(d2))
         return false;
 
     list_for_each (node, d1) {
@@ -628,3 +674,79 @@ int append_devices(struct listnode *dest, const struct listnode *source)
     }
     return ret;
 }
+
+/*
+ * Empty caller owned device list
+ * Operation: buf = {};
+ */
+void device_list_buf_init(struct device_list_buf *buf)
+{
+    list_init(&buf->list);
+    buf->num_entries = 0;
+}
+
+/*
+ * Add device to caller owned list, updating the address if already present
+ * Operation: buf |= {type, address}
+ */
+int device_list_buf_add(struct device_list_buf *buf, audio_devices_t type,
+                        const char *address)
+{
+    struct audio_device_info *device = NULL;
+    int i;
+
+    if (type == AUDIO_DEVICE_NONE)
+        return -EINVAL;
+
+    for (i = 0; i < buf->num_entries; i++) {
+        if (buf->entries[i].type == type) {
+            device = &buf->entries[i];
+            break;
+        }
+    }
+
+    if (device == NULL) {
+        if (buf->num_entries == DEVICE_LIST_BUF_ENTRIES) {
+            ALOGE("%s: no room for device type %#x", __func__, type);
+            return -ENOMEM;
+        }
+        device = &buf->entries[buf->num_entries++];
+        device->type = type;
+        list_add_tail(&buf->list, &device->list);
+    }
+    strlcpy(device->address, address, AUDIO_DEVICE_MAX_ADDRESS_LEN);
+    return 0;
+}
+
+/*
+ * Assign source device list to caller owned list
+ * Operation: buf = source list
+ */
+int device_list_buf_assign(struct device_list_buf *buf,
+                           const struct listnode *source)
+{
+    struct listnode *node;
+    struct audio_device_info *item = NULL;
+    int ret = 0;
+
+    device_list_buf_init(buf);
+    if (source == NULL)
+        return ret;
+
+    list_for_each (node, source) {
+        item = node_to_item(node, struct audio_device_info, list);
+        if (item != NULL)
+            ret = device_list_buf_add(buf, item->type, item->address);
+    }
+    return ret;
+}
+
+/*
+ * Replace caller owned list with single device
+ */
+int device_list_buf_reassign(struct device_list_buf *buf,
+                             audio_devices_t type, const char *address)
+{
+    device_list_buf_init(buf);
+    return device_list_buf_add(buf, type, address);
+}
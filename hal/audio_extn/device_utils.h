@@ -65,4 +65,26 @@ int reassign_device_list(struct listnode *device_list,
                             audio_devices_t type, char *address);
 int append_devices(struct listnode *dest, const struct listnode *source);
 
+#define DEVICE_LIST_BUF_ENTRIES 8
+
+/*
+ * Caller owned storage for short lived device lists on routing paths.
+ * &buf->list can be passed to any of the read only helpers above, but the
+ * list must only be changed through the device_list_buf_* helpers and is
+ * never passed to clear_devices(). Nothing is allocated or freed.
+ */
+struct device_list_buf {
+    struct listnode list;
+    int num_entries;
+    struct audio_device_info entries[DEVICE_LIST_BUF_ENTRIES];
+};
+
+void device_list_buf_init(struct device_list_buf *buf);
+int device_list_buf_add(struct device_list_buf *buf, audio_devices_t type,
+                        const char *address);
+int device_list_buf_assign(struct device_list_buf *buf,
+                           const struct listnode *source);
+int device_list_buf_reassign(struct device_list_buf *buf,
+                             audio_devices_t type, const char *address);
+
 #endif
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2026, The Linux Foundation. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above
+ *     copyright notice, this list of conditions and the following
+ *     disclaimer in the documentation and/or other materials provided
+ *     with the distribution.
+ *   * Neither the name of The Linux Foundation nor the names of its
+ *     contributors may be used to endorse or promote products derived
+ *     from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED "AS IS" AND ANY EXPRESS OR IMPLIED
+ * WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE
+ * OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Micro-benchmark of the device list helpers used on routing paths.
+ * Usage: device_utils_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <hardware/audio.h>
+#include <cutils/list.h>
+
+#include "device_utils.h"
+
+#define DEFAULT_ITERATIONS 1000000
+
+static volatile int sink;
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void report(const char *name, int64_t elapsed_ns, int iterations)
+{
+    printf("%-32s %8.1f ns/op\n", name, (double)elapsed_ns / iterations);
+}
+
+int main(int argc, char **argv)
+{
+    struct listnode spk, spk_hs, a2dp;
+    struct device_list_buf buf;
+    struct listnode heap;
+    int iterations = DEFAULT_ITERATIONS;
+    int64_t start;
+    int i;
+
+    if (argc > 1)
+        iterations = atoi(argv[1]);
+    if (iterations <= 0)
+        iterations = DEFAULT_ITERATIONS;
+
+    list_init(&spk);
+    list_init(&spk_hs);
+    list_init(&a2dp);
+    list_init(&heap);
+    update_device_list(&spk, AUDIO_DEVICE_OUT_SPEAKER, "", true);
+    update_device_list(&spk_hs, AUDIO_DEVICE_OUT_SPEAKER, "", true);
+    update_device_list(&spk_hs, AUDIO_DEVICE_OUT_WIRED_HEADSET, "", true);
+    update_device_list(&a2dp, AUDIO_DEVICE_OUT_BLUETOOTH_A2DP,
+                       "00:11:22:33:44:55", true);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        sink += compare_devices(&spk_hs, &spk);
+    report("compare_devices", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        sink += compare_devices_for_any_match(&spk_hs, &a2dp);
+    report("compare_devices_for_any_match", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        sink += compare_device_type(&spk_hs, AUDIO_DEVICE_OUT_WIRED_HEADSET);
+    report("compare_device_type", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        sink += is_a2dp_out_device_type(&a2dp);
+    report("is_a2dp_out_device_type", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        sink += get_device_types(&spk_hs);
+    report("get_device_types", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        assign_devices(&heap, &spk_hs);
+        clear_devices(&heap);
+    }
+    report("assign_devices + clear_devices", now_ns() - start, iterations);
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++) {
+        device_list_buf_assign(&buf, &spk_hs);
+        sink += buf.num_entries;
+    }
+    report("device_list_buf_assign", now_ns() - start, iterations);
+
+    clear_devices(&spk);
+    clear_devices(&spk_hs);
+    clear_devices(&a2dp);
+    return 0;
+}
@@ -854,6 +854,33 @@ static void dump_edid_data(edid_audio_info *info)
            info->channel_map[6], info->channel_map[7]);
 }
 
+/*
+ * Folds the descriptors into one set of capabilities so that the queries
+ * below do not walk the blocks; every query asks whether any block
+ * supports a value.
+ */
+static void update_capability_index(edid_audio_info* info)
+{
+    edid_audio_block_info *block;
+    int i;
+
+    info->format_mask = 0;
+    info->sampling_freq_bitmask = 0;
+    info->bits_per_sample_bitmask = 0;
+    info->max_lpcm_channels = 0;
+
+    for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
+        block = &info->audio_blocks_array[i];
+        if (block->format_id < 32)
+            info->format_mask |= BIT(block->format_id);
+        info->sampling_freq_bitmask |= block->sampling_freq_bitmask;
+        info->bits_per_sample_bitmask |= block->bits_per_sample_bitmask;
+        if (block->format_id == LPCM && block->channels > info->max_lpcm_channels)
+            info->max_lpcm_channels = block->channels;
+    }
+    info->highest_sr = get_highest_edid_sf(info->sampling_freq_bitmask);
+}
+
 bool edid_get_sink_caps(edid_audio_info* info, char *edid_data)
 {
     unsigned char channels[MAX_EDID_BLOCKS];
@@ -926,6 +953,7 @@ bool edid_get_sink_caps(edid_audio_info* info, char *edid_data)
         ALOGV("info->audio_blocks_array[i].bits_per_sample_bitmask %d",
               info->audio_blocks_array[i].bits_per_sample_bitmask);
     }
+    update_capability_index(info);
     dump_speaker_allocation(info);
     dump_edid_data(info);
     return true;
@@ -933,15 +961,11 @@ bool edid_get_sink_caps(edid_audio_info* info, char *edid_data)
 
 bool edid_is_supported_sr(edid_audio_info* info, int sr)
 {
-    int i = 0;
-    if (info != NULL && sr != 0) {
-        for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
-        if (is_supported_sr(info->audio_blocks_array[i].sampling_freq_bitmask , sr)) {
-                ALOGV("%s: returns true for sample rate [%d]",
-                      __func__, sr);
-                return true;
-            }
-        }
+    if (info != NULL && sr != 0 &&
+            is_supported_sr(info->sampling_freq_bitmask, sr)) {
+        ALOGV("%s: returns true for sample rate [%d]",
+              __func__, sr);
+        return true;
     }
     ALOGV("%s: returns false for sample rate [%d]",
            __func__, sr);
@@ -950,22 +974,17 @@ bool edid_is_supported_sr(edid_audio_info* info, int sr)
 
 bool edid_is_supported_bps(edid_audio_info* info, int bps)
 {
-    int i = 0;
-
     if (bps == 16) {
         //16 bit bps is always supported
         //some oem may not update 16bit support in their edid info
         return true;
     }
 
-    if (info != NULL && bps != 0) {
-        for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
-            if (is_supported_bps(info->audio_blocks_array[i].bits_per_sample_bitmask, bps)) {
-                ALOGV("%s: returns true for bit width [%d]",
-                      __func__, bps);
-                return true;
-            }
-        }
+    if (info != NULL && bps != 0 &&
+            is_supported_bps(info->bits_per_sample_bitmask, bps)) {
+        ALOGV("%s: returns true for bit width [%d]",
+              __func__, bps);
+        return true;
     }
     ALOGV("%s: returns false for bit width [%d]",
            __func__, bps);
@@ -974,17 +993,10 @@ bool edid_is_supported_bps(edid_audio_info* info, int bps)
 
 int edid_get_highest_supported_sr(edid_audio_info* info)
 {
-    int sr = 0;
     int highest_sr = 0;
-    int i;
 
-    if (info != NULL) {
-        for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
-          sr = get_highest_edid_sf(info->audio_blocks_array[i].sampling_freq_bitmask);
-          if (sr > highest_sr)
-            highest_sr = sr;
-        }
-    }
+    if (info != NULL)
+        highest_sr = info->highest_sr;
     else
         ALOGE("%s: info is NULL", __func__);
 
@@ -113,6 +113,12 @@ typedef struct edid_audio_info {
     char channel_map[MAX_CHANNELS_SUPPORTED];
     int  channel_allocation;
     unsigned int  channel_mask;
+    /* capability index over all blocks, filled in by edid_get_sink_caps() */
+    unsigned int format_mask;           /* BIT(format_id) per format */
+    int sampling_freq_bitmask;
+    int bits_per_sample_bitmask;
+    int highest_sr;
+    int max_lpcm_channels;
 } edid_audio_info;
 
 bool edid_is_supported_sr(edid_audio_info* info, int sr);
@@ -35,12 +35,16 @@
 #define LOG_NDDEBUG 0
 
 #include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <pthread.h>
 #include <log/log.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <cutils/atomic.h>
 #include <cutils/properties.h>
 #include "audio_hw.h"
 #include "audio_extn.h"
@@ -59,7 +63,8 @@
 
 /* Proprietary interface version used for compatibility with STHAL */
 #define STHAL_PROP_API_VERSION_2_0 MAKE_HAL_VERSION(2, 0)
-#define STHAL_PROP_API_CURRENT_VERSION STHAL_PROP_API_VERSION_2_0
+#define STHAL_PROP_API_VERSION_2_1 MAKE_HAL_VERSION(2, 1)
+#define STHAL_PROP_API_CURRENT_VERSION STHAL_PROP_API_VERSION_2_1
 
 #define ST_EVENT_CONFIG_MAX_STR_VALUE 32
 #define ST_DEVICE_HANDSET_MIC 1
@@ -69,7 +74,9 @@ typedef enum {
     ST_EVENT_SESSION_DEREGISTER,
     ST_EVENT_START_KEEP_ALIVE,
     ST_EVENT_STOP_KEEP_ALIVE,
-    ST_EVENT_UPDATE_ECHO_REF
+    ST_EVENT_UPDATE_ECHO_REF,
+    ST_EVENT_LAB_RING_REGISTER,   /* API version 2.1 */
+    ST_EVENT_LAB_RING_DEREGISTER  /* API version 2.1 */
 } sound_trigger_event_type_t;
 
 typedef enum {
@@ -127,9 +134,31 @@ struct audio_hal_usecase {
     audio_stream_usecase_type_t type;
 };
 
+/*
+ * LAB ring shared by STHAL (producer) with AHAL (consumer) through a memfd.
+ * The data area follows the header at ST_LAB_RING_DATA_OFFSET and its size
+ * is a power of two. Offsets are free running byte counters, each one only
+ * written by its owner.
+ */
+#define ST_LAB_RING_MAGIC 0x4c414252 /* "LABR" */
+#define ST_LAB_RING_DATA_OFFSET 64
+
+struct sound_trigger_lab_ring_hdr {
+    uint32_t magic;
+    uint32_t data_size;
+    volatile int32_t write_offset;
+    volatile int32_t read_offset;
+};
+
+struct sound_trigger_lab_ring_info {
+    int fd;
+    size_t size;
+};
+
 struct sound_trigger_event_info {
     struct sound_trigger_session_info st_ses;
     bool st_ec_ref_enabled;
+    struct sound_trigger_lab_ring_info lab_ring; /* API version 2.1 */
 };
 typedef struct sound_trigger_event_info sound_trigger_event_info_t;
 
@@ -201,9 +230,30 @@ do {\
  */
 const unsigned int sthal_prop_api_version = STHAL_PROP_API_CURRENT_VERSION;
 
+/* max time a ring read waits for the producer before failing */
+#define ST_LAB_RING_MAX_WAIT_US 100000
+
+struct sound_trigger_lab_ring {
+    void *map;
+    size_t map_size;
+    struct sound_trigger_lab_ring_hdr *hdr;
+    uint8_t *data;
+    /* data_size validated at map time, the header copy is producer writable */
+    uint32_t size;
+    /* drain metrics, reset on every LAB start */
+    int64_t first_read_ns;
+    int64_t catchup_ns;
+    uint64_t burst_bytes;
+    uint32_t burst_reads;
+    bool caught_up;
+};
+
 struct sound_trigger_info  {
     struct sound_trigger_session_info st_ses;
     bool lab_stopped;
+    struct sound_trigger_lab_ring ring;
+    /* readers using the ring without st_dev->lock, see st_info_get() */
+    int users;
     struct listnode list;
 };
 
@@ -213,6 +263,7 @@ struct sound_trigger_audio_device {
     sound_trigger_hw_call_back_t st_callback;
     struct listnode st_ses_list;
     pthread_mutex_t lock;
+    pthread_cond_t users_cond;
     unsigned int sthal_prop_api_version;
     bool st_ec_ref_enabled;
     bool shared_mixer;
@@ -251,6 +302,183 @@ get_sound_trigger_info(int capture_handle)
     return NULL;
 }
 
+/*
+ * A LAB read drops st_dev->lock while it waits on the ring. The session is
+ * pinned for that time so that a deregister does not unmap the ring or
+ * free the session under it. Called with st_dev->lock held.
+ */
+static void st_info_get(struct sound_trigger_info *st_info)
+{
+    st_info->users++;
+}
+
+static void st_info_put(struct sound_trigger_info *st_info)
+{
+    pthread_mutex_lock(&st_dev->lock);
+    if (--st_info->users == 0)
+        pthread_cond_broadcast(&st_dev->users_cond);
+    pthread_mutex_unlock(&st_dev->lock);
+}
+
+/* called with st_dev->lock held, before unmapping or freeing st_info */
+static void st_info_wait_unused(struct sound_trigger_info *st_info)
+{
+    while (st_info->users > 0)
+        pthread_cond_wait(&st_dev->users_cond, &st_dev->lock);
+}
+
+static int64_t lab_ring_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int lab_ring_map(struct sound_trigger_info *st_info,
+                        struct sound_trigger_lab_ring_info *info)
+{
+    struct sound_trigger_lab_ring *ring = &st_info->ring;
+    struct sound_trigger_lab_ring_hdr *hdr = NULL;
+    void *map = NULL;
+
+    if (ring->map) {
+        ALOGW("%s: ring already mapped for capture_handle %d", __func__,
+              st_info->st_ses.capture_handle);
+        return -EBUSY;
+    }
+    if (info->fd < 0 || info->size <= ST_LAB_RING_DATA_OFFSET)
+        return -EINVAL;
+
+    map = mmap(NULL, info->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               info->fd, 0);
+    if (map == MAP_FAILED) {
+        ALOGE("%s: mmap failed, err %d", __func__, errno);
+        return -errno;
+    }
+
+    hdr = (struct sound_trigger_lab_ring_hdr *)map;
+    if (hdr->magic != ST_LAB_RING_MAGIC || hdr->data_size == 0 ||
+        (hdr->data_size & (hdr->data_size - 1)) ||
+        hdr->data_size > info->size - ST_LAB_RING_DATA_OFFSET) {
+        ALOGE("%s: invalid ring header magic 0x%x size %u", __func__,
+              hdr->magic, hdr->data_size);
+        munmap(map, info->size);
+        return -EINVAL;
+    }
+
+    memset(ring, 0, sizeof(*ring));
+    ring->map = map;
+    ring->map_size = info->size;
+    ring->hdr = hdr;
+    ring->data = (uint8_t *)map + ST_LAB_RING_DATA_OFFSET;
+    ring->size = hdr->data_size;
+    ALOGD("%s: capture_handle %d ring size %u", __func__,
+          st_info->st_ses.capture_handle, ring->size);
+    return 0;
+}
+
+static void lab_ring_log_metrics(struct sound_trigger_info *st_info)
+{
+    struct sound_trigger_lab_ring *ring = &st_info->ring;
+
+    if (!ring->map || !ring->first_read_ns)
+        return;
+
+    ALOGD("%s: capture_handle %d burst %" PRIu64 " bytes in %u reads, "
+          "catch up %s %" PRId64 " us", __func__,
+          st_info->st_ses.capture_handle, ring->burst_bytes,
+          ring->burst_reads, ring->caught_up ? "after" : "not reached,",
+          ((ring->caught_up ? ring->catchup_ns : lab_ring_now_ns()) -
+           ring->first_read_ns) / 1000);
+    ring->first_read_ns = 0;
+    ring->catchup_ns = 0;
+    ring->burst_bytes = 0;
+    ring->burst_reads = 0;
+    ring->caught_up = false;
+}
+
+static void lab_ring_unmap(struct sound_trigger_info *st_info)
+{
+    struct sound_trigger_lab_ring *ring = &st_info->ring;
+
+    if (!ring->map)
+        return;
+
+    lab_ring_log_metrics(st_info);
+    munmap(ring->map, ring->map_size);
+    memset(ring, 0, sizeof(*ring));
+}
+
+/*
+ * Drains LAB data straight from the shared ring. Buffered keyword audio is
+ * returned without going through the STHAL callback; once the consumer has
+ * caught up with the producer the read paces itself on the incoming data.
+ */
+static int lab_ring_read(struct stream_in *in, struct sound_trigger_lab_ring *ring,
+                         void *buffer, size_t bytes)
+{
+    struct sound_trigger_lab_ring_hdr *hdr = ring->hdr;
+    uint32_t size = ring->size;
+    uint32_t rd, wr, avail, off, first;
+    uint32_t waited_us = 0, wait_us = 0;
+    size_t frame_size = audio_stream_in_frame_size((struct audio_stream_in *)in);
+
+    if (bytes > size)
+        return -EINVAL;
+
+    if (!ring->first_read_ns)
+        ring->first_read_ns = lab_ring_now_ns();
+
+    rd = (uint32_t)hdr->read_offset;
+    wr = (uint32_t)android_atomic_acquire_load(&hdr->write_offset);
+    avail = wr - rd;
+    if (avail > size) {
+        /* producer lapped us, resync to the oldest valid data */
+        ALOGW("%s: ring overrun, dropping %u bytes", __func__, avail - size);
+        rd = wr - size;
+        avail = size;
+    }
+
+    if (!ring->caught_up) {
+        if (avail >= bytes) {
+            ring->burst_bytes += bytes;
+            ring->burst_reads++;
+        } else {
+            ring->caught_up = true;
+            ring->catchup_ns = lab_ring_now_ns();
+        }
+    }
+
+    while (avail < bytes) {
+        if (waited_us >= ST_LAB_RING_MAX_WAIT_US || !frame_size || !in->config.rate)
+            return -ETIMEDOUT;
+        wait_us = (uint32_t)(((uint64_t)(bytes - avail) * 1000000) /
+                             (frame_size * in->config.rate)) + 1;
+        usleep(wait_us);
+        waited_us += wait_us;
+        wr = (uint32_t)android_atomic_acquire_load(&hdr->write_offset);
+        avail = wr - rd;
+        if (avail > size) {
+            ALOGW("%s: ring overrun while waiting, dropping %u bytes", __func__,
+                  avail - size);
+            rd = wr - size;
+            avail = size;
+        }
+    }
+
+    off = rd & (size - 1);
+    first = size - off;
+    if (first >= bytes) {
+        memcpy(buffer, ring->data + off, bytes);
+    } else {
+        memcpy(buffer, ring->data + off, first);
+        memcpy((uint8_t *)buffer + first, ring->data, bytes - first);
+    }
+    android_atomic_release_store((int32_t)(rd + bytes), &hdr->read_offset);
+    return 0;
+}
+
 static int populate_usecase(struct audio_hal_usecase *usecase,
                        struct audio_usecase *uc_info)
 {
@@ -374,10 +602,35 @@ int audio_hw_call_back(sound_trigger_event_type_t event,
         }
         ALOGV("%s: remove capture_handle %d st session opaque ptr %p", __func__,
               st_ses_info->st_ses.capture_handle, st_ses_info->st_ses.p_ses);
+        st_info_wait_unused(st_ses_info);
         list_remove(&st_ses_info->list);
+        lab_ring_unmap(st_ses_info);
         free(st_ses_info);
         break;
 
+    case ST_EVENT_LAB_RING_REGISTER:
+    case ST_EVENT_LAB_RING_DEREGISTER:
+        if (!config ||
+            st_dev->sthal_prop_api_version < STHAL_PROP_API_VERSION_2_1) {
+            ALOGE("%s: LAB ring not supported by sthal", __func__);
+            status = -EINVAL;
+            break;
+        }
+        st_ses_info = get_sound_trigger_info(config->st_ses.capture_handle);
+        if (!st_ses_info) {
+            ALOGE("%s: capture_handle %d not in the list!", __func__,
+                  config->st_ses.capture_handle);
+            status = -EINVAL;
+            break;
+        }
+        if (event == ST_EVENT_LAB_RING_REGISTER) {
+            status = lab_ring_map(st_ses_info, &config->lab_ring);
+        } else {
+            st_info_wait_unused(st_ses_info);
+            lab_ring_unmap(st_ses_info);
+        }
+        break;
+
     case ST_EVENT_STOP_KEEP_ALIVE:
         pthread_mutex_unlock(&st_dev->lock);
         pthread_mutex_lock(&st_dev->adev->lock);
@@ -409,6 +662,7 @@ int audio_extn_sound_trigger_read(struct stream_in *in, void *buffer,
     int ret = -1;
     struct sound_trigger_info  *st_info = NULL;
     audio_event_info_t event;
+    bool use_ring;
 
     if (!st_dev)
        return ret;
@@ -420,8 +674,14 @@ int audio_extn_sound_trigger_read(struct stream_in *in, void *buffer,
 
     pthread_mutex_lock(&st_dev->lock);
     st_info = get_sound_trigger_info(in->capture_handle);
+    use_ring = st_info && st_info->ring.map;
+    if (use_ring)
+        st_info_get(st_info);
     pthread_mutex_unlock(&st_dev->lock);
-    if (st_info) {
+    if (use_ring) {
+        ret = lab_ring_read(in, &st_info->ring, buffer, bytes);
+        st_info_put(st_info);
+    } else if (st_info) {
         event.u.aud_info.ses_info = &st_info->st_ses;
         event.u.aud_info.buf = buffer;
         event.u.aud_info.num_bytes = bytes;
@@ -450,10 +710,13 @@ void audio_extn_sound_trigger_stop_lab(struct stream_in *in)
 
     pthread_mutex_lock(&st_dev->lock);
     st_ses_info = get_sound_trigger_info(in->capture_handle);
-    pthread_mutex_unlock(&st_dev->lock);
     if (st_ses_info) {
+        lab_ring_log_metrics(st_ses_info);
         event.u.ses_info = st_ses_info->st_ses;
-        ALOGV("%s: AUDIO_EVENT_STOP_LAB st sess %p", __func__, st_ses_info->st_ses.p_ses);
+    }
+    pthread_mutex_unlock(&st_dev->lock);
+    if (st_ses_info) {
+        ALOGV("%s: AUDIO_EVENT_STOP_LAB st sess %p", __func__, event.u.ses_info.p_ses);
         st_dev->st_callback(AUDIO_EVENT_STOP_LAB, &event);
         in->is_st_session_active = false;
     }
@@ -888,6 +1151,7 @@ int clear_device_list(struct listnode *devices)
          item = node_to_item(node, struct sound_trigger_info, list);
          if (item != NULL) {
              list_remove(&item->list);
+             lab_ring_unmap(item);
              free(item);
         }
      }
@@ -34,6 +34,10 @@
 #include <log/log.h>
 #include <cutils/misc.h>
 #include <unistd.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
 
 
@@ -2861,6 +2865,9 @@ int audio_extn_utils_pcm_get_dsp_presentation_pos(struct stream_out *out __unuse
 #define MAX_SND_CARD 8
 #define RETRY_US 400000
 #define RETRY_NUMBER 100
+/* overall bound, /dev/snd events can otherwise keep the scan going forever */
+#define SND_CARD_DETECT_TIMEOUT_US ((int64_t)RETRY_US * RETRY_NUMBER)
+#define SND_DEV_DIR "/dev/snd"
 #define PLATFORM_INFO_XML_PATH          "audio_platform_info.xml"
 #define PLATFORM_INFO_XML_BASE_STRING   "audio_platform_info"
 
@@ -2912,11 +2919,73 @@ int audio_extn_utils_get_platform_info(const char* snd_card_name, char* platform
     return ret;
 }
 
+/*
+ * card found by the last successful detection, reused while it still opens
+ * and still is a supported card
+ */
+static int detected_snd_card_num = -1;
+
+static int64_t snd_card_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static int snd_card_watch_open(void)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (fd < 0) {
+        ALOGW("%s: inotify unavailable (%s), polling for sound card",
+              __func__, strerror(errno));
+        return -1;
+    }
+    /* control nodes are created first and made accessible by ueventd later */
+    if (inotify_add_watch(fd, SND_DEV_DIR, IN_CREATE | IN_ATTRIB) < 0) {
+        ALOGW("%s: cannot watch %s (%s), polling for sound card",
+              __func__, SND_DEV_DIR, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Waits up to timeout_us for a node under /dev/snd to appear or change.
+ * Returns true if woken by an event, false on timeout or when sleeping
+ * because inotify is not usable.
+ */
+static bool snd_card_watch_wait(int watch_fd, int timeout_us)
+{
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+    struct pollfd pfd;
+    int ret;
+
+    if (watch_fd < 0) {
+        usleep(timeout_us);
+        return false;
+    }
+
+    pfd.fd = watch_fd;
+    pfd.events = POLLIN;
+    ret = poll(&pfd, 1, timeout_us / 1000);
+    if (ret <= 0 || !(pfd.revents & POLLIN))
+        return false;
+
+    /* the caller rescans every card, so the event contents do not matter */
+    while (read(watch_fd, buf, sizeof(buf)) > 0)
+        ;
+    return true;
+}
+
 int audio_extn_utils_get_snd_card_num()
 {
     int snd_card_num = 0;
     struct mixer *mixer = NULL;
 
+    /* reopens and re-checks the cached card, or scans if that fails */
     snd_card_num = audio_extn_utils_open_snd_mixer(&mixer);
     if (mixer)
         mixer_close(mixer);
@@ -2925,12 +2994,13 @@ int audio_extn_utils_get_snd_card_num()
 
 int audio_extn_utils_open_snd_mixer(struct mixer **mixer_handle)
 {
-
-    void *hw_info = NULL;
     struct mixer *mixer = NULL;
     int retry_num = 0;
     int snd_card_num = 0;
-    char* snd_card_name = NULL;
+    int watch_fd = -1;
+    int wakeups = 0;
+    int64_t start_us, remaining_us;
+    const char *snd_card_name = NULL;
     int snd_card_detection_info[MAX_SND_CARD] = {0};
 
     if (!mixer_handle) {
@@ -2938,14 +3008,37 @@ int audio_extn_utils_open_snd_mixer(struct mixer **mixer_handle)
         return -1;
     }
     *mixer_handle = NULL;
+    start_us = snd_card_now_us();
+
+    if (detected_snd_card_num >= 0) {
+        mixer = mixer_open(detected_snd_card_num);
+        /* the card may have been renumbered or replaced meanwhile */
+        if (mixer && hw_info_is_supported_snd_card(mixer_get_name(mixer))) {
+            *mixer_handle = mixer;
+            ALOGD("%s: Reopened sound card:%d", __func__, detected_snd_card_num);
+            return detected_snd_card_num;
+        }
+        ALOGW("%s: sound card %d no longer valid, rescanning", __func__,
+              detected_snd_card_num);
+        if (mixer)
+            mixer_close(mixer);
+        mixer = NULL;
+        detected_snd_card_num = -1;
+    }
+
     /*
     * Try with all the sound cards ( 0 to 7 ) and if none of them were detected
-    * sleep for 1 sec and try detections with sound card 0 again.
+    * wait for a change under /dev/snd, at most RETRY_US, and try detections
+    * with sound card 0 again. Only waits that time out count as retries,
+    * and the whole detection gives up after SND_CARD_DETECT_TIMEOUT_US.
     * If sound card gets detected, check if it is relevant, if not check with the
     * other sound cards. To ensure that the irrelevant sound card is not check again,
-    * we maintain it in min_snd_card_num.
+    * we maintain it in snd_card_detection_info.
     */
     while (retry_num < RETRY_NUMBER) {
+        remaining_us = start_us + SND_CARD_DETECT_TIMEOUT_US - snd_card_now_us();
+        if (remaining_us <= 0)
+            break;
         snd_card_num = 0;
         while (snd_card_num < MAX_SND_CARD) {
             if (snd_card_detection_info[snd_card_num] == 0) {
@@ -2959,46 +3052,48 @@ int audio_extn_utils_open_snd_mixer(struct mixer **mixer_handle)
         }
 
         if (!mixer) {
-           usleep(RETRY_US);
-           retry_num++;
-           ALOGD("%s: retry, retry_num %d", __func__, retry_num);
-           continue;
+            if (watch_fd < 0 && wakeups == 0 && retry_num == 0)
+                watch_fd = snd_card_watch_open();
+            if (snd_card_watch_wait(watch_fd,
+                    remaining_us < RETRY_US ? (int)remaining_us : RETRY_US)) {
+                wakeups++;
+                ALOGV("%s: %s changed, rescanning", __func__, SND_DEV_DIR);
+            } else {
+                retry_num++;
+                ALOGD("%s: retry, retry_num %d", __func__, retry_num);
+            }
+            continue;
         }
 
-        snd_card_name = strdup(mixer_get_name(mixer));
-        if (!snd_card_name) {
-            ALOGE("failed to allocate memory for snd_card_name\n");
-            mixer_close(mixer);
-            return -1;
-        }
+        snd_card_name = mixer_get_name(mixer);
         ALOGD("%s: snd_card_name: %s", __func__, snd_card_name);
         snd_card_detection_info[snd_card_num] = 1;
-        hw_info = hw_info_init(snd_card_name);
-        if (hw_info) {
+        if (hw_info_is_supported_snd_card(snd_card_name)) {
             ALOGD("%s: Opened sound card:%d", __func__, snd_card_num);
             break;
         }
         ALOGE("%s: Failed to init hardware info, snd_card_num:%d", __func__, snd_card_num);
 
-        free(snd_card_name);
-        snd_card_name = NULL;
-
         mixer_close(mixer);
         mixer = NULL;
     }
-    if (snd_card_name)
-        free(snd_card_name);
 
-    if (hw_info)
-        hw_info_deinit(hw_info);
+    if (watch_fd >= 0)
+        close(watch_fd);
 
-    if (retry_num >= RETRY_NUMBER) {
-        ALOGE("%s: Unable to find correct sound card, aborting.", __func__);
+    if (!mixer) {
+        ALOGE("%s: Unable to find correct sound card after %" PRId64 " ms, aborting.",
+              __func__, (snd_card_now_us() - start_us) / 1000);
         return -1;
     }
 
+    ALOGD("%s: sound card %d detected in %" PRId64 " ms, %d retries, %d wakeups",
+          __func__, snd_card_num, (snd_card_now_us() - start_us) / 1000,
+          retry_num, wakeups);
+
     if (mixer)
         *mixer_handle = mixer;
+    detected_snd_card_num = snd_card_num;
 
     return snd_card_num;
 }
@@ -52,9 +52,11 @@
 #include <limits.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/time.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <math.h>
 #include <dlfcn.h>
 #include <sys/resource.h>
@@ -93,6 +95,7 @@
 #include "audio_amplifier.h"
 #include "audio_hw_lvacfs.h"
 #include "audio_hw_lvimfs.h"
+#include "audio_hw_lvfs_pipeline.h"
 
 #ifdef DYNAMIC_LOG_ENABLED
 #include <log_xml_parser.h>
@@ -1447,7 +1450,7 @@ int enable_audio_route(struct audio_device *adev,
     char mixer_path[MIXER_PATH_MAX_LENGTH];
     struct stream_out *out = NULL;
     struct stream_in *in = NULL;
-    struct listnode out_devices;
+    struct device_list_buf out_devices;
     int ret = 0;
 
     if (usecase == NULL)
@@ -1462,32 +1465,30 @@ int enable_audio_route(struct audio_device *adev,
 
         if (in) {
             if (in->enable_aec || in->enable_ec_port) {
-                list_init(&out_devices);
-                update_device_list(&out_devices, AUDIO_DEVICE_OUT_SPEAKER, "", true);
+                device_list_buf_reassign(&out_devices, AUDIO_DEVICE_OUT_SPEAKER, "");
                 struct listnode *node;
                 struct audio_usecase *voip_usecase = get_usecase_from_list(adev,
                                                            USECASE_AUDIO_PLAYBACK_VOIP);
                 if (voip_usecase) {
-                    assign_devices(&out_devices,
-                                   &voip_usecase->stream.out->device_list);
+                    device_list_buf_assign(&out_devices,
+                                           &voip_usecase->stream.out->device_list);
                 } else if (adev->primary_output &&
                               !adev->primary_output->standby) {
-                    assign_devices(&out_devices,
-                                   &adev->primary_output->device_list);
+                    device_list_buf_assign(&out_devices,
+                                           &adev->primary_output->device_list);
                 } else {
                     list_for_each(node, &adev->usecase_list) {
                         uinfo = node_to_item(node, struct audio_usecase, list);
                         if (uinfo->type != PCM_CAPTURE) {
-                            assign_devices(&out_devices,
-                                           &uinfo->stream.out->device_list);
+                            device_list_buf_assign(&out_devices,
+                                                   &uinfo->stream.out->device_list);
                             break;
                         }
                     }
                 }
 
-                platform_set_echo_reference(adev, true, &out_devices);
+                platform_set_echo_reference(adev, true, &out_devices.list);
                 in->ec_opened = true;
-                clear_devices(&out_devices);
             }
         }
     } else if ((usecase->type == TRANSCODE_LOOPBACK_TX) || ((usecase->type == PCM_HFP_CALL) &&
@@ -1616,9 +1617,9 @@ int disable_audio_route(struct audio_device *adev,
         if (in && in->ec_opened) {
             struct listnode out_devices;
             list_init(&out_devices);
+            /* an empty list, nothing to allocate or clear */
             platform_set_echo_reference(in->dev, false, &out_devices);
             in->ec_opened = false;
-            clear_devices(&out_devices);
         }
     }
     if (usecase->id == adev->fluence_nn_usecase_id) {
@@ -3065,7 +3066,6 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
                                                       &out_devices, usecase->type);
         assign_devices(&usecase->device_list,
                        &usecase->stream.inout->in_config.device_list);
-        clear_devices(&out_devices);
     } else {
         /*
          * If the voice call is active, use the sound devices of voice call usecase
@@ -3164,11 +3164,11 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
             assign_devices(&usecase->device_list, &usecase->stream.in->device_list);
             out_snd_device = SND_DEVICE_NONE;
             if (in_snd_device == SND_DEVICE_NONE) {
-                struct listnode out_devices;
+                struct device_list_buf out_devices;
                 struct stream_in *voip_in = get_voice_communication_input(adev);
                 struct stream_in *priority_in = NULL;
 
-                list_init(&out_devices);
+                device_list_buf_init(&out_devices);
                 if (voip_in != NULL) {
                     struct audio_usecase *voip_usecase = get_usecase_from_list(adev,
                                                              USECASE_AUDIO_PLAYBACK_VOIP);
@@ -3177,16 +3177,16 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
 
                     if (usecase->id == USECASE_AUDIO_RECORD_AFE_PROXY ||
                         usecase->id == USECASE_AUDIO_RECORD_AFE_PROXY2) {
-                        reassign_device_list(&out_devices, AUDIO_DEVICE_OUT_TELEPHONY_TX, "");
+                        device_list_buf_reassign(&out_devices, AUDIO_DEVICE_OUT_TELEPHONY_TX, "");
                     } else if (voip_usecase) {
-                        assign_devices(&out_devices, &voip_usecase->stream.out->device_list);
+                        device_list_buf_assign(&out_devices, &voip_usecase->stream.out->device_list);
                     } else if (adev->primary_output &&
                                   !adev->primary_output->standby) {
-                        assign_devices(&out_devices, &adev->primary_output->device_list);
+                        device_list_buf_assign(&out_devices, &adev->primary_output->device_list);
                     } else {
                         /* forcing speaker o/p device to get matching i/p pair
                            in case o/p is not routed from same primary HAL */
-                        reassign_device_list(&out_devices, AUDIO_DEVICE_OUT_SPEAKER, "");
+                        device_list_buf_reassign(&out_devices, AUDIO_DEVICE_OUT_SPEAKER, "");
                     }
                     priority_in = voip_in;
                 } else {
@@ -3206,9 +3206,8 @@ int select_devices(struct audio_device *adev, audio_usecase_t uc_id)
                 else
                     in_snd_device = platform_get_input_snd_device(adev->platform,
                                                                   priority_in,
-                                                                  &out_devices,
+                                                                  &out_devices.list,
                                                                   usecase->type);
-                clear_devices(&out_devices);
             }
         }
     }
@@ -3561,6 +3560,8 @@ static int stop_input_stream(struct stream_in *in)
     if (is_loopback_input_device(get_device_types(&in->device_list)))
         audio_extn_keep_alive_stop(KEEP_ALIVE_OUT_PRIMARY);
 
+    lvfs_pipeline_stop(in);
+
     if (lvacfs_wrapper_ops && in->lvacfs_handle) {
         lvacfs_stop_input_stream(in);
     }
@@ -3787,6 +3788,10 @@ int start_input_stream(struct stream_in *in)
     if (lvimfs_wrapper_ops && !in->lvimfs_instance) {
         lvimfs_start_input_stream(in);
     }
+
+    if (in->lvacfs_handle || in->lvimfs_instance) {
+        lvfs_pipeline_start(in);
+    }
 done_open:
     audio_streaming_hint_end();
     audio_extn_perf_lock_release(&adev->perf_lock_handle);
@@ -4410,36 +4415,32 @@ int start_output_stream(struct stream_out *out)
         if (!a2dp_combo) {
             check_a2dp_restore_l(adev, out, false);
         } else {
-            struct listnode dev;
-            list_init(&dev);
-            assign_devices(&dev, &out->device_list);
-            if (compare_device_type(&dev, AUDIO_DEVICE_OUT_SPEAKER_SAFE))
+            struct device_list_buf dev;
+            device_list_buf_assign(&dev, &out->device_list);
+            if (compare_device_type(&dev.list, AUDIO_DEVICE_OUT_SPEAKER_SAFE))
                 reassign_device_list(&out->device_list,
                                 AUDIO_DEVICE_OUT_SPEAKER_SAFE, "");
             else
                 reassign_device_list(&out->device_list,
                                 AUDIO_DEVICE_OUT_SPEAKER, "");
             select_devices(adev, out->usecase);
-            assign_devices(&out->device_list, &dev);
-            clear_devices(&dev);
+            assign_devices(&out->device_list, &dev.list);
         }
     } else {
         select_devices(adev, out->usecase);
         if (is_a2dp_out_device_type(&out->device_list) &&
              !adev->a2dp_started) {
             if (is_speaker_active || is_speaker_safe_active) {
-                struct listnode dev;
-                list_init(&dev);
-                assign_devices(&dev, &out->device_list);
-                if (compare_device_type(&dev, AUDIO_DEVICE_OUT_SPEAKER_SAFE))
+                struct device_list_buf dev;
+                device_list_buf_assign(&dev, &out->device_list);
+                if (compare_device_type(&dev.list, AUDIO_DEVICE_OUT_SPEAKER_SAFE))
                     reassign_device_list(&out->device_list,
                                     AUDIO_DEVICE_OUT_SPEAKER_SAFE, "");
                 else
                     reassign_device_list(&out->device_list,
                                     AUDIO_DEVICE_OUT_SPEAKER, "");
                 select_devices(adev, out->usecase);
-                assign_devices(&out->device_list, &dev);
-                clear_devices(&dev);
+                assign_devices(&out->device_list, &dev.list);
             } else {
                 ret = -EINVAL;
                 goto error_open;
@@ -7362,6 +7363,134 @@ static int in_set_format(struct audio_stream *stream __unused,
     return -ENOSYS;
 }
 
+static int64_t in_capture_position_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return audio_utils_ns_from_timespec(&ts);
+}
+
+/* must be called with in->lock held after a successful pcm read */
+static void in_publish_capture_position(struct stream_in *in)
+{
+    struct capture_position_snapshot *pos = &in->capture_pos;
+    struct timespec timestamp;
+    unsigned int avail;
+    int64_t latency_ns;
+
+    if (in->pcm == NULL || in->config.rate == 0 ||
+        pcm_get_htimestamp(in->pcm, &avail, &timestamp) != 0)
+        return;
+
+    latency_ns = platform_capture_latency(in) * 1000LL;
+    latency_ns += lvfs_pipeline_latency_ns(in);
+    // Note: decoder latency is returned in ms, while platform_capture_latency in ns.
+    if (is_a2dp_in_device_type(&in->device_list))
+        latency_ns += audio_extn_a2dp_get_decoder_latency() * 1000000LL;
+
+    android_atomic_inc(&pos->seq);
+    /* the odd sequence must be visible before any of the payload stores */
+    android_memory_barrier();
+    pos->frames = in->frames_read + avail;
+    pos->time_ns = audio_utils_ns_from_timespec(&timestamp);
+    pos->latency_ns = latency_ns;
+    pos->rate = in->config.rate;
+    pos->stale_ns = 2LL * in->config.period_size * 1000000000LL / in->config.rate;
+    android_atomic_inc(&pos->seq);
+}
+
+/* must be called with in->lock held */
+static void in_invalidate_capture_position(struct stream_in *in)
+{
+    android_atomic_inc(&in->capture_pos.seq);
+    android_memory_barrier();
+    in->capture_pos.time_ns = 0;
+    android_atomic_inc(&in->capture_pos.seq);
+}
+
+#define CAPTURE_POS_SNAPSHOT_RETRIES 8
+
+/*
+ * Extrapolates the capture position from the last snapshot published by
+ * in_read(). Fails if the snapshot is invalid, stale or being updated.
+ */
+static int in_get_capture_position_snapshot(struct stream_in *in,
+                                            int64_t *frames, int64_t *time)
+{
+    struct capture_position_snapshot *pos = &in->capture_pos;
+    int64_t snap_frames = 0, snap_time_ns = 0, latency_ns = 0, stale_ns = 0;
+    int64_t now_ns, age_ns;
+    uint32_t rate = 0;
+    int32_t seq;
+    int i;
+
+    for (i = 0; i < CAPTURE_POS_SNAPSHOT_RETRIES; i++) {
+        seq = android_atomic_acquire_load(&pos->seq);
+        if (seq & 1)
+            continue;
+        snap_frames = pos->frames;
+        snap_time_ns = pos->time_ns;
+        latency_ns = pos->latency_ns;
+        stale_ns = pos->stale_ns;
+        rate = pos->rate;
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&pos->seq) == seq)
+            break;
+    }
+    if (i == CAPTURE_POS_SNAPSHOT_RETRIES || snap_time_ns == 0 || rate == 0)
+        return -EAGAIN;
+
+    now_ns = in_capture_position_now_ns();
+    age_ns = now_ns - snap_time_ns;
+    if (age_ns < 0 || age_ns > stale_ns)
+        return -EAGAIN;
+
+    *frames = snap_frames + age_ns * rate / 1000000000LL;
+    *time = now_ns - latency_ns;
+    return 0;
+}
+
+static void in_log_capture_position_latency(struct stream_in *in, int64_t start_ns)
+{
+    int64_t elapsed_ns = in_capture_position_now_ns() - start_ns;
+    int bucket = 0;
+
+    if (elapsed_ns > 0)
+        bucket = 63 - __builtin_clzll((unsigned long long)elapsed_ns) - 6;
+    if (bucket < 0)
+        bucket = 0;
+    else if (bucket >= CAPTURE_POS_LATENCY_BUCKETS)
+        bucket = CAPTURE_POS_LATENCY_BUCKETS - 1;
+    android_atomic_inc(&in->capture_pos.latency_hist[bucket]);
+}
+
+static void in_dump_capture_position_stats(struct stream_in *in, int fd)
+{
+    static const int percentiles[] = { 50, 90, 99 };
+    int64_t bounds[sizeof(percentiles) / sizeof(percentiles[0])] = { 0 };
+    int64_t total = 0, count = 0;
+    unsigned int i, p = 0;
+
+    for (i = 0; i < CAPTURE_POS_LATENCY_BUCKETS; i++)
+        total += android_atomic_acquire_load(&in->capture_pos.latency_hist[i]);
+    if (total == 0)
+        return;
+
+    for (i = 0; i < CAPTURE_POS_LATENCY_BUCKETS &&
+                p < sizeof(percentiles) / sizeof(percentiles[0]); i++) {
+        count += android_atomic_acquire_load(&in->capture_pos.latency_hist[i]);
+        while (p < sizeof(percentiles) / sizeof(percentiles[0]) &&
+               count * 100 >= total * percentiles[p])
+            bounds[p++] = 64LL << (i + 1);
+    }
+    dprintf(fd, "      Capture position queries: %d snapshot, %d driver\n",
+            android_atomic_acquire_load(&in->capture_pos.fast_queries),
+            android_atomic_acquire_load(&in->capture_pos.driver_queries));
+    dprintf(fd, "      Capture position latency ns: p50 < %lld, p90 < %lld, p99 < %lld\n",
+            (long long)bounds[0], (long long)bounds[1], (long long)bounds[2]);
+}
+
 static int in_standby(struct audio_stream *stream)
 {
     struct stream_in *in = (struct stream_in *)stream;
@@ -7372,6 +7501,7 @@ static int in_standby(struct audio_stream *stream)
     bool do_stop = true;
 
     lock_input_stream(in);
+    in_invalidate_capture_position(in);
     if (!in->standby && in->is_st_session) {
         ALOGD("%s: sound trigger pcm stop lab", __func__);
         audio_extn_sound_trigger_stop_lab(in);
@@ -7387,6 +7517,9 @@ static int in_standby(struct audio_stream *stream)
         pthread_mutex_lock(&adev->lock);
         amplifier_input_stream_standby((struct audio_stream_in *) stream);
 
+        /* join the lvfs worker before the capture it was fed from is closed */
+        lvfs_pipeline_stop(in);
+
         in->standby = true;
         if (in->usecase == USECASE_COMPRESS_VOIP_CALL) {
             do_stop = false;
@@ -7446,10 +7579,20 @@ static int in_dump(const struct audio_stream *stream,
         simple_stats_to_string(&in->start_latency_ms, buffer, sizeof(buffer));
         dprintf(fd, "      Start latency ms: %s\n", buffer);
     }
+    if (in->read_cpu_us_unmuted.n > 0) {
+        simple_stats_to_string(&in->read_cpu_us_unmuted, buffer, sizeof(buffer));
+        dprintf(fd, "      Read CPU us: %s\n", buffer);
+    }
+    if (in->read_cpu_us_muted.n > 0) {
+        simple_stats_to_string(&in->read_cpu_us_muted, buffer, sizeof(buffer));
+        dprintf(fd, "      Read CPU us while muted: %s\n", buffer);
+    }
 #endif
     if (locked) {
+        lvfs_pipeline_dump(in, fd);
         pthread_mutex_unlock(&in->lock);
     }
+    in_dump_capture_position_stats(in, fd);
 #ifndef LINUX_ENABLED
     // dump error info
     (void)error_log_dump(
@@ -7669,6 +7812,94 @@ static int in_set_gain(struct audio_stream_in *stream,
     return 0;
 }
 
+/*
+ * Instead of writing zeroes here, we could trust the hardware to always
+ * provide zeroes when muted. This is also muted with voice recognition
+ * usecases so that other clients do not have access to voice recognition
+ * data.
+ */
+static bool in_is_muted(struct stream_in *in)
+{
+    struct audio_device *adev = in->dev;
+
+    /* aviod FM usecase muting, upon muting MIC.*/
+    if (in->usecase == USECASE_AUDIO_RECORD_FM_VIRTUAL)
+        return false;
+
+    /*
+     * compress capture fragments start with a snd_codec_metadata header and
+     * may carry an encoded payload, zeroing or ramping them corrupts both
+     */
+    if (audio_extn_cin_attached_usecase(in))
+        return false;
+
+    return (voice_get_mic_mute(adev) &&
+            !voice_is_in_call_rec_stream(in) &&
+            (in->usecase != USECASE_AUDIO_RECORD_AFE_PROXY &&
+             in->usecase != USECASE_AUDIO_RECORD_AFE_PROXY2 &&
+             in->source != AUDIO_SOURCE_FM_TUNER &&
+             !is_single_device_type_equal(&in->device_list, AUDIO_DEVICE_IN_FM_TUNER))) ||
+           (adev->num_va_sessions &&
+            in->source != AUDIO_SOURCE_VOICE_RECOGNITION &&
+            property_get_bool("persist.vendor.audio.va_concurrency_mute_enabled",
+               false));
+}
+
+#define UNMUTE_RAMP_MS 10
+
+/* linear fade in over the first UNMUTE_RAMP_MS of a block to avoid clicks */
+static void in_apply_unmute_ramp(struct stream_in *in, void *buffer, size_t bytes)
+{
+    size_t frame_size = audio_stream_in_frame_size(&in->stream);
+    uint32_t channels = audio_channel_count_from_in_mask(in->channel_mask);
+    size_t frames, ramp_frames, i, c;
+
+    if (frame_size == 0 || channels == 0 || in->config.rate == 0)
+        return;
+
+    frames = bytes / frame_size;
+    ramp_frames = in->config.rate * UNMUTE_RAMP_MS / 1000;
+    if (ramp_frames > frames)
+        ramp_frames = frames;
+
+    switch (in->format) {
+    case AUDIO_FORMAT_PCM_16_BIT: {
+        int16_t *samples = (int16_t *)buffer;
+        for (i = 0; i < ramp_frames; i++)
+            for (c = 0; c < channels; c++, samples++)
+                *samples = (int16_t)(((int32_t)*samples * (int32_t)i) /
+                                     (int32_t)ramp_frames);
+        break;
+    }
+    case AUDIO_FORMAT_PCM_32_BIT:
+    case AUDIO_FORMAT_PCM_8_24_BIT: {
+        int32_t *samples = (int32_t *)buffer;
+        for (i = 0; i < ramp_frames; i++)
+            for (c = 0; c < channels; c++, samples++)
+                *samples = (int32_t)(((int64_t)*samples * (int64_t)i) /
+                                     (int64_t)ramp_frames);
+        break;
+    }
+    case AUDIO_FORMAT_PCM_FLOAT: {
+        float *samples = (float *)buffer;
+        for (i = 0; i < ramp_frames; i++)
+            for (c = 0; c < channels; c++, samples++)
+                *samples *= (float)i / (float)ramp_frames;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static int64_t in_thread_cpu_time_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
 static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
                        size_t bytes)
 {
@@ -7682,6 +7913,8 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
     struct audio_device *adev = in->dev;
     int ret = -1;
     size_t bytes_read = 0, frame_size = 0;
+    bool muted = false;
+    int64_t cpu_start_us = 0;
 
     lock_input_stream(in);
 
@@ -7756,6 +7989,10 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
         goto exit;
     bool use_mmap = is_mmap_usecase(in->usecase) || in->realtime;
 
+    /* while muted the data is discarded, skip conversion and processing */
+    muted = in_is_muted(in);
+    cpu_start_us = in_thread_cpu_time_us();
+
     if (audio_extn_cin_attached_usecase(in)) {
         ret = audio_extn_cin_read(in, buffer, bytes, &bytes_read);
     } else if (in->pcm) {
@@ -7770,7 +8007,8 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
         } else {
             ret = pcm_read(in->pcm, buffer, bytes);
             /* data from DSP comes in 24_8 format, convert it to 8_24 */
-            if (!ret && bytes > 0 && (in->format == AUDIO_FORMAT_PCM_8_24_BIT)) {
+            if (!ret && bytes > 0 && !muted &&
+                (in->format == AUDIO_FORMAT_PCM_8_24_BIT)) {
                 if (audio_extn_utils_convert_format_24_8_to_8_24(buffer, bytes)
                     != bytes) {
                     ret = -EINVAL;
@@ -7786,42 +8024,47 @@ static ssize_t in_read(struct audio_stream_in *stream, void *buffer,
 
     release_in_focus(in);
 
-    /*
-     * Instead of writing zeroes here, we could trust the hardware to always
-     * provide zeroes when muted. This is also muted with voice recognition
-     * usecases so that other clients do not have access to voice recognition
-     * data.
-     */
-    if ((ret == 0 && voice_get_mic_mute(adev) &&
-         !voice_is_in_call_rec_stream(in) &&
-         (in->usecase != USECASE_AUDIO_RECORD_AFE_PROXY &&
-          in->usecase != USECASE_AUDIO_RECORD_AFE_PROXY2 &&
-          in->source != AUDIO_SOURCE_FM_TUNER &&
-          !is_single_device_type_equal(&in->device_list, AUDIO_DEVICE_IN_FM_TUNER))) ||
-        (adev->num_va_sessions &&
-         in->source != AUDIO_SOURCE_VOICE_RECOGNITION &&
-         property_get_bool("persist.vendor.audio.va_concurrency_mute_enabled",
-            false))) {
-
-        /* aviod FM usecase muting, upon muting MIC.*/
-        if (in->usecase != USECASE_AUDIO_RECORD_FM_VIRTUAL) {
-            memset(buffer, 0, bytes);
+    if (muted) {
+        memset(buffer, 0, bytes);
+        frame_size = audio_stream_in_frame_size(stream);
+        if (ret == 0 && frame_size > 0)
+            in->frames_muted += bytes_read / frame_size;
+        in->unmute_ramp_pending = true;
+        in->lvfs_flush_pending = true;
+    } else {
+        bool processed = true;
+
+        /* the block queued before mute must not come out after it */
+        if (in->lvfs_flush_pending) {
+            lvfs_pipeline_flush(in);
+            in->lvfs_flush_pending = false;
         }
-    }
 
-    if (lvacfs_wrapper_ops && in->lvacfs_handle) {
-        lvacfs_process_input_stream(in, buffer, bytes);
-    }
+        if ((lvacfs_wrapper_ops && in->lvacfs_handle) ||
+            (lvimfs_wrapper_ops && in->lvimfs_instance)) {
+            processed = lvfs_pipeline_process(in, buffer, bytes);
+        }
 
-    if (lvimfs_wrapper_ops && in->lvimfs_instance) {
-        lvimfs_process_input_stream(in, buffer, bytes);
+        /* ramp the first block of audio handed back, not the pipeline input */
+        if (ret == 0 && processed && in->unmute_ramp_pending) {
+            in_apply_unmute_ramp(in, buffer, bytes_read);
+            in->unmute_ramp_pending = false;
+        }
     }
 
+#ifndef LINUX_ENABLED
+    simple_stats_log(muted ? &in->read_cpu_us_muted : &in->read_cpu_us_unmuted,
+                     in_thread_cpu_time_us() - cpu_start_us);
+#endif
+
 exit:
     frame_size = audio_stream_in_frame_size(stream);
     if (frame_size > 0)
         in->frames_read += bytes_read/frame_size;
 
+    if (ret == 0 && in->pcm && !audio_extn_cin_attached_usecase(in))
+        in_publish_capture_position(in);
+
     if (-ENETRESET == ret)
         in->card_status = CARD_STATUS_OFFLINE;
     pthread_mutex_unlock(&in->lock);
@@ -7860,7 +8103,15 @@ static int in_get_capture_position(const struct audio_stream_in *stream,
     }
     struct stream_in *in = (struct stream_in *)stream;
     int ret = -ENOSYS;
+    const int64_t start_ns = in_capture_position_now_ns();
 
+    if (in_get_capture_position_snapshot(in, frames, time) == 0) {
+        android_atomic_inc(&in->capture_pos.fast_queries);
+        in_log_capture_position_latency(in, start_ns);
+        return 0;
+    }
+
+    android_atomic_inc(&in->capture_pos.driver_queries);
     lock_input_stream(in);
     // note: ST sessions do not close the alsa pcm driver synchronously
     // on standby. Therefore, we may return an error even though the
@@ -7876,7 +8127,8 @@ static int in_get_capture_position(const struct audio_stream_in *stream,
         if (pcm_get_htimestamp(in->pcm, &avail, &timestamp) == 0) {
             *frames = in->frames_read + avail;
             *time = timestamp.tv_sec * 1000000000LL + timestamp.tv_nsec
-                    - platform_capture_latency(in) * 1000LL;
+                    - platform_capture_latency(in) * 1000LL
+                    - lvfs_pipeline_latency_ns(in);
              //Adjustment accounts for A2dp decoder latency for recording usecase
              // Note: decoder latency is returned in ms, while platform_capture_latency in ns.
             if (is_a2dp_in_device_type(&in->device_list))
@@ -7886,6 +8138,7 @@ static int in_get_capture_position(const struct audio_stream_in *stream,
     }
 exit:
     pthread_mutex_unlock(&in->lock);
+    in_log_capture_position_latency(in, start_ns);
     return ret;
 }
 
@@ -8302,6 +8555,128 @@ static void in_update_sink_metadata(struct audio_stream_in *stream,
     pthread_mutex_unlock(&in->lock);
 }
 
+/* cin_private_data and its codec, see compress_in.c */
+#define STREAM_IN_ARENA_CIN_SIZE \
+        (STREAM_ARENA_ALIGN_UP(sizeof(struct snd_codec)) + \
+         STREAM_IN_ARENA_CIN_PRIVATE_SIZE)
+#define STREAM_ARENA_REPORT_INTERVAL 64
+
+/* usage collected with vendor.audio.stream_arena.debug */
+static struct {
+    pthread_mutex_t lock;
+    size_t peak[AUDIO_USECASE_MAX];
+    uint32_t opens;
+    int64_t open_ns;
+    size_t heap_base;
+} stream_arena_stats = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/*
+ * Allocates a stream struct of stream_size with arena_size bytes of arena
+ * behind it and points the arena, found at arena_offset in the struct, at
+ * that space.
+ */
+static void *stream_arena_create(size_t stream_size, size_t arena_offset,
+                                 size_t arena_size)
+{
+    size_t inline_offset = STREAM_ARENA_ALIGN_UP(stream_size);
+    struct stream_arena *arena;
+    char *stream;
+
+    arena_size = STREAM_ARENA_ALIGN_UP(arena_size);
+    stream = (char *)calloc(1, inline_offset + arena_size);
+    if (!stream)
+        return NULL;
+
+    arena = (struct stream_arena *)(stream + arena_offset);
+    arena->base = stream + inline_offset;
+    arena->size = arena_size;
+    return stream;
+}
+
+/* zeroed memory owned by the arena, do not free() it */
+void *stream_arena_alloc(struct stream_arena *arena, size_t size)
+{
+    struct stream_arena_chunk *chunk;
+    size_t chunk_offset = STREAM_ARENA_ALIGN_UP(sizeof(struct stream_arena_chunk));
+    void *ptr;
+
+    size = STREAM_ARENA_ALIGN_UP(size);
+    if (size <= arena->size - arena->used) {
+        ptr = arena->base + arena->used;
+        arena->used += size;
+        return ptr;
+    }
+
+    chunk = (struct stream_arena_chunk *)calloc(1, chunk_offset + size);
+    if (!chunk)
+        return NULL;
+    chunk->size = size;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->overflow += size;
+    return (char *)chunk + chunk_offset;
+}
+
+void stream_arena_release(struct stream_arena *arena)
+{
+    struct stream_arena_chunk *chunk;
+
+    while (arena->chunks) {
+        chunk = arena->chunks;
+        arena->chunks = chunk->next;
+        free(chunk);
+    }
+    arena->used = 0;
+    arena->overflow = 0;
+}
+
+static void stream_arena_account_open(struct audio_device *adev, int64_t start_ns)
+{
+    if (!adev->stream_arena_debug)
+        return;
+
+    pthread_mutex_lock(&stream_arena_stats.lock);
+    stream_arena_stats.opens++;
+    stream_arena_stats.open_ns += systemTime(SYSTEM_TIME_MONOTONIC) - start_ns;
+    pthread_mutex_unlock(&stream_arena_stats.lock);
+}
+
+/*
+ * Records the arena usage of a closing stream. Peaks are logged per usecase
+ * so the inline sizes can be tuned, open/close churn every
+ * STREAM_ARENA_REPORT_INTERVAL opens with the heap in use at that point.
+ */
+static void stream_arena_account_close(struct audio_device *adev,
+                                       audio_usecase_t usecase,
+                                       const struct stream_arena *arena)
+{
+    size_t used = arena->used + arena->overflow;
+    struct mallinfo mi;
+
+    if (!adev->stream_arena_debug || usecase >= AUDIO_USECASE_MAX)
+        return;
+
+    pthread_mutex_lock(&stream_arena_stats.lock);
+    if (used > stream_arena_stats.peak[usecase]) {
+        stream_arena_stats.peak[usecase] = used;
+        ALOGD("%s: %s peak %zu bytes, inline %zu overflow %zu", __func__,
+              use_case_table[usecase], used, arena->size, arena->overflow);
+    }
+    if (stream_arena_stats.opens >= STREAM_ARENA_REPORT_INTERVAL) {
+        mi = mallinfo();
+        if (stream_arena_stats.heap_base == 0)
+            stream_arena_stats.heap_base = mi.uordblks;
+        ALOGD("%s: %u opens, avg open %lld us, heap in use %zu growth %zd",
+              __func__, stream_arena_stats.opens,
+              (long long)(stream_arena_stats.open_ns / stream_arena_stats.opens / 1000),
+              (size_t)mi.uordblks,
+              (ssize_t)mi.uordblks - (ssize_t)stream_arena_stats.heap_base);
+        stream_arena_stats.opens = 0;
+        stream_arena_stats.open_ns = 0;
+    }
+    pthread_mutex_unlock(&stream_arena_stats.lock);
+}
+
 int adev_open_output_stream(struct audio_hw_device *dev,
                             audio_io_handle_t handle,
                             audio_devices_t devices,
@@ -8330,6 +8705,8 @@ int adev_open_output_stream(struct audio_hw_device *dev,
     __s32 *generic_dec;
 #endif
     pthread_mutexattr_t latch_attr;
+    int64_t open_start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t arena_size = 0;
 
     if (is_usb_dev && (!audio_extn_usb_connected(NULL))) {
         is_usb_dev = false;
@@ -8346,7 +8723,11 @@ int adev_open_output_stream(struct audio_hw_device *dev,
 
     *stream_out = NULL;
 
-    out = (struct stream_out *)calloc(1, sizeof(struct stream_out));
+    if ((flags & AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD) ||
+        (flags == AUDIO_OUTPUT_FLAG_DIRECT))
+        arena_size += sizeof(struct snd_codec);
+    out = (struct stream_out *)stream_arena_create(sizeof(struct stream_out),
+                                   offsetof(struct stream_out, arena), arena_size);
 
     ALOGD("%s: enter: format(%#x) sample_rate(%d) channel_mask(%#x) devices(%#x) flags(%#x)\
         stream_handle(%p) address(%s)", __func__, config->format, config->sample_rate, config->channel_mask,
@@ -8594,7 +8975,7 @@ int adev_open_output_stream(struct audio_hw_device *dev,
         }
 
         out->compr_config.codec = (struct snd_codec *)
-                                    calloc(1, sizeof(struct snd_codec));
+                stream_arena_alloc(&out->arena, sizeof(struct snd_codec));
 
         if (!out->compr_config.codec) {
             ret = -ENOMEM;
@@ -8733,7 +9114,8 @@ int adev_open_output_stream(struct audio_hw_device *dev,
                  *size of convert buffer is equal to the size required to hold one fragment size
                  *worth of pcm data, this is because flinger does not write more than fragment_size
                  */
-                out->convert_buffer = calloc(1,out->compr_config.fragment_size);
+                out->convert_buffer = stream_arena_alloc(&out->arena,
+                                                         out->compr_config.fragment_size);
                 if (out->convert_buffer == NULL){
                     ALOGE("Allocation failed for convert buffer for size %d", out->compr_config.fragment_size);
                     ret = -ENOMEM;
@@ -9048,7 +9430,7 @@ int adev_open_output_stream(struct audio_hw_device *dev,
             uint32_t buffer_size = out->config.period_size *
                                    format_to_bitwidth_table[out->hal_op_format] *
                                    out->config.channels;
-            out->convert_buffer = calloc(1, buffer_size);
+            out->convert_buffer = stream_arena_alloc(&out->arena, buffer_size);
             if (out->convert_buffer == NULL){
                 ALOGE("Allocation failed for convert buffer for size %d",
                        out->compr_config.fragment_size);
@@ -9205,12 +9587,12 @@ int adev_open_output_stream(struct audio_hw_device *dev,
     pthread_mutex_unlock(&adev->lock);
     pthread_mutex_unlock(&adev->active_outputs_list_lock);
 
+    stream_arena_account_open(adev, open_start_ns);
     ALOGV("%s: exit", __func__);
     return 0;
 
 error_open:
-    if (out->convert_buffer)
-        free(out->convert_buffer);
+    stream_arena_release(&out->arena);
     free(out);
     *stream_out = NULL;
     ALOGD("%s: exit: ret %d", __func__, ret);
@@ -9267,8 +9649,6 @@ void adev_close_output_stream(struct audio_hw_device *dev __unused,
         audio_extn_dts_remove_state_notifier_node(out->usecase);
         destroy_offload_callback_thread(out);
         free_offload_usecase(adev, out->usecase);
-        if (out->compr_config.codec != NULL)
-            free(out->compr_config.codec);
     }
 
     out->a2dp_muted = false;
@@ -9276,11 +9656,6 @@ void adev_close_output_stream(struct audio_hw_device *dev __unused,
     if (is_interactive_usecase(out->usecase))
         free_interactive_usecase(adev, out->usecase);
 
-    if (out->convert_buffer != NULL) {
-        free(out->convert_buffer);
-        out->convert_buffer = NULL;
-    }
-
     if (adev->voice_tx_output == out)
         adev->voice_tx_output = NULL;
 
@@ -9297,6 +9672,11 @@ void adev_close_output_stream(struct audio_hw_device *dev __unused,
     pthread_mutex_destroy(&out->latch_lock);
     pthread_mutex_destroy(&out->position_query_lock);
 
+    stream_arena_account_close(adev, out->usecase, &out->arena);
+    stream_arena_release(&out->arena);
+    out->compr_config.codec = NULL;
+    out->convert_buffer = NULL;
+
     pthread_mutex_lock(&adev->lock);
     clear_devices(&out->device_list);
     free(stream);
@@ -9969,6 +10349,9 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
                                                             devices,
                                                             flags,
                                                             source);
+    int64_t open_start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    size_t arena_size = 0;
+
     ALOGV("%s: enter: flags %#x, is_usb_dev %d, may_use_hifi_record %d,"
             " sample_rate %u, channel_mask %#x, format %#x",
             __func__, flags, is_usb_dev, may_use_hifi_record,
@@ -9998,7 +10381,10 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
             return -EINVAL;
     }
 
-    in = (struct stream_in *)calloc(1, sizeof(struct stream_in));
+    if (flags & (AUDIO_INPUT_FLAG_COMPRESS | AUDIO_INPUT_FLAG_TIMESTAMP))
+        arena_size += STREAM_IN_ARENA_CIN_SIZE;
+    in = (struct stream_in *)stream_arena_create(sizeof(struct stream_in),
+                                  offsetof(struct stream_in, arena), arena_size);
 
     if (!in) {
         ALOGE("failed to allocate input stream");
@@ -10499,6 +10885,7 @@ static int adev_open_input_stream(struct audio_hw_device *dev,
     pthread_mutex_unlock(&adev->lock);
     pthread_mutex_unlock(&adev->active_inputs_list_lock);
 
+    stream_arena_account_open(adev, open_start_ns);
     ALOGV("%s: exit", __func__);
     return ret;
 
@@ -10517,6 +10904,7 @@ err_open:
         adev->pcm_low_latency_record_uc_state = 0;
         pthread_mutex_unlock(&adev->lock);
     }
+    stream_arena_release(&in->arena);
     free(in);
     *stream_in = NULL;
     return ret;
@@ -10617,6 +11005,8 @@ static void adev_close_input_stream(struct audio_hw_device *dev,
         ALOGV("%s: sound trigger pcm stop lab", __func__);
         audio_extn_sound_trigger_stop_lab(in);
     }
+    stream_arena_account_close(adev, in->usecase, &in->arena);
+    stream_arena_release(&in->arena);
     clear_devices(&in->device_list);
     free(stream);
     pthread_mutex_unlock(&adev->lock);
@@ -11614,6 +12004,8 @@ static int adev_open(const hw_module_t *module, const char *name,
     }
 
     adev->mic_break_enabled = property_get_bool("vendor.audio.mic_break", false);
+    adev->stream_arena_debug =
+        property_get_bool("vendor.audio.stream_arena.debug", false);
 
     adev->camera_orientation = CAMERA_DEFAULT;
 
@@ -447,6 +447,31 @@ typedef struct streams_output_ctxt {
     struct stream_out *output;
 } streams_output_ctxt_t;
 
+/*
+ * Allocations that live as long as a stream. The inline part is allocated
+ * together with the stream struct and sized from the open flags, requests
+ * that do not fit go to overflow chunks. Nothing is freed individually,
+ * everything goes in stream_arena_release() when the stream is closed.
+ */
+#define STREAM_ARENA_ALIGN 16
+#define STREAM_ARENA_ALIGN_UP(x) \
+        (((x) + STREAM_ARENA_ALIGN - 1) & ~((size_t)STREAM_ARENA_ALIGN - 1))
+/* room for cin_private_data, compress_in.c checks that it fits */
+#define STREAM_IN_ARENA_CIN_PRIVATE_SIZE 128
+
+struct stream_arena_chunk {
+    struct stream_arena_chunk *next;
+    size_t size;
+};
+
+struct stream_arena {
+    char *base;
+    size_t size;
+    size_t used;
+    size_t overflow;    /* bytes handed out from chunks */
+    struct stream_arena_chunk *chunks;
+};
+
 struct stream_inout {
     pthread_mutex_t lock; /* see note below on mutex acquisition order */
     pthread_mutex_t pre_lock; /* acquire before lock to avoid DOS by playback thread */
@@ -464,6 +489,7 @@ struct stream_inout {
 
 struct stream_out {
     struct audio_stream_out stream;
+    struct stream_arena arena;
     pthread_mutex_t lock; /* see note below on mutex acquisition order */
     pthread_mutex_t pre_lock; /* acquire before lock to avoid DOS by playback thread */
     pthread_cond_t  cond;
@@ -582,8 +608,29 @@ struct stream_out {
     simple_stats_t start_latency_ms;
 };
 
+#define CAPTURE_POS_LATENCY_BUCKETS 16
+
+/*
+ * Capture position published by in_read() under a sequence lock so that
+ * in_get_capture_position() can extrapolate without taking in->lock.
+ * An odd seq means an update is in progress, time_ns 0 means invalid.
+ */
+struct capture_position_snapshot {
+    volatile int32_t seq;
+    int64_t frames;
+    int64_t time_ns;      /* hw timestamp of frames */
+    int64_t latency_ns;   /* capture path latency subtracted from time */
+    int64_t stale_ns;     /* age after which the driver is queried again */
+    uint32_t rate;
+    /* query statistics, log2 buckets of query latency starting at 64ns */
+    volatile int32_t fast_queries;
+    volatile int32_t driver_queries;
+    volatile int32_t latency_hist[CAPTURE_POS_LATENCY_BUCKETS];
+};
+
 struct stream_in {
     struct audio_stream_in stream;
+    struct stream_arena arena;
     pthread_mutex_t lock; /* see note below on mutex acquisition order */
     pthread_mutex_t pre_lock; /* acquire before lock to avoid DOS by playback thread */
     struct pcm_config config;
@@ -632,6 +679,10 @@ struct stream_in {
 
     int64_t frames_read; /* total frames read, not cleared when entering standby */
     int64_t frames_muted; /* total frames muted, not cleared when entering standby */
+    bool unmute_ramp_pending; /* fade in the first block read after mute */
+    simple_stats_t read_cpu_us_muted;
+    simple_stats_t read_cpu_us_unmuted;
+    struct capture_position_snapshot capture_pos;
 
 #ifndef LINUX_ENABLED
     error_log_t *error_log;
@@ -645,6 +696,9 @@ struct stream_in {
 
     void** lvimfs_instance;
     pthread_mutex_t lvimfs_lock;
+
+    struct lvfs_pipeline* lvfs_pipeline;
+    bool lvfs_flush_pending; /* drop the pipelined block queued before mute */
 };
 
 typedef enum {
@@ -767,6 +821,7 @@ struct audio_device {
     bool allow_afe_proxy_usage;
     bool is_charging; // from battery listener
     bool mic_break_enabled;
+    bool stream_arena_debug;
     bool enable_hfp;
     bool mic_muted;
     bool enable_voicerx;
@@ -898,6 +953,9 @@ struct audio_usecase *get_usecase_from_list(const struct audio_device *adev,
 
 bool is_offload_usecase(audio_usecase_t uc_id);
 
+void *stream_arena_alloc(struct stream_arena *arena, size_t size);
+void stream_arena_release(struct stream_arena *arena);
+
 bool audio_is_true_native_stream_active(struct audio_device *adev);
 
 bool audio_is_dsd_native_stream_active(struct audio_device *adev);
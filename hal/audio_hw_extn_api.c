@@ -218,50 +218,105 @@ int qahwi_in_stop(struct audio_stream_in* stream) {
     return 0;
 }
 
-ssize_t qahwi_in_read_v2(struct audio_stream_in *stream, void* buffer,
-                          size_t bytes, uint64_t *timestamp)
+static bool qahwi_in_timestamp_mode(struct stream_in *in)
+{
+    return COMPRESSED_TIMESTAMP_FLAG &&
+           ((in->flags & AUDIO_INPUT_FLAG_TIMESTAMP) ||
+            (in->flags & AUDIO_INPUT_FLAG_PASSTHROUGH));
+}
+
+/*
+ * Reads up to max_frames fragments into the staging buffer with a single
+ * read call and returns descriptors pointing at the payload of each one,
+ * so callers can consume the data in place.
+ */
+int qahwi_in_read_frames(struct audio_stream_in *stream,
+                         struct qahwi_in_frame *frames,
+                         uint32_t max_frames)
 {
     struct stream_in *in = (struct stream_in *)stream;
     struct snd_codec_metadata *mdata = NULL;
-    size_t mdata_size = 0, bytes_read = 0;
+    size_t mdata_size = sizeof(struct snd_codec_metadata);
+    uint32_t num_frames = 0, i = 0;
     char *buf = NULL;
-    size_t ret = 0;
+    ssize_t ret = 0;
+
+    if (!in->qahwi_in.is_inititalized || !in->qahwi_in.ibuf) {
+        ALOGE("%s: invalid state!", __func__);
+        return -EINVAL;
+    }
+    if (!qahwi_in_timestamp_mode(in)) {
+        ALOGE("%s: only supported in timestamp mode!", __func__);
+        return -ENOSYS;
+    }
+    if (frames == NULL || max_frames == 0)
+        return -EINVAL;
+
+    num_frames = max_frames > QAHWI_IN_MAX_FRAMES ?
+                 QAHWI_IN_MAX_FRAMES : max_frames;
+    buf = (char *) in->qahwi_in.ibuf;
+    ret = in->qahwi_in.base.read(&in->stream, (void *)buf,
+                                 num_frames * in->qahwi_in.frag_size);
+    if (ret != (ssize_t)(num_frames * in->qahwi_in.frag_size)) {
+        ALOGE("%s: error! read returned %zd", __func__, ret);
+        return ret < 0 ? ret : -EIO;
+    }
+
+    for (i = 0; i < num_frames; i++) {
+        mdata = (struct snd_codec_metadata *) buf;
+        if (mdata->length > in->qahwi_in.frag_size - mdata_size) {
+            ALOGE("%s: invalid frame length %u", __func__, mdata->length);
+            return -EINVAL;
+        }
+        frames[i].data = buf + mdata_size;
+        frames[i].length = mdata->length;
+        frames[i].timestamp = mdata->timestamp;
+        frames[i].flags = QAHWI_IN_FRAME_TIMESTAMP_VALID;
+        buf += in->qahwi_in.frag_size;
+    }
+
+    in->qahwi_in.read_calls++;
+    in->qahwi_in.frames_read += num_frames;
+    ALOGV("%s: flag 0x%x, frames %u", __func__, in->flags, num_frames);
+    return num_frames;
+}
+
+ssize_t qahwi_in_read_v2(struct audio_stream_in *stream, void* buffer,
+                          size_t bytes, uint64_t *timestamp)
+{
+    struct stream_in *in = (struct stream_in *)stream;
+    struct qahwi_in_frame frame;
+    size_t bytes_read = 0;
+    int ret = 0;
 
     if (!in->qahwi_in.is_inititalized) {
         ALOGE("%s: invalid state!", __func__);
         return -EINVAL;
     }
-    if (COMPRESSED_TIMESTAMP_FLAG &&
-        ((in->flags & AUDIO_INPUT_FLAG_TIMESTAMP) ||
-         (in->flags & AUDIO_INPUT_FLAG_PASSTHROUGH))) {
+    if (qahwi_in_timestamp_mode(in)) {
         if (bytes != in->stream.common.get_buffer_size(&stream->common)) {
             ALOGE("%s: bytes requested must be fragment size in timestamp mode!", __func__);
             return -EINVAL;
         }
-        mdata_size = sizeof(struct snd_codec_metadata);
-        buf = (char *) in->qahwi_in.ibuf;
-        ret = in->qahwi_in.base.read(&in->stream, (void *)buf, bytes + mdata_size);
-        if (ret == bytes + mdata_size) {
-           mdata = (struct snd_codec_metadata *) buf;
-           bytes_read = mdata->length;
+        ret = qahwi_in_read_frames(stream, &frame, 1);
+        if (ret == 1) {
+           bytes_read = frame.length;
            if (bytes_read > bytes) {
               ALOGE("%s: bytes requested to small (given %zu, required %zu)",
                  __func__, bytes, bytes_read);
               return -EINVAL;
            }
-           memcpy(buffer, buf + mdata_size, bytes_read);
+           memcpy(buffer, frame.data, bytes_read);
            if (timestamp) {
-               *timestamp = mdata->timestamp;
+               *timestamp = frame.timestamp;
            }
-        } else {
-           ALOGE("%s: error! read returned %zd", __func__, ret);
         }
     } else {
         bytes_read = in->qahwi_in.base.read(stream, buffer, bytes);
         if (timestamp)
             *timestamp = (uint64_t ) -1;
     }
-    ALOGV("%s: flag 0x%x, bytes %zd, read %zd, ret %zd",
+    ALOGV("%s: flag 0x%x, bytes %zd, read %zd, ret %d",
           __func__, in->flags, bytes, bytes_read, ret);
     return bytes_read;
 }
@@ -277,8 +332,11 @@ static void qahwi_close_input_stream(struct audio_hw_device *dev,
         ALOGE("%s: invalid state!", __func__);
         return;
     }
-    if (in->qahwi_in.ibuf)
+    if (in->qahwi_in.ibuf) {
+        ALOGD("%s: in %p, read calls %" PRIu64 ", frames %" PRIu64,
+              __func__, in, in->qahwi_in.read_calls, in->qahwi_in.frames_read);
         free(in->qahwi_in.ibuf);
+    }
     adev->qahwi_dev.base.close_input_stream(dev, stream_in);
 }
 
@@ -314,15 +372,15 @@ static int qahwi_open_input_stream(struct audio_hw_device *dev,
 
     in->qahwi_in.is_inititalized = true;
 
-    if (COMPRESSED_TIMESTAMP_FLAG &&
-        ((in->flags & AUDIO_INPUT_FLAG_TIMESTAMP) ||
-         (in->flags & AUDIO_INPUT_FLAG_PASSTHROUGH))) {
+    if (qahwi_in_timestamp_mode(in)) {
         // set read to NULL as this is not supported in timestamp mode
         in->stream.read = NULL;
 
         mdata_size = sizeof(struct snd_codec_metadata);
-        buf_size = mdata_size +
+        in->qahwi_in.frag_size = mdata_size +
                    in->qahwi_in.base.common.get_buffer_size(&in->stream.common);
+        /* room for a full batch of fragments, see qahwi_in_read_frames() */
+        buf_size = in->qahwi_in.frag_size * QAHWI_IN_MAX_FRAMES;
 
         in->qahwi_in.ibuf = malloc(buf_size);
         if (!in->qahwi_in.ibuf) {
@@ -36,10 +36,30 @@ typedef struct qahwi_stream_in qahwi_stream_in_t;
 typedef struct qahwi_stream_out qahwi_stream_out_t;
 typedef struct qahwi_device qahwi_device_t;
 
+/* max number of fragments staged per qahwi_in_read_frames() call */
+#define QAHWI_IN_MAX_FRAMES 8
+
+/* qahwi_in_frame flags */
+#define QAHWI_IN_FRAME_TIMESTAMP_VALID 0x1
+
+/*
+ * Descriptor of one captured fragment. data points into the HAL owned
+ * staging buffer and stays valid until the next read on the same stream.
+ */
+struct qahwi_in_frame {
+    const void *data;
+    size_t length;
+    uint64_t timestamp;
+    uint32_t flags;
+};
+
 struct qahwi_stream_in {
     struct audio_stream_in base;
     bool is_inititalized;
     void *ibuf;
+    size_t frag_size;
+    uint64_t read_calls;
+    uint64_t frames_read;
 };
 
 struct qahwi_stream_out {
@@ -56,6 +76,15 @@ struct qahwi_device {
 
 void qahwi_init(hw_device_t *device);
 void qahwi_deinit(hw_device_t *device);
+
+/*
+ * Timestamp mode only: reads up to max_frames fragments (capped at
+ * QAHWI_IN_MAX_FRAMES) and returns the number of descriptors filled in
+ * frames, or a negative errno.
+ */
+int qahwi_in_read_frames(struct audio_stream_in *stream,
+                         struct qahwi_in_frame *frames,
+                         uint32_t max_frames);
 #else
 typedef void *qahwi_stream_in_t;
 typedef void *qahwi_stream_out_t;
@@ -120,17 +120,16 @@ void lvacfs_start_input_stream(struct stream_in* in) {
     }
 }
 
-void lvacfs_process_input_stream(struct stream_in* in, void* buffer, size_t bytes) {
+int lvacfs_process_input_stream(struct stream_in* in, void* buffer, uint32_t num_frames) {
     pthread_mutex_lock(&in->lvacfs_lock);
-    uint32_t num_frames = pcm_bytes_to_frames(in->pcm, bytes);
     uint8_t status_buffer[0x160] = {0};
     int ret = lvacfs_wrapper_ops->process(in->lvacfs_handle, buffer, buffer, num_frames,
                                           status_buffer);
     if (ret < 0) {
         ALOGE("process failed: %d", ret);
-        lvacfs_stop_input_stream(in);
     }
     pthread_mutex_unlock(&in->lvacfs_lock);
+    return ret;
 }
 
 void lvacfs_stop_input_stream(struct stream_in* in) {
@@ -48,5 +48,6 @@ struct lvacfs_wrapper_ops {
 void lvacfs_init(void);
 void lvacfs_deinit(void);
 void lvacfs_start_input_stream(struct stream_in* in);
-void lvacfs_process_input_stream(struct stream_in* in, void* buffer, size_t bytes);
+/* returns < 0 on failure, the caller stops the instance from the stream thread */
+int lvacfs_process_input_stream(struct stream_in* in, void* buffer, uint32_t num_frames);
 void lvacfs_stop_input_stream(struct stream_in* in);
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) 2026 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "audio_hw_lvfs_pipeline"
+
+#include "audio_hw_lvfs_pipeline.h"
+#include "audio_hw_lvacfs.h"
+#include "audio_hw_lvimfs.h"
+#include <cutils/properties.h>
+#include <log/log.h>
+#include <stdio.h>
+#include <sys/prctl.h>
+#include <time.h>
+
+struct lvfs_pipeline {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    struct stream_in* in;
+    /* block owned by the worker while work_pending is set */
+    uint8_t* work;
+    uint8_t* spare;
+    size_t capacity;
+    size_t work_bytes;
+    /* computed by the stream thread, the worker never touches in->pcm */
+    uint32_t work_frames;
+    /* LVFS_FAILED_* engines the owner has to stop */
+    uint32_t failed;
+    bool work_pending;
+    bool work_ready;
+    bool exit;
+    simple_stats_t proc_time_ms;
+    simple_stats_t queue_depth;
+};
+
+static int64_t lvfs_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+#define LVFS_FAILED_LVACFS 0x1
+#define LVFS_FAILED_LVIMFS 0x2
+
+/* must be called from the stream thread, the pcm may go away on standby */
+static uint32_t lvfs_bytes_to_frames(struct stream_in* in, size_t bytes) {
+    size_t frame_size;
+
+    if (in->pcm) {
+        return pcm_bytes_to_frames(in->pcm, bytes);
+    }
+    frame_size = audio_stream_in_frame_size(&in->stream);
+    return frame_size ? bytes / frame_size : 0;
+}
+
+/* returns the LVFS_FAILED_* engines, they are stopped by lvfs_stop_failed() */
+static uint32_t lvfs_process_block(struct stream_in* in, void* buffer, uint32_t frames) {
+    uint32_t failed = 0;
+
+    if (lvacfs_wrapper_ops && in->lvacfs_handle) {
+        if (lvacfs_process_input_stream(in, buffer, frames) < 0) {
+            failed |= LVFS_FAILED_LVACFS;
+        }
+    }
+
+    if (lvimfs_wrapper_ops && in->lvimfs_instance) {
+        if (lvimfs_process_input_stream(in, buffer, frames) < 0) {
+            failed |= LVFS_FAILED_LVIMFS;
+        }
+    }
+    return failed;
+}
+
+/* must be called from the stream thread while the worker is idle */
+static void lvfs_stop_failed(struct stream_in* in, uint32_t failed) {
+    if (failed & LVFS_FAILED_LVACFS) {
+        pthread_mutex_lock(&in->lvacfs_lock);
+        lvacfs_stop_input_stream(in);
+        pthread_mutex_unlock(&in->lvacfs_lock);
+    }
+
+    if (failed & LVFS_FAILED_LVIMFS) {
+        pthread_mutex_lock(&in->lvimfs_lock);
+        lvimfs_stop_input_stream(in);
+        pthread_mutex_unlock(&in->lvimfs_lock);
+    }
+}
+
+static void* lvfs_pipeline_thread_loop(void* context) {
+    struct lvfs_pipeline* pipe = (struct lvfs_pipeline*)context;
+
+    prctl(PR_SET_NAME, (unsigned long)"lvfs_pipeline", 0, 0, 0);
+
+    pthread_mutex_lock(&pipe->lock);
+    while (!pipe->exit) {
+        if (!pipe->work_pending) {
+            pthread_cond_wait(&pipe->cond, &pipe->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pipe->lock);
+
+        int64_t start_ns = lvfs_now_ns();
+        uint32_t failed = lvfs_process_block(pipe->in, pipe->work, pipe->work_frames);
+        double elapsed_ms = (lvfs_now_ns() - start_ns) * 1e-6;
+
+        pthread_mutex_lock(&pipe->lock);
+        simple_stats_log(&pipe->proc_time_ms, elapsed_ms);
+        pipe->failed |= failed;
+        pipe->work_pending = false;
+        pipe->work_ready = true;
+        pthread_cond_broadcast(&pipe->cond);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+    return NULL;
+}
+
+static bool lvfs_pipeline_allowed(struct stream_in* in) {
+    if (in->realtime || (in->flags & AUDIO_INPUT_FLAG_FAST) ||
+        in->usecase == USECASE_AUDIO_RECORD_LOW_LATENCY ||
+        in->usecase == USECASE_AUDIO_RECORD_MMAP) {
+        return false;
+    }
+    return property_get_bool("vendor.audio.lvfs.pipelined", false);
+}
+
+void lvfs_pipeline_start(struct stream_in* in) {
+    struct lvfs_pipeline* pipe;
+
+    if (in->lvfs_pipeline || !lvfs_pipeline_allowed(in)) {
+        return;
+    }
+
+    pipe = (struct lvfs_pipeline*)calloc(1, sizeof(struct lvfs_pipeline));
+    if (!pipe) {
+        ALOGE("Failed to allocate lvfs pipeline");
+        return;
+    }
+    pipe->in = in;
+    pthread_mutex_init(&pipe->lock, (const pthread_mutexattr_t*)NULL);
+    pthread_cond_init(&pipe->cond, (const pthread_condattr_t*)NULL);
+
+    if (pthread_create(&pipe->thread, (const pthread_attr_t*)NULL, lvfs_pipeline_thread_loop,
+                       pipe)) {
+        ALOGE("Failed to create lvfs pipeline thread, staying synchronous");
+        pthread_cond_destroy(&pipe->cond);
+        pthread_mutex_destroy(&pipe->lock);
+        free(pipe);
+        return;
+    }
+    in->lvfs_pipeline = pipe;
+    ALOGD("lvfs pipeline started for usecase %d", in->usecase);
+}
+
+bool lvfs_pipeline_process(struct stream_in* in, void* buffer, size_t bytes) {
+    struct lvfs_pipeline* pipe = in->lvfs_pipeline;
+    uint32_t frames = lvfs_bytes_to_frames(in, bytes);
+    uint8_t* tmp;
+    bool processed;
+
+    if (!pipe) {
+        lvfs_stop_failed(in, lvfs_process_block(in, buffer, frames));
+        return true;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    simple_stats_log(&pipe->queue_depth, pipe->work_pending ? 1 : 0);
+    while (pipe->work_pending) {
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    if (pipe->failed) {
+        lvfs_stop_failed(in, pipe->failed);
+        pipe->failed = 0;
+    }
+
+    if (bytes > pipe->capacity) {
+        free(pipe->work);
+        free(pipe->spare);
+        pipe->work = (uint8_t*)malloc(bytes);
+        pipe->spare = (uint8_t*)malloc(bytes);
+        pipe->work_ready = false;
+        if (!pipe->work || !pipe->spare) {
+            ALOGE("Failed to allocate lvfs pipeline buffers");
+            free(pipe->work);
+            free(pipe->spare);
+            pipe->work = pipe->spare = NULL;
+            pipe->capacity = 0;
+            pthread_mutex_unlock(&pipe->lock);
+            lvfs_stop_failed(in, lvfs_process_block(in, buffer, frames));
+            return true;
+        }
+        pipe->capacity = bytes;
+    }
+
+    /* hand block N to the worker and return the processed block N-1 */
+    memcpy(pipe->spare, buffer, bytes);
+    processed = pipe->work_ready && pipe->work_bytes == bytes;
+    if (processed) {
+        memcpy(buffer, pipe->work, bytes);
+    } else {
+        memset(buffer, 0, bytes);
+    }
+    tmp = pipe->work;
+    pipe->work = pipe->spare;
+    pipe->spare = tmp;
+    pipe->work_bytes = bytes;
+    pipe->work_frames = frames;
+    pipe->work_ready = false;
+    pipe->work_pending = true;
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+    return processed;
+}
+
+void lvfs_pipeline_flush(struct stream_in* in) {
+    struct lvfs_pipeline* pipe = in->lvfs_pipeline;
+
+    if (!pipe) {
+        return;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    while (pipe->work_pending) {
+        pthread_cond_wait(&pipe->cond, &pipe->lock);
+    }
+    pipe->work_ready = false;
+    pipe->work_bytes = 0;
+    pthread_mutex_unlock(&pipe->lock);
+}
+
+int64_t lvfs_pipeline_latency_ns(struct stream_in* in) {
+    struct lvfs_pipeline* pipe = in->lvfs_pipeline;
+    size_t frame_size = audio_stream_in_frame_size(&in->stream);
+    size_t bytes;
+
+    if (!pipe || frame_size == 0 || in->config.rate == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    bytes = pipe->work_bytes;
+    pthread_mutex_unlock(&pipe->lock);
+    return (int64_t)(bytes / frame_size) * 1000000000LL / in->config.rate;
+}
+
+void lvfs_pipeline_stop(struct stream_in* in) {
+    struct lvfs_pipeline* pipe = in->lvfs_pipeline;
+    char buffer[256];
+
+    if (!pipe) {
+        return;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    pipe->exit = true;
+    pthread_cond_broadcast(&pipe->cond);
+    pthread_mutex_unlock(&pipe->lock);
+    pthread_join(pipe->thread, (void**)NULL);
+    lvfs_stop_failed(in, pipe->failed);
+
+    if (pipe->proc_time_ms.n > 0) {
+        simple_stats_to_string(&pipe->proc_time_ms, buffer, sizeof(buffer));
+        ALOGD("lvfs pipeline processing ms: %s", buffer);
+    }
+
+    in->lvfs_pipeline = NULL;
+    pthread_cond_destroy(&pipe->cond);
+    pthread_mutex_destroy(&pipe->lock);
+    free(pipe->work);
+    free(pipe->spare);
+    free(pipe);
+}
+
+void lvfs_pipeline_dump(struct stream_in* in, int fd) {
+    struct lvfs_pipeline* pipe = in->lvfs_pipeline;
+    char buffer[256];
+
+    if (!pipe) {
+        return;
+    }
+
+    pthread_mutex_lock(&pipe->lock);
+    if (pipe->proc_time_ms.n > 0) {
+        simple_stats_to_string(&pipe->proc_time_ms, buffer, sizeof(buffer));
+        dprintf(fd, "      LVFS block processing ms: %s\n", buffer);
+    }
+    if (pipe->queue_depth.n > 0) {
+        simple_stats_to_string(&pipe->queue_depth, buffer, sizeof(buffer));
+        dprintf(fd, "      LVFS queue depth: %s\n", buffer);
+    }
+    pthread_mutex_unlock(&pipe->lock);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2026 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "audio_hw.h"
+
+/*
+ * Runs lvacfs/lvimfs processing of block N on a worker thread while the
+ * caller reads block N+1, at the cost of one block of latency. Enabled with
+ * vendor.audio.lvfs.pipelined; low latency and realtime inputs always stay
+ * synchronous.
+ */
+void lvfs_pipeline_start(struct stream_in* in);
+/* returns false if the block handed back is silence rather than processed audio */
+bool lvfs_pipeline_process(struct stream_in* in, void* buffer, size_t bytes);
+/* drops the block held by the pipeline, the next process call returns silence */
+void lvfs_pipeline_flush(struct stream_in* in);
+/* delay added by the block held in the pipeline, 0 when synchronous */
+int64_t lvfs_pipeline_latency_ns(struct stream_in* in);
+void lvfs_pipeline_stop(struct stream_in* in);
+void lvfs_pipeline_dump(struct stream_in* in, int fd);
@@ -109,15 +109,14 @@ void lvimfs_start_input_stream(struct stream_in* in) {
     }
 }
 
-void lvimfs_process_input_stream(struct stream_in* in, void* buffer, size_t bytes) {
+int lvimfs_process_input_stream(struct stream_in* in, void* buffer, uint32_t num_frames) {
     pthread_mutex_lock(&in->lvimfs_lock);
-    uint32_t num_frames = pcm_bytes_to_frames(in->pcm, bytes);
     int ret = lvimfs_wrapper_ops->process(in->lvimfs_instance, buffer, buffer, num_frames);
     if (ret < 0) {
         ALOGE("process failed: %d", ret);
-        lvimfs_stop_input_stream(in);
     }
     pthread_mutex_unlock(&in->lvimfs_lock);
+    return ret;
 }
 
 void lvimfs_stop_input_stream(struct stream_in* in) {
@@ -38,5 +38,6 @@ struct lvimfs_wrapper_ops {
 void lvimfs_init(void);
 void lvimfs_deinit(void);
 void lvimfs_start_input_stream(struct stream_in* in);
-void lvimfs_process_input_stream(struct stream_in* in, void* buffer, size_t bytes);
+/* returns < 0 on failure, the caller stops the instance from the stream thread */
+int lvimfs_process_input_stream(struct stream_in* in, void* buffer, uint32_t num_frames);
 void lvimfs_stop_input_stream(struct stream_in* in);
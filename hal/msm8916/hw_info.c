@@ -193,10 +193,35 @@ static void update_hardware_info_8x16(struct hardware_info *hw_info, const char
     }
 }
 
+static const char * const snd_card_8x16_keys[] = {
+    "msm8x16", "msm8939", "msm8909", "msm8952", "msm8976", "msm8953",
+    "msm8937", "msm8917", "msm8940", "msm8920", "sdm660", "apq8009",
+    "mdm9607", "mdm-tasha", "sdm439",
+};
+
+bool hw_info_is_supported_snd_card(const char *snd_card_name)
+{
+    uint32_t i;
+
+    if (!snd_card_name)
+        return false;
+
+    for (i = 0; i < ARRAY_SIZE(snd_card_8x16_keys); i++) {
+        if (strstr(snd_card_name, snd_card_8x16_keys[i]))
+            return true;
+    }
+    return false;
+}
+
 void *hw_info_init(const char *snd_card_name)
 {
     struct hardware_info *hw_info;
 
+    if (!hw_info_is_supported_snd_card(snd_card_name)) {
+        ALOGE("%s: Unsupported target %s:",__func__, snd_card_name);
+        return NULL;
+    }
+
     hw_info = malloc(sizeof(struct hardware_info));
     if (!hw_info) {
         ALOGE("failed to allocate mem for hardware info");
@@ -211,21 +236,8 @@ void *hw_info_init(const char *snd_card_name)
     hw_info->is_wsa_combo_suppported = false;
 
     hw_info->is_stereo_spkr = true;
-    if (strstr(snd_card_name, "msm8x16") || strstr(snd_card_name, "msm8939") ||
-        strstr(snd_card_name, "msm8909") || strstr(snd_card_name, "msm8952") ||
-        strstr(snd_card_name, "msm8976") || strstr(snd_card_name, "msm8953") ||
-        strstr(snd_card_name, "msm8937") || strstr(snd_card_name, "msm8917") ||
-        strstr(snd_card_name, "msm8940") || strstr(snd_card_name, "msm8920") ||
-        strstr(snd_card_name, "sdm660") || strstr(snd_card_name, "apq8009") ||
-        strstr(snd_card_name, "mdm9607") || strstr(snd_card_name, "mdm-tasha") ||
-        strstr(snd_card_name, "sdm439")) {
-        ALOGV("8x16 - variant soundcard");
-        update_hardware_info_8x16(hw_info, snd_card_name);
-    } else {
-        ALOGE("%s: Unsupported target %s:",__func__, snd_card_name);
-        free(hw_info);
-        hw_info = NULL;
-    }
+    ALOGV("8x16 - variant soundcard");
+    update_hardware_info_8x16(hw_info, snd_card_name);
 
     return hw_info;
 }
@@ -5814,6 +5814,13 @@ void platform_set_snd_device_delay(snd_device_t snd_device __unused, int delay_m
 {
 }
 
+void platform_set_latency_model_entry(audio_usecase_t usecase __unused,
+                                      snd_device_t snd_device __unused,
+                                      unsigned int sample_rate __unused,
+                                      int delay_us __unused)
+{
+}
+
 void platform_set_audio_source_delay(audio_source_t audio_source, int delay_ms)
 {
     if ((audio_source < AUDIO_SOURCE_DEFAULT) ||
@@ -912,9 +912,69 @@ static void update_hardware_info_msm8952(struct hardware_info *hw_info, const ch
     }
 }
 
+/*
+ * Sound card variants, matched in order on a substring of the card name.
+ * The first entry with a matching key wins, so keep the order when adding
+ * a variant whose key can appear inside another family's card name.
+ */
+#define SND_CARD_VARIANT_MAX_KEYS 8
+
+struct snd_card_variant {
+    const char *label;
+    const char *keys[SND_CARD_VARIANT_MAX_KEYS];
+    void (*update)(struct hardware_info *hw_info, const char *snd_card_name);
+};
+
+static const struct snd_card_variant snd_card_variants[] = {
+    {"8974", {"msm8974", "apq8074"}, update_hardware_info_8974},
+    {"8x26", {"msm8226"}, update_hardware_info_8226},
+    {"8x10", {"msm8x10"}, update_hardware_info_8610},
+    {"8084", {"apq8084"}, update_hardware_info_8084},
+    {"8994", {"msm8994"}, update_hardware_info_8994},
+    {"8096", {"apq8096"}, update_hardware_info_8096},
+    {"8996", {"msm8996"}, update_hardware_info_8996},
+    {"MSM8998", {"msm8998", "apq8098_latv"}, update_hardware_info_msm8998},
+    {"SDM845", {"sdm845"}, update_hardware_info_sdm845},
+    {"Bear", {"sdm660", "sdm670", "sm6150", "qcs605-lc", "qcs405",
+              "qcs605-ipc", "trinket", "sa6155"}, update_hardware_info_bear},
+    {"SDX", {"sdx"}, update_hardware_info_sdx},
+    {"MSMNILE", {"pahu", "tavil", "sa8155", "sa8295"},
+        update_hardware_info_msmnile},
+    {"SDA845", {"sda845"}, update_hardware_info_sda845},
+    {"KONA", {"kona", "lito", "atoll", "bengal"}, update_hardware_info_kona},
+    {"LAHAINA", {"lahaina", "shima", "yupik"}, update_hardware_info_lahaina},
+    {"HOLI", {"holi"}, update_hardware_info_holi},
+    {"SDM439", {"sdm439", "sdm429w"}, update_hardware_info_sdm439},
+    {"MSM8937", {"msm8937"}, update_hardware_info_msm8937},
+    {"MSM8953", {"msm8953"}, update_hardware_info_msm8953},
+    {"MSM8952", {"msm8952"}, update_hardware_info_msm8952},
+};
+
+static const struct snd_card_variant *find_snd_card_variant(
+                                       const char *snd_card_name)
+{
+    uint32_t i, j;
+
+    for (i = 0; i < ARRAY_SIZE(snd_card_variants); i++) {
+        for (j = 0; j < SND_CARD_VARIANT_MAX_KEYS &&
+                    snd_card_variants[i].keys[j]; j++) {
+            if (strstr(snd_card_name, snd_card_variants[i].keys[j]))
+                return &snd_card_variants[i];
+        }
+    }
+    return NULL;
+}
+
 void *hw_info_init(const char *snd_card_name)
 {
     struct hardware_info *hw_info;
+    const struct snd_card_variant *variant;
+
+    variant = find_snd_card_variant(snd_card_name);
+    if (!variant) {
+        ALOGE("%s: Unsupported target %s:",__func__, snd_card_name);
+        return NULL;
+    }
 
     hw_info = malloc(sizeof(struct hardware_info));
     if (!hw_info) {
@@ -931,82 +991,17 @@ void *hw_info_init(const char *snd_card_name)
     strlcpy(hw_info->type, "", sizeof(hw_info->type));
     strlcpy(hw_info->name, "", sizeof(hw_info->name));
 
-    if(strstr(snd_card_name, "msm8974") ||
-              strstr(snd_card_name, "apq8074")) {
-        ALOGV("8974 - variant soundcard");
-        update_hardware_info_8974(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "msm8226")) {
-        ALOGV("8x26 - variant soundcard");
-        update_hardware_info_8226(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "msm8x10")) {
-        ALOGV("8x10 - variant soundcard");
-        update_hardware_info_8610(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "apq8084")) {
-        ALOGV("8084 - variant soundcard");
-        update_hardware_info_8084(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "msm8994")) {
-        ALOGV("8994 - variant soundcard");
-        update_hardware_info_8994(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "apq8096")) {
-        ALOGV("8096 - variant soundcard");
-        update_hardware_info_8096(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "msm8996")) {
-        ALOGV("8996 - variant soundcard");
-        update_hardware_info_8996(hw_info, snd_card_name);
-    } else if((strstr(snd_card_name, "msm8998")) || (strstr(snd_card_name, "apq8098_latv"))) {
-        ALOGV("MSM8998 - variant soundcard");
-        update_hardware_info_msm8998(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "sdm845")) {
-        ALOGV("SDM845 - variant soundcard");
-        update_hardware_info_sdm845(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "sdm660") || strstr(snd_card_name, "sdm670")
-               || strstr(snd_card_name, "sm6150") || strstr(snd_card_name, "qcs605-lc")
-               || strstr(snd_card_name, "qcs405") || strstr(snd_card_name, "qcs605-ipc")
-               || strstr(snd_card_name, "trinket") || strstr(snd_card_name, "sa6155")) {
-        ALOGV("Bear - variant soundcard");
-        update_hardware_info_bear(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "sdx")) {
-        ALOGV("SDX - variant soundcard");
-        update_hardware_info_sdx(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "pahu") || strstr(snd_card_name, "tavil") ||
-            strstr(snd_card_name, "sa8155") || strstr(snd_card_name, "sa8295")) {
-        ALOGV("MSMNILE - variant soundcard");
-        update_hardware_info_msmnile(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "sda845")) {
-        ALOGV("SDA845 - variant soundcard");
-        update_hardware_info_sda845(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "kona") || strstr(snd_card_name, "lito")
-               || strstr(snd_card_name, "atoll") || strstr(snd_card_name, "bengal")) {
-        ALOGV("KONA - variant soundcard");
-        update_hardware_info_kona(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "lahaina") || strstr(snd_card_name, "shima")
-      || strstr(snd_card_name, "yupik")) {
-        ALOGV("LAHAINA - variant soundcard");
-        update_hardware_info_lahaina(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "holi")) {
-        ALOGV("HOLI - variant soundcard");
-        update_hardware_info_holi(hw_info, snd_card_name);
-    } else if(strstr(snd_card_name, "sdm439") || strstr(snd_card_name, "sdm429w")) {
-        ALOGV("SDM439 - variant soundcard");
-        update_hardware_info_sdm439(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "msm8937")) {
-        ALOGV("MSM8937 - variant soundcard");
-        update_hardware_info_msm8937(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "msm8953")) {
-        ALOGV("MSM8953 - variant soundcard");
-        update_hardware_info_msm8953(hw_info, snd_card_name);
-    } else if (strstr(snd_card_name, "msm8952")) {
-        ALOGV("MSM8952 - variant soundcard");
-        update_hardware_info_msm8952(hw_info, snd_card_name);
-    } else {
-        ALOGE("%s: Unsupported target %s:",__func__, snd_card_name);
-        free(hw_info);
-        hw_info = NULL;
-    }
+    ALOGV("%s - variant soundcard", variant->label);
+    variant->update(hw_info, snd_card_name);
 
     return hw_info;
 }
 
+bool hw_info_is_supported_snd_card(const char *snd_card_name)
+{
+    return snd_card_name && find_snd_card_variant(snd_card_name) != NULL;
+}
+
 void hw_info_deinit(void *hw_info)
 {
     struct hardware_info *my_data = (struct hardware_info*) hw_info;
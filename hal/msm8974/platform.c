@@ -31,7 +31,9 @@
 #define ALOGVV(a...) do { } while(0)
 #endif
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <dlfcn.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -41,7 +43,11 @@
 #include <audio_hw.h>
 #include <platform_api.h>
 #include <pthread.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <system/thread_defs.h>
 #include "platform.h"
 #include "audio_extn.h"
 #include "acdb.h"
@@ -175,6 +181,8 @@
 
 /* Reload ACDB files from specified path */
 #define AUDIO_PARAMETER_KEY_RELOAD_ACDB "reload_acdb"
+#define AUDIO_PARAMETER_KEY_ACDB_PREFETCH "acdb_prefetch"
+#define AUDIO_PARAMETER_KEY_LATENCY_MODEL "latency_model"
 
 /* Query external audio device connection status */
 #define AUDIO_PARAMETER_KEY_EXT_AUDIO_DEVICE "ext_audio_device"
@@ -301,6 +309,10 @@ typedef struct codec_backend_cfg {
     char     *bitwidth_mixer_ctl;
     char     *samplerate_mixer_ctl;
     char     *channels_mixer_ctl;
+    /* handles of the controls above, see get_backend_mixer_ctl() */
+    struct mixer_ctl *bitwidth_ctl;
+    struct mixer_ctl *samplerate_ctl;
+    struct mixer_ctl *channels_ctl;
     int      controller;
     int      stream;
 } codec_backend_cfg_t;
@@ -312,13 +324,144 @@ static bool spkr_hph_single_be_native_concurrency = false;
 static int max_be_dai_names = 0;
 static const struct be_dai_name_struct *be_dai_name_table;
 
+/* allocated per capture device on the first mic mapped to it */
 struct snd_device_to_mic_map {
-    struct mic_info microphones[AUDIO_MICROPHONE_MAX_COUNT];
     size_t mic_count;
+    struct mic_info microphones[];
 };
 
 static struct listnode *external_specific_device_table[SND_DEVICE_MAX];
 
+/*
+ * Memo of platform_get_output_snd_device(). The key holds every device,
+ * stream and call state the selection reads; platform configuration that
+ * only changes through set_parameters or the platform XML is covered by
+ * snd_device_cfg_gen, which is bumped wherever that configuration is set.
+ *
+ * Only output selection on this platform is memoized. The input selector
+ * also reads the source, flags and effect state of the stream, the active
+ * output and the ssr, sound trigger and fluence state of other modules,
+ * and runs once per capture start rather than once per stream on every
+ * routing pass, so it is left uncached. msm8916 and msm8960 keep their own
+ * uncached copies. Equivalence with select_output_snd_device() is only
+ * checked at runtime with vendor.audio.snd_device_cache.verify: the
+ * selection reads live adev and extension state, which there is no host
+ * harness in the tree to reproduce offline.
+ */
+#define OUT_SND_DEVICE_CACHE_SIZE 8
+
+#define OUT_SND_CTX_VOICECALL_ACTIVE    (1 << 0)
+#define OUT_SND_CTX_VOIP_ACTIVE         (1 << 1)
+#define OUT_SND_CTX_HFP_ACTIVE          (1 << 2)
+#define OUT_SND_CTX_VOICERX             (1 << 3)
+#define OUT_SND_CTX_ENABLE_HFP          (1 << 4)
+#define OUT_SND_CTX_DP_FOR_VOICE        (1 << 5)
+#define OUT_SND_CTX_BT_WB               (1 << 6)
+#define OUT_SND_CTX_HAC                 (1 << 7)
+#define OUT_SND_CTX_LR_SWAP             (1 << 8)
+#define OUT_SND_CTX_HIFI_FILTER         (1 << 9)
+
+#define OUT_SND_CTX_VOICE_PATH (OUT_SND_CTX_VOICECALL_ACTIVE | \
+                                OUT_SND_CTX_VOIP_ACTIVE | \
+                                OUT_SND_CTX_HFP_ACTIVE | \
+                                OUT_SND_CTX_VOICERX)
+
+/* selections with side effects or that query other modules are not cached */
+#define OUT_SND_CTX_UNCACHED_DEVICES (AUDIO_DEVICE_OUT_PROXY | \
+                                      AUDIO_DEVICE_OUT_ANLG_DOCK_HEADSET | \
+                                      AUDIO_DEVICE_OUT_DGTL_DOCK_HEADSET | \
+                                      AUDIO_DEVICE_OUT_USB_DEVICE | \
+                                      AUDIO_DEVICE_OUT_USB_HEADSET | \
+                                      AUDIO_DEVICE_OUT_BUS)
+
+struct out_snd_device_ctx {
+    uint32_t cfg_gen;
+    uint32_t devices;
+    uint32_t num_devices;
+    uint32_t flags;
+    int controller;
+    int stream;
+    int disp_type;
+    int na_mode;
+    int channel_count;
+    int tty_mode;
+    int swb_speech_mode;
+    uint32_t sample_rate;
+    uint32_t format;
+    uint32_t mode;
+    uint32_t uc_type;
+};
+
+struct out_snd_device_cache {
+    struct out_snd_device_ctx ctx[OUT_SND_DEVICE_CACHE_SIZE];
+    snd_device_t snd_device[OUT_SND_DEVICE_CACHE_SIZE];
+    int count;
+    int next;
+    bool verify;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncached;
+    uint64_t mismatches;
+};
+
+static uint32_t snd_device_cfg_gen = 0;
+
+/*
+ * Last calibration tuple pushed through the ACDB loader on each path. The
+ * loader keeps what it was sent in the kernel cal blocks, so a send with
+ * the same tuple as the previous one on that path can be skipped. Anything
+ * else that writes calibration drops the fingerprints.
+ */
+#define AUDIO_CAL_PATHS 2
+
+struct audio_cal_fingerprint {
+    bool valid;
+    bool prefetched;
+    int acdb_dev_id;
+    int app_type;
+    int sample_rate;
+    int be_sample_rate;
+    int fe_id;
+    int index;
+};
+
+struct audio_cal_cache {
+    struct audio_cal_fingerprint last[AUDIO_CAL_PATHS];
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t send_ns;
+    uint64_t prefetch_sends;
+    uint64_t prefetch_hits;
+};
+
+/*
+ * Calibration staged off the start path by a background thread: the
+ * acdb_prefetch list from the platform XML after boot and SSR, and the
+ * snd device of a newly connected output. A staged send leaves its
+ * fingerprint behind, so the first real start on that device skips it.
+ */
+#define ACDB_PREFETCH_MAX_DEVICES 8
+#define ACDB_PREFETCH_RETRY_US 20000
+#define ACDB_PREFETCH_MAX_RETRIES 250
+
+struct acdb_prefetch {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool thread_created;
+    bool exit;
+    bool list_pending;
+    audio_devices_t connected;
+    int num_devices;
+    snd_device_t devices[ACDB_PREFETCH_MAX_DEVICES];
+};
+
+/* where a usecase was last routed, for the latency model lookup */
+struct latency_route {
+    snd_device_t snd_device;
+    int backend_idx;
+};
+
 struct platform_data {
     struct audio_device *adev;
     bool fluence_in_spkr_mode;
@@ -389,6 +532,10 @@ struct platform_data {
         void *edid_info;
         bool valid;
         int type;
+        /* last EDID parsed on this controller/stream, kept across hotplugs */
+        void *last_edid_info;
+        int last_edid_len;
+        char last_edid[MAX_SAD_BLOCKS * SAD_BLOCK_SIZE + 1];
     } ext_disp[MAX_CONTROLLERS][MAX_STREAMS_PER_CONTROLLER];
     char ec_ref_mixer_path[MIXER_PATH_MAX_LENGTH];
     codec_backend_cfg_t current_backend_cfg[MAX_CODEC_BACKENDS];
@@ -407,7 +554,7 @@ struct platform_data {
     struct acdb_init_data_v4 acdb_init_data;
     uint32_t declared_mic_count;
     struct audio_microphone_characteristic_t microphones[AUDIO_MICROPHONE_MAX_COUNT];
-    struct snd_device_to_mic_map mic_map[SND_DEVICE_MAX];
+    struct snd_device_to_mic_map *mic_map[SND_DEVICE_MAX];
     struct  spkr_device_chmap *spkr_ch_map;
     bool use_sprk_default_sample_rate;
     bool is_multiple_sample_rate_combo_supported;
@@ -415,6 +562,13 @@ struct platform_data {
     struct listnode custom_mtmx_in_params_list;
     struct power_mode_cfg power_mode_cfg[SND_DEVICE_MAX];
     struct island_cfg island_cfg[SND_DEVICE_MAX];
+    struct out_snd_device_cache out_snd_cache;
+    struct audio_cal_cache audio_cal_cache;
+    struct acdb_prefetch acdb_prefetch;
+    struct mixer *backend_ctl_mixer;
+    uint64_t backend_reconfigs;
+    uint64_t backend_reconfig_ns;
+    struct latency_route latency_route[AUDIO_USECASE_MAX];
 };
 
 struct  spkr_device_chmap {
@@ -909,55 +1063,108 @@ static const char * const device_table[SND_DEVICE_MAX] = {
 // Platform specific backend bit width table
 static int backend_bit_width_table[SND_DEVICE_MAX] = {0};
 
-static struct audio_effect_config effect_config_table[GET_IN_DEVICE_INDEX(SND_DEVICE_MAX)][EFFECT_MAX] = {
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_QMIC_AEC_NS)][EFFECT_AEC] = {TX_VOICE_FLUENCE_PROV2, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_QMIC_AEC_NS)][EFFECT_NS] = {TX_VOICE_FLUENCE_PROV2,  0x0, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_TMIC_AEC_NS)][EFFECT_AEC] = {TX_VOICE_TM_FLUENCE_PRO_VC, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_TMIC_AEC_NS)][EFFECT_NS] = {TX_VOICE_TM_FLUENCE_PRO_VC,  0x0, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_TMIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_TMIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN,  0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_BROADSIDE)][EFFECT_AEC] = {TX_VOICE_DM_FV5_BROADSIDE, 0x0,
-                                                                 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_BROADSIDE)][EFFECT_NS] = {TX_VOICE_DM_FV5_BROADSIDE, 0x0,
-                                                                0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS)][EFFECT_AEC] = {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS)][EFFECT_NS] = {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC)][EFFECT_AEC] = {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC)][EFFECT_NS] = {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_TMIC_AEC_NS)][EFFECT_AEC] = {TX_VOICE_TM_FLUENCE_EF, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_TMIC_AEC_NS)][EFFECT_NS] = {TX_VOICE_TM_FLUENCE_EF, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_TMIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_TMIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_AEC_NS)][EFFECT_AEC] = {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_AEC_NS)][EFFECT_NS] = {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC)][EFFECT_AEC] = {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC)][EFFECT_NS] = {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x02},
-
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_SB)][EFFECT_AEC] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_SB)][EFFECT_NS] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC_SB)][EFFECT_AEC] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC_SB)][EFFECT_NS] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_AEC_NS_SB)][EFFECT_AEC] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_DMIC_AEC_NS_SB)][EFFECT_NS] = {TX_VOICE_FLUENCE_MM_SB, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC_SB)][EFFECT_AEC] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC_SB)][EFFECT_NS] = {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02},
-
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_SPEAKER_MIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC_NN)][EFFECT_AEC] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_HANDSET_MIC_NN)][EFFECT_NS] = {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02},
-
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_VOICE_REC_MIC)][EFFECT_AEC] = {TX_VOICE_FLUENCEV5_SM, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_VOICE_REC_MIC)][EFFECT_NS] = {TX_VOICE_FLUENCEV5_SM, 0x0, 0x10EAF, 0x02},
-
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_VOICE_REC_DMIC_STEREO)][EFFECT_AEC] = {TX_VOICE_TM_FLUENCE_EF, 0x0, 0x10EAF, 0x01},
-    [GET_IN_DEVICE_INDEX(SND_DEVICE_IN_VOICE_REC_DMIC_STEREO)][EFFECT_NS] = {TX_VOICE_TM_FLUENCE_EF, 0x0, 0x10EAF, 0x02},
+/*
+ * Default AEC/NS module of the capture devices that have one. Only a few
+ * dozen of the capture devices have an entry, so this is kept as a list
+ * instead of a table indexed by device and effect.
+ */
+struct effect_config_entry {
+    snd_device_t snd_device;
+    effect_type_t effect_type;
+    struct audio_effect_config config;
+};
+
+static const struct effect_config_entry effect_config_defaults[] = {
+    {SND_DEVICE_IN_SPEAKER_QMIC_AEC_NS, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_PROV2, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_QMIC_AEC_NS, EFFECT_NS,
+        {TX_VOICE_FLUENCE_PROV2, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_TMIC_AEC_NS, EFFECT_AEC,
+        {TX_VOICE_TM_FLUENCE_PRO_VC, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_TMIC_AEC_NS, EFFECT_NS,
+        {TX_VOICE_TM_FLUENCE_PRO_VC, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_TMIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_TMIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_BROADSIDE, EFFECT_AEC,
+        {TX_VOICE_DM_FV5_BROADSIDE, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_BROADSIDE, EFFECT_NS,
+        {TX_VOICE_DM_FV5_BROADSIDE, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS, EFFECT_AEC,
+        {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS, EFFECT_NS,
+        {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_MIC, EFFECT_AEC,
+        {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_MIC, EFFECT_NS,
+        {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_TMIC_AEC_NS, EFFECT_AEC,
+        {TX_VOICE_TM_FLUENCE_EF, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_TMIC_AEC_NS, EFFECT_NS,
+        {TX_VOICE_TM_FLUENCE_EF, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_TMIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_TMIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_DMIC_AEC_NS, EFFECT_AEC,
+        {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_DMIC_AEC_NS, EFFECT_NS,
+        {TX_VOICE_FV5ECNS_DM, 0x0, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_DMIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_DMIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_MIC, EFFECT_AEC,
+        {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_MIC, EFFECT_NS,
+        {TX_VOICE_SMECNS_V2, 0x0, 0x10EAF, 0x02}},
+
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_SB, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_DMIC_AEC_NS_SB, EFFECT_NS,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_SPEAKER_MIC_SB, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_MIC_SB, EFFECT_NS,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_DMIC_AEC_NS_SB, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_DMIC_AEC_NS_SB, EFFECT_NS,
+        {TX_VOICE_FLUENCE_MM_SB, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_MIC_SB, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_MIC_SB, EFFECT_NS,
+        {TX_VOICE_FLUENCE_SM_SB, 0x8000, 0x10EAF, 0x02}},
+
+    {SND_DEVICE_IN_SPEAKER_MIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_SPEAKER_MIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+    {SND_DEVICE_IN_HANDSET_MIC_NN, EFFECT_AEC,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_HANDSET_MIC_NN, EFFECT_NS,
+        {TX_VOICE_FLUENCE_NN, 0x8000, 0x10EAF, 0x02}},
+
+    {SND_DEVICE_IN_VOICE_REC_MIC, EFFECT_AEC,
+        {TX_VOICE_FLUENCEV5_SM, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_VOICE_REC_MIC, EFFECT_NS,
+        {TX_VOICE_FLUENCEV5_SM, 0x0, 0x10EAF, 0x02}},
+
+    {SND_DEVICE_IN_VOICE_REC_DMIC_STEREO, EFFECT_AEC,
+        {TX_VOICE_TM_FLUENCE_EF, 0x0, 0x10EAF, 0x01}},
+    {SND_DEVICE_IN_VOICE_REC_DMIC_STEREO, EFFECT_NS,
+        {TX_VOICE_TM_FLUENCE_EF, 0x0, 0x10EAF, 0x02}},
 };
 
+/* entries set from the platform XML, looked up before the defaults */
+static struct effect_config_entry *effect_config_overrides = NULL;
+static size_t effect_config_override_cnt = 0;
+
 static struct audio_fluence_mmsecns_config fluence_mmsecns_table = {TOPOLOGY_ID_MM_HFP_ECNS, MODULE_ID_MM_HFP_ECNS,
                                                                     INSTANCE_ID_MM_HFP_ECNS, PARAM_ID_MM_HFP_ZONE};
 
@@ -1220,14 +1427,14 @@ static int acdb_device_table[SND_DEVICE_MAX] = {
 };
 
 struct name_to_index {
-    char name[100];
+    const char *name;
     unsigned int index;
 };
 
 #define TO_NAME_INDEX(X)   #X, X
 
 /* Used to get index from parsed string */
-static struct name_to_index snd_device_name_index[SND_DEVICE_MAX] = {
+static const struct name_to_index snd_device_name_index[SND_DEVICE_MAX] = {
     {TO_NAME_INDEX(SND_DEVICE_OUT_HANDSET)},
     {TO_NAME_INDEX(SND_DEVICE_OUT_SPEAKER)},
     {TO_NAME_INDEX(SND_DEVICE_OUT_SPEAKER_EXTERNAL_1)},
@@ -1503,7 +1710,7 @@ static struct name_to_index snd_device_name_index[SND_DEVICE_MAX] = {
 static char * backend_tag_table[SND_DEVICE_MAX] = {0};
 static char * hw_interface_table[SND_DEVICE_MAX] = {0};
 
-static struct name_to_index usecase_name_index[AUDIO_USECASE_MAX] = {
+static const struct name_to_index usecase_name_index[AUDIO_USECASE_MAX] = {
     {TO_NAME_INDEX(USECASE_AUDIO_PLAYBACK_DEEP_BUFFER)},
     {TO_NAME_INDEX(USECASE_AUDIO_PLAYBACK_WITH_HAPTICS)},
     {TO_NAME_INDEX(USECASE_AUDIO_PLAYBACK_HAPTICS)},
@@ -1584,7 +1791,7 @@ static struct name_to_index usecase_name_index[AUDIO_USECASE_MAX] = {
     {TO_NAME_INDEX(USECASE_AUDIO_PLAYBACK_SYNTHESIZER)},
 };
 
-static const struct name_to_index usecase_type_index[USECASE_TYPE_MAX] = {
+static const struct name_to_index usecase_type_index[] = {
     {TO_NAME_INDEX(PCM_PLAYBACK)},
     {TO_NAME_INDEX(PCM_CAPTURE)},
     {TO_NAME_INDEX(VOICE_CALL)},
@@ -1782,9 +1989,28 @@ static int msm_be_id_array_len  =
 #define ULL_PLATFORM_DELAY         (3*1000LL)
 #define MMAP_PLATFORM_DELAY        (3*1000LL)
 
+/*
+ * Measured delays from the latency_model section of the platform info XML,
+ * or pushed at runtime with latency_model=. An entry may narrow a usecase
+ * down to the snd device (and with it the backend) and the backend sample
+ * rate it was measured with; the most specific match for the current route
+ * wins and usecases without an entry keep the defaults above.
+ */
+#define LATENCY_MODEL_MAX_ENTRIES 64
+
+struct latency_model_entry {
+    audio_usecase_t usecase;
+    snd_device_t snd_device;    /* SND_DEVICE_NONE matches any */
+    unsigned int sample_rate;   /* 0 matches any */
+    int delay_us;
+};
+
+static struct latency_model_entry latency_model[LATENCY_MODEL_MAX_ENTRIES];
+static int latency_model_cnt;
+
 static int audio_source_delay_ms[AUDIO_SOURCE_CNT] = {0};
 
-static struct name_to_index audio_source_index[AUDIO_SOURCE_CNT] = {
+static const struct name_to_index audio_source_index[AUDIO_SOURCE_CNT] = {
     {TO_NAME_INDEX(AUDIO_SOURCE_DEFAULT)},
     {TO_NAME_INDEX(AUDIO_SOURCE_MIC)},
     {TO_NAME_INDEX(AUDIO_SOURCE_VOICE_UPLINK)},
@@ -2084,6 +2310,34 @@ static snd_device_t fixup_usb_headset_mic_snd_device(void *platform,
 }
 
 static const char *platform_get_mixer_control(struct mixer_ctl *);
+static void invalidate_audio_cal_cache(struct platform_data *my_data);
+static void acdb_prefetch_request(struct platform_data *my_data,
+                                  bool list, audio_devices_t connected);
+
+/*
+ * Backend attribute controls are looked up by name once per mixer rather
+ * than on every reconfiguration; the lookup walks every control of the card.
+ */
+static struct mixer_ctl *get_backend_mixer_ctl(struct platform_data *my_data,
+                                               const char *name,
+                                               struct mixer_ctl **ctl)
+{
+    struct mixer *mixer = my_data->adev->mixer;
+    int idx;
+
+    if (my_data->backend_ctl_mixer != mixer) {
+        for (idx = 0; idx < MAX_CODEC_BACKENDS; idx++) {
+            my_data->current_backend_cfg[idx].bitwidth_ctl = NULL;
+            my_data->current_backend_cfg[idx].samplerate_ctl = NULL;
+            my_data->current_backend_cfg[idx].channels_ctl = NULL;
+        }
+        my_data->backend_ctl_mixer = mixer;
+    }
+
+    if (*ctl == NULL)
+        *ctl = mixer_get_ctl_by_name(mixer, name);
+    return *ctl;
+}
 
 static void platform_reset_edid_info(void *platform) {
     ALOGV("%s:", __func__);
@@ -2097,6 +2351,11 @@ static void platform_reset_edid_info(void *platform) {
                 free(state->edid_info);
                 state->edid_info = NULL;
             }
+            if (state->last_edid_info) {
+                free(state->last_edid_info);
+                state->last_edid_info = NULL;
+            }
+            state->last_edid_len = 0;
             state->valid = false;
         }
     }
@@ -2162,6 +2421,7 @@ bool platform_send_gain_dep_cal(void *platform, int level) {
                             acdb_dev_id = acdb_device_table[new_snd_device[i]];
                     }
 
+                invalidate_audio_cal_cache(my_data);
                 if (!my_data->acdb_send_gain_dep_cal(acdb_dev_id, app_type,
                                                      acdb_dev_type, mode, level)) {
                     // set ret_val true if at least one calibration is set successfully
@@ -3369,6 +3629,96 @@ static void configure_flicker_sensor_input(struct mixer *mixer)
 }
 #endif
 
+#define FOOTPRINT_TABLE(table) { #table, sizeof(table) }
+
+/*
+ * Rss and Private_Dirty in kB of the mappings of this library, including
+ * the anonymous .bss mapping that follows them.
+ */
+static void get_library_footprint(const char *path, unsigned long *rss_kb,
+                                  unsigned long *dirty_kb)
+{
+    char line[512];
+    char map_path[256];
+    char real_path[PATH_MAX];
+    unsigned long start, end, kb;
+    bool in_lib = false;
+    FILE *fp;
+
+    *rss_kb = *dirty_kb = 0;
+    /* smaps lists the resolved path */
+    if (realpath(path, real_path) != NULL)
+        path = real_path;
+    fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL) {
+        ALOGW("%s: cannot open smaps: %s", __func__, strerror(errno));
+        return;
+    }
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%lx-%lx", &start, &end) == 2) {
+            map_path[0] = '\0';
+            sscanf(line, "%*s %*s %*s %*s %*s %255s", map_path);
+            in_lib = !strcmp(map_path, path) ||
+                     (in_lib && !strcmp(map_path, "[anon:.bss]"));
+        } else if (in_lib && sscanf(line, "Rss: %lu kB", &kb) == 1) {
+            *rss_kb += kb;
+        } else if (in_lib && sscanf(line, "Private_Dirty: %lu kB", &kb) == 1) {
+            *dirty_kb += kb;
+        }
+    }
+    fclose(fp);
+}
+
+/*
+ * Logs the size of the platform tables and the resident memory of the HAL
+ * library, to compare builds for low RAM targets. Enabled with
+ * vendor.audio.hal.mem.report.
+ */
+static void log_platform_footprint(struct platform_data *my_data)
+{
+    static const struct {
+        const char *name;
+        size_t size;
+    } tables[] = {
+        FOOTPRINT_TABLE(device_table),
+        FOOTPRINT_TABLE(snd_device_name_index),
+        FOOTPRINT_TABLE(usecase_name_index),
+        FOOTPRINT_TABLE(audio_source_index),
+        FOOTPRINT_TABLE(acdb_device_table),
+        FOOTPRINT_TABLE(pcm_device_table),
+        FOOTPRINT_TABLE(backend_bit_width_table),
+        FOOTPRINT_TABLE(backend_tag_table),
+        FOOTPRINT_TABLE(hw_interface_table),
+        FOOTPRINT_TABLE(operator_specific_device_table),
+        FOOTPRINT_TABLE(external_specific_device_table),
+        FOOTPRINT_TABLE(effect_config_defaults),
+        FOOTPRINT_TABLE(latency_model),
+    };
+    size_t mic_map_bytes = 0;
+    unsigned long rss_kb, dirty_kb;
+    Dl_info info;
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(tables); i++)
+        ALOGD("%s: %s %zu bytes", __func__, tables[i].name, tables[i].size);
+
+    for (i = SND_DEVICE_IN_BEGIN; i < SND_DEVICE_IN_END; i++) {
+        if (my_data->mic_map[i])
+            mic_map_bytes += sizeof(struct snd_device_to_mic_map) +
+                    my_data->mic_map[i]->mic_count * sizeof(struct mic_info);
+    }
+    ALOGD("%s: platform_data %zu bytes, mic maps %zu bytes, %zu effect overrides",
+          __func__, sizeof(struct platform_data), mic_map_bytes,
+          effect_config_override_cnt);
+
+    if (dladdr((void *)log_platform_footprint, &info) && info.dli_fname) {
+        get_library_footprint(info.dli_fname, &rss_kb, &dirty_kb);
+        ALOGD("%s: %s Rss %lu kB Private_Dirty %lu kB", __func__,
+              info.dli_fname, rss_kb, dirty_kb);
+    }
+}
+
 void *platform_init(struct audio_device *adev)
 {
     char platform[PROPERTY_VALUE_MAX];
@@ -3468,6 +3818,10 @@ void *platform_init(struct audio_device *adev)
     my_data->ec_car_state = false;
     my_data->lpi_enabled = false;
     my_data->is_multiple_sample_rate_combo_supported = true;
+    my_data->out_snd_cache.verify =
+        property_get_bool("vendor.audio.snd_device_cache.verify", false);
+    pthread_mutex_init(&my_data->acdb_prefetch.lock, (const pthread_mutexattr_t *) NULL);
+    pthread_cond_init(&my_data->acdb_prefetch.cond, (const pthread_condattr_t *) NULL);
     platform_reset_edid_info(my_data);
 
     //set max volume step for voice call
@@ -4282,8 +4636,9 @@ acdb_init_fail:
 
     for (idx = 0; idx < MAX_CODEC_BACKENDS; idx++) {
         if (my_data->current_backend_cfg[idx].bitwidth_mixer_ctl) {
-            ctl = mixer_get_ctl_by_name(adev->mixer,
-                         my_data->current_backend_cfg[idx].bitwidth_mixer_ctl);
+            ctl = get_backend_mixer_ctl(my_data,
+                         my_data->current_backend_cfg[idx].bitwidth_mixer_ctl,
+                         &my_data->current_backend_cfg[idx].bitwidth_ctl);
             id_string = platform_get_mixer_control(ctl);
             if (id_string) {
                 cfg_value = audio_extn_utils_get_bit_width_from_string(id_string);
@@ -4293,8 +4648,9 @@ acdb_init_fail:
         }
 
         if (my_data->current_backend_cfg[idx].samplerate_mixer_ctl) {
-            ctl = mixer_get_ctl_by_name(adev->mixer,
-                         my_data->current_backend_cfg[idx].samplerate_mixer_ctl);
+            ctl = get_backend_mixer_ctl(my_data,
+                         my_data->current_backend_cfg[idx].samplerate_mixer_ctl,
+                         &my_data->current_backend_cfg[idx].samplerate_ctl);
             id_string = platform_get_mixer_control(ctl);
             if (id_string) {
                 cfg_value = audio_extn_utils_get_sample_rate_from_string(id_string);
@@ -4304,8 +4660,9 @@ acdb_init_fail:
         }
 
         if (my_data->current_backend_cfg[idx].channels_mixer_ctl) {
-            ctl = mixer_get_ctl_by_name(adev->mixer,
-                         my_data->current_backend_cfg[idx].channels_mixer_ctl);
+            ctl = get_backend_mixer_ctl(my_data,
+                         my_data->current_backend_cfg[idx].channels_mixer_ctl,
+                         &my_data->current_backend_cfg[idx].channels_ctl);
             id_string = platform_get_mixer_control(ctl);
             if (id_string) {
                 cfg_value = audio_extn_utils_get_channels_from_string(id_string);
@@ -4361,6 +4718,11 @@ acdb_init_fail:
     if (my_data->is_lvimfs_enabled) {
         lvimfs_init();
     }
+    acdb_prefetch_request(my_data, true, AUDIO_DEVICE_NONE);
+
+    if (property_get_bool("vendor.audio.hal.mem.report", false))
+        log_platform_footprint(my_data);
+
     free(snd_card_name);
     ALOGD("%s: exit", __func__);
     return my_data;
@@ -4560,6 +4922,33 @@ void platform_deinit(void *platform)
     struct app_type_entry *ap;
     struct listnode *node;
 
+    ALOGD("%s: output snd device cache hits %llu misses %llu uncached %llu"
+          " mismatches %llu", __func__,
+          (unsigned long long)my_data->out_snd_cache.hits,
+          (unsigned long long)my_data->out_snd_cache.misses,
+          (unsigned long long)my_data->out_snd_cache.uncached,
+          (unsigned long long)my_data->out_snd_cache.mismatches);
+    ALOGD("%s: audio calibration sends %llu skipped %llu, %llu us spent sending",
+          __func__, (unsigned long long)my_data->audio_cal_cache.misses,
+          (unsigned long long)my_data->audio_cal_cache.hits,
+          (unsigned long long)(my_data->audio_cal_cache.send_ns / 1000));
+    ALOGD("%s: acdb prefetch staged %llu, used by %llu first starts", __func__,
+          (unsigned long long)my_data->audio_cal_cache.prefetch_sends,
+          (unsigned long long)my_data->audio_cal_cache.prefetch_hits);
+    ALOGD("%s: backend reconfigurations %llu, %llu us average", __func__,
+          (unsigned long long)my_data->backend_reconfigs,
+          (unsigned long long)(my_data->backend_reconfigs ?
+              my_data->backend_reconfig_ns / my_data->backend_reconfigs / 1000 : 0));
+
+    pthread_mutex_lock(&my_data->acdb_prefetch.lock);
+    my_data->acdb_prefetch.exit = true;
+    pthread_cond_signal(&my_data->acdb_prefetch.cond);
+    pthread_mutex_unlock(&my_data->acdb_prefetch.lock);
+    if (my_data->acdb_prefetch.thread_created)
+        pthread_join(my_data->acdb_prefetch.thread, (void **) NULL);
+    pthread_cond_destroy(&my_data->acdb_prefetch.cond);
+    pthread_mutex_destroy(&my_data->acdb_prefetch.lock);
+
     audio_extn_keep_alive_deinit();
     platform_reset_edid_info(my_data);
 
@@ -4579,6 +4968,12 @@ void platform_deinit(void *platform)
     close_csd_client(my_data->csd);
 
     int32_t dev;
+    for (dev = SND_DEVICE_IN_BEGIN; dev < SND_DEVICE_IN_END; dev++)
+        free(my_data->mic_map[dev]);
+    free(effect_config_overrides);
+    effect_config_overrides = NULL;
+    effect_config_override_cnt = 0;
+
     for (dev = 0; dev < SND_DEVICE_MAX; dev++) {
         if (backend_tag_table[dev]) {
             free(backend_tag_table[dev]);
@@ -4714,6 +5109,11 @@ void platform_snd_card_update(void *platform, card_status_t card_status)
 {
     struct platform_data *my_data = (struct platform_data *)platform;
 
+    /* the DSP lost whatever calibration it had across SSR */
+    invalidate_audio_cal_cache(my_data);
+    if (card_status == CARD_STATUS_ONLINE)
+        acdb_prefetch_request(my_data, true, AUDIO_DEVICE_NONE);
+
     if (card_status == CARD_STATUS_ONLINE) {
         if (!platform_is_acdb_initialized(my_data)) {
 #ifdef DAEMON_SUPPORT_AUTO
@@ -5086,7 +5486,7 @@ int platform_set_qtime(void *platform, int audio_pcm_device_id,
     return ret;
 }
 
-static int find_index(struct name_to_index * table, int32_t len, const char * name)
+static int find_index(const struct name_to_index * table, int32_t len, const char * name)
 {
     int ret = 0;
     int32_t i;
@@ -5105,6 +5505,8 @@ static int find_index(struct name_to_index * table, int32_t len, const char * na
 
     for (i=0; i < len; i++) {
         const char* tn = table[i].name;
+        if (tn == NULL)
+            continue; // unused slot
         size_t len = strlen(tn);
         if (strncmp(tn, name, len) == 0) {
             if (strlen(name) != len) {
@@ -5121,6 +5523,19 @@ done:
     return ret;
 }
 
+/* reverse of find_index(), for logging entries in their XML spelling */
+static const char *find_name(const struct name_to_index *table, int32_t len,
+                             unsigned int index)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        if ((table[i].index == index) && (table[i].name != NULL))
+            return table[i].name;
+    }
+    return "unknown";
+}
+
 int platform_set_fluence_type(void *platform, char *value)
 {
     int ret = 0;
@@ -5156,6 +5571,7 @@ int platform_set_fluence_type(void *platform, char *value)
         ALOGV("%s: Updating fluence_type to :%d", __func__, fluence_type);
         my_data->fluence_type = fluence_type;
         adev->acdb_settings = (adev->acdb_settings & FLUENCE_MODE_CLEAR) | fluence_flag;
+        snd_device_cfg_gen++;
     }
 done:
     return ret;
@@ -5225,10 +5641,30 @@ void platform_add_operator_specific_device(snd_device_t snd_device,
 
 }
 
+static const struct effect_config_entry *find_effect_config(
+                                              snd_device_t snd_device,
+                                              effect_type_t effect_type)
+{
+    size_t i;
+
+    for (i = 0; i < effect_config_override_cnt; i++) {
+        if (effect_config_overrides[i].snd_device == snd_device &&
+            effect_config_overrides[i].effect_type == effect_type)
+            return &effect_config_overrides[i];
+    }
+    for (i = 0; i < ARRAY_SIZE(effect_config_defaults); i++) {
+        if (effect_config_defaults[i].snd_device == snd_device &&
+            effect_config_defaults[i].effect_type == effect_type)
+            return &effect_config_defaults[i];
+    }
+    return NULL;
+}
+
 int platform_get_effect_config_data(snd_device_t snd_device,
                                       struct audio_effect_config *effect_config,
                                       effect_type_t effect_type)
 {
+    const struct effect_config_entry *entry;
     int ret = 0;
 
     if ((snd_device < SND_DEVICE_IN_BEGIN) || (snd_device >= SND_DEVICE_MAX) ||
@@ -5245,10 +5681,13 @@ int platform_get_effect_config_data(snd_device_t snd_device,
         goto done;
     }
 
+    entry = find_effect_config(snd_device, effect_type);
+    if (entry)
+        *effect_config = entry->config;
+    else
+        memset(effect_config, 0, sizeof(struct audio_effect_config));
     ALOGV("%s: snd_device = %d module_id = %d",
-            __func__, snd_device, effect_config_table[GET_IN_DEVICE_INDEX(snd_device)][effect_type].module_id);
-    memcpy(effect_config, &effect_config_table[GET_IN_DEVICE_INDEX(snd_device)][effect_type],
-           sizeof(struct audio_effect_config));
+            __func__, snd_device, effect_config->module_id);
 
 done:
     return ret;
@@ -5315,6 +5754,7 @@ int platform_set_snd_device_acdb_id(snd_device_t snd_device, unsigned int acdb_i
     ALOGV("%s: acdb_device_table[%s]: old = %d new = %d", __func__,
           platform_get_snd_device_name(snd_device), acdb_device_table[snd_device], acdb_id);
     acdb_device_table[snd_device] = acdb_id;
+    snd_device_cfg_gen++;
 done:
     return ret;
 }
@@ -5323,6 +5763,8 @@ int platform_set_effect_config_data(snd_device_t snd_device,
                                       struct audio_effect_config effect_config,
                                       effect_type_t effect_type)
 {
+    struct effect_config_entry *entry;
+    size_t i;
     int ret = 0;
 
     if ((snd_device < SND_DEVICE_IN_BEGIN) || (snd_device >= SND_DEVICE_MAX) ||
@@ -5336,7 +5778,24 @@ int platform_set_effect_config_data(snd_device_t snd_device,
     ALOGV("%s 0x%x 0x%x 0x%x 0x%x", __func__, effect_config.module_id,
            effect_config.instance_id, effect_config.param_id,
            effect_config.param_value);
-    effect_config_table[GET_IN_DEVICE_INDEX(snd_device)][effect_type] = effect_config;
+    for (i = 0; i < effect_config_override_cnt; i++) {
+        if (effect_config_overrides[i].snd_device == snd_device &&
+            effect_config_overrides[i].effect_type == effect_type)
+            break;
+    }
+    if (i == effect_config_override_cnt) {
+        entry = realloc(effect_config_overrides, (i + 1) * sizeof(*entry));
+        if (!entry) {
+            ALOGE("%s: failed to allocate effect config entry", __func__);
+            ret = -ENOMEM;
+            goto done;
+        }
+        effect_config_overrides = entry;
+        effect_config_override_cnt++;
+        effect_config_overrides[i].snd_device = snd_device;
+        effect_config_overrides[i].effect_type = effect_type;
+    }
+    effect_config_overrides[i].config = effect_config;
 
 done:
     return ret;
@@ -5368,6 +5827,7 @@ int platform_set_acdb_metainfo_key(void *platform, char *name, int key)
     key_info->cal_info.nKey = key;
     strlcpy(key_info->name, name, sizeof(key_info->name));
     list_add_tail(&pdata->acdb_meta_key_list, &key_info->list);
+    invalidate_audio_cal_cache(pdata);
 
     ALOGD("%s: successfully added module %s and key %d to the list", __func__,
                key_info->name, key_info->cal_info.nKey);
@@ -5737,6 +6197,119 @@ int platform_get_backend_index(snd_device_t snd_device)
     return port;
 }
 
+static void invalidate_audio_cal_cache(struct platform_data *my_data)
+{
+    int path;
+
+    for (path = 0; path < AUDIO_CAL_PATHS; path++)
+        my_data->audio_cal_cache.last[path].valid = false;
+}
+
+static bool audio_cal_cache_hit(struct platform_data *my_data, int path,
+                                const struct audio_cal_fingerprint *fp)
+{
+    const struct audio_cal_fingerprint *last = &my_data->audio_cal_cache.last[path];
+
+    return last->valid &&
+           last->acdb_dev_id == fp->acdb_dev_id &&
+           last->app_type == fp->app_type &&
+           last->sample_rate == fp->sample_rate &&
+           last->be_sample_rate == fp->be_sample_rate &&
+           last->fe_id == fp->fe_id &&
+           last->index == fp->index;
+}
+
+static uint64_t audio_cal_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Pushes one calibration tuple through the ACDB loader unless it is what
+ * was last sent on its path. Returns true if the send was skipped.
+ */
+static bool send_audio_cal_fingerprinted(struct platform_data *my_data,
+                                         int acdb_dev_id, int acdb_dev_type,
+                                         int app_type, int sample_rate,
+                                         int fe_id, int index,
+                                         int be_sample_rate, bool prefetch)
+{
+    struct audio_cal_cache *cal_cache = &my_data->audio_cal_cache;
+    struct audio_cal_fingerprint fp;
+    int path = acdb_dev_type - 1;
+    uint64_t start_ns;
+
+    fp.valid = true;
+    fp.prefetched = prefetch;
+    fp.acdb_dev_id = acdb_dev_id;
+    fp.app_type = app_type;
+    fp.sample_rate = sample_rate;
+    fp.be_sample_rate = be_sample_rate;
+#ifdef PLATFORM_AUTO
+    fp.fe_id = fe_id;
+#else
+    /* only the auto loader is given the fe id */
+    fp.fe_id = -1;
+#endif
+    fp.index = index;
+    if (audio_cal_cache_hit(my_data, path, &fp)) {
+        if (!prefetch) {
+            cal_cache->hits++;
+            if (cal_cache->last[path].prefetched) {
+                cal_cache->last[path].prefetched = false;
+                cal_cache->prefetch_hits++;
+                ALOGD("%s: acdb_id(%d) calibration was prefetched, ~%llu us saved",
+                      __func__, acdb_dev_id,
+                      (unsigned long long)(cal_cache->send_ns /
+                                           (cal_cache->misses + cal_cache->prefetch_sends) /
+                                           1000));
+            }
+        }
+        return true;
+    }
+    start_ns = audio_cal_now_ns();
+
+#ifdef PLATFORM_AUTO
+    if (my_data->acdb_send_audio_cal_v6 && (fe_id != -1) ) {
+        my_data->acdb_send_audio_cal_v6(acdb_dev_id, acdb_dev_type,
+                                        app_type, sample_rate, fe_id,
+                                        be_sample_rate, CAL_MODE_SEND, CAL_OFFSET_ASM_TOP);
+    } else if (my_data->acdb_send_audio_cal_v4) {
+        my_data->acdb_send_audio_cal_v4(acdb_dev_id, acdb_dev_type,
+                                        app_type, sample_rate, path,
+                                        be_sample_rate);
+    } else if (my_data->acdb_send_audio_cal_v3) {
+        my_data->acdb_send_audio_cal_v3(acdb_dev_id, acdb_dev_type,
+                                        app_type, sample_rate, index);
+    } else if (my_data->acdb_send_audio_cal) {
+        my_data->acdb_send_audio_cal(acdb_dev_id, acdb_dev_type, app_type,
+                                     sample_rate);
+    }
+#else
+    if (my_data->acdb_send_audio_cal_v4) {
+        my_data->acdb_send_audio_cal_v4(acdb_dev_id, acdb_dev_type,
+                                        app_type, sample_rate, index,
+                                        be_sample_rate);
+    } else if (my_data->acdb_send_audio_cal_v3) {
+        my_data->acdb_send_audio_cal_v3(acdb_dev_id, acdb_dev_type,
+                                        app_type, sample_rate, index);
+    } else if (my_data->acdb_send_audio_cal) {
+        my_data->acdb_send_audio_cal(acdb_dev_id, acdb_dev_type, app_type,
+                                     sample_rate);
+    }
+#endif
+    cal_cache->send_ns += audio_cal_now_ns() - start_ns;
+    if (prefetch)
+        cal_cache->prefetch_sends++;
+    else
+        cal_cache->misses++;
+    cal_cache->last[path] = fp;
+    return false;
+}
+
 int platform_send_audio_calibration(void *platform, struct audio_usecase *usecase,
                                     int app_type)
 {
@@ -5750,6 +6323,8 @@ int platform_send_audio_calibration(void *platform, struct audio_usecase *usecas
     int sample_rate = DEFAULT_OUTPUT_SAMPLING_RATE;
     struct audio_backend_cfg backend_cfg = {0};
     bool is_bus_dev_usecase = false;
+    struct audio_cal_cache *cal_cache = &my_data->audio_cal_cache;
+    int skipped = 0;
 
     if (voice_is_in_call_or_call_screen(my_data->adev) && (usecase->type == PCM_CAPTURE))
         is_incall_rec_usecase = voice_is_in_call_rec_stream(usecase->stream.in);
@@ -5860,39 +6435,22 @@ int platform_send_audio_calibration(void *platform, struct audio_usecase *usecas
         path = acdb_dev_type-1;
         fe_id = platform_get_fe_id(usecase->id, path);
 
-#ifdef PLATFORM_AUTO
-        if (my_data->acdb_send_audio_cal_v6 && (fe_id != -1) ) {
-            my_data->acdb_send_audio_cal_v6(acdb_dev_id, acdb_dev_type,
-                                            app_type, sample_rate, fe_id,
-                                            backend_cfg.sample_rate, CAL_MODE_SEND, CAL_OFFSET_ASM_TOP);
-        } else if (my_data->acdb_send_audio_cal_v4) {
-            my_data->acdb_send_audio_cal_v4(acdb_dev_id, acdb_dev_type,
-                                            app_type, sample_rate, path,
-                                            backend_cfg.sample_rate);
-        } else if (my_data->acdb_send_audio_cal_v3) {
-            my_data->acdb_send_audio_cal_v3(acdb_dev_id, acdb_dev_type,
-                                            app_type, sample_rate, i);
-        } else if (my_data->acdb_send_audio_cal) {
-            my_data->acdb_send_audio_cal(acdb_dev_id, acdb_dev_type, app_type,
-                                         sample_rate);
-        }
-#else
-        if (my_data->acdb_send_audio_cal_v4) {
-            my_data->acdb_send_audio_cal_v4(acdb_dev_id, acdb_dev_type,
-                                            app_type, sample_rate, i,
-                                            backend_cfg.sample_rate);
-        } else if (my_data->acdb_send_audio_cal_v3) {
-            my_data->acdb_send_audio_cal_v3(acdb_dev_id, acdb_dev_type,
-                                            app_type, sample_rate, i);
-        } else if (my_data->acdb_send_audio_cal) {
-            my_data->acdb_send_audio_cal(acdb_dev_id, acdb_dev_type, app_type,
-                                         sample_rate);
-        }
-#endif
+        if (send_audio_cal_fingerprinted(my_data, acdb_dev_id, acdb_dev_type,
+                                         app_type, sample_rate, fe_id, i,
+                                         backend_cfg.sample_rate, false))
+            skipped++;
     }
 
+    if (skipped > 0 && cal_cache->misses + cal_cache->prefetch_sends > 0)
+        ALOGV("%s: usecase(%d) skipped %d calibration sends, ~%llu us saved",
+              __func__, usecase->id, skipped,
+              (unsigned long long)(skipped * cal_cache->send_ns /
+                                   (cal_cache->misses + cal_cache->prefetch_sends) /
+                                   1000));
+
     /* send haptics audio calibration */
     if (usecase->id == USECASE_AUDIO_PLAYBACK_WITH_HAPTICS) {
+        cal_cache->last[ACDB_DEV_TYPE_OUT - 1].valid = false;
         acdb_dev_id =
             acdb_device_table[platform_get_spkr_prot_snd_device(SND_DEVICE_OUT_HAPTICS)];
         acdb_dev_type = ACDB_DEV_TYPE_OUT;
@@ -5913,6 +6471,197 @@ int platform_send_audio_calibration(void *platform, struct audio_usecase *usecas
     return 0;
 }
 
+/* stages the default playback/capture calibration of a single snd device */
+static void acdb_prefetch_snd_device_l(struct platform_data *my_data,
+                                       snd_device_t snd_device)
+{
+    struct audio_backend_cfg backend_cfg = {0};
+    snd_device_t new_snd_device[SND_DEVICE_OUT_END] = {0};
+    int num_devices = 1;
+    int acdb_dev_id, acdb_dev_type, app_type;
+
+    if (!my_data->is_acdb_initialized ||
+        snd_device <= SND_DEVICE_NONE || snd_device >= SND_DEVICE_MAX)
+        return;
+
+    /* split devices are sent per backend, only single ones are staged */
+    if (platform_split_snd_device(my_data, snd_device,
+                                  &num_devices, new_snd_device) == 0 &&
+        num_devices > 1)
+        return;
+
+    acdb_dev_id = acdb_device_table[platform_get_spkr_prot_snd_device(snd_device)];
+    if (acdb_dev_id < 0)
+        return;
+
+    if (snd_device >= SND_DEVICE_OUT_BEGIN && snd_device < SND_DEVICE_OUT_END) {
+        acdb_dev_type = ACDB_DEV_TYPE_OUT;
+        app_type = platform_get_default_app_type_v2(my_data, PCM_PLAYBACK);
+    } else {
+        acdb_dev_type = ACDB_DEV_TYPE_IN;
+        app_type = platform_get_default_app_type_v2(my_data, PCM_CAPTURE);
+    }
+    platform_get_codec_backend_cfg(my_data->adev, snd_device, &backend_cfg);
+
+    if (!send_audio_cal_fingerprinted(my_data, acdb_dev_id, acdb_dev_type,
+                                      app_type, DEFAULT_OUTPUT_SAMPLING_RATE,
+                                      -1, 0, backend_cfg.sample_rate, true))
+        ALOGV("%s: staged calibration for %s acdb_id(%d)", __func__,
+              platform_get_snd_device_name(snd_device), acdb_dev_id);
+}
+
+/*
+ * Sends go through adev->lock like the start path does. The prefetch only
+ * ever tries the lock, so it never holds up a stream start waiting for it.
+ */
+static bool acdb_prefetch_lock_adev(struct platform_data *my_data)
+{
+    struct acdb_prefetch *prefetch = &my_data->acdb_prefetch;
+    int retries;
+    bool exit;
+
+    for (retries = 0; retries < ACDB_PREFETCH_MAX_RETRIES; retries++) {
+        if (pthread_mutex_trylock(&my_data->adev->lock) == 0)
+            return true;
+
+        pthread_mutex_lock(&prefetch->lock);
+        exit = prefetch->exit;
+        pthread_mutex_unlock(&prefetch->lock);
+        if (exit)
+            break;
+        usleep(ACDB_PREFETCH_RETRY_US);
+    }
+    return false;
+}
+
+static void acdb_prefetch_run(struct platform_data *my_data, bool list,
+                              audio_devices_t connected)
+{
+    struct acdb_prefetch *prefetch = &my_data->acdb_prefetch;
+    struct stream_out out;
+    snd_device_t snd_device;
+    int i;
+
+    /* the list is only updated by set_parameters, under adev->lock */
+    for (i = 0; list; i++) {
+        if (!acdb_prefetch_lock_adev(my_data))
+            return;
+        if (i >= prefetch->num_devices) {
+            pthread_mutex_unlock(&my_data->adev->lock);
+            break;
+        }
+        /* last staged wins a path, so the most likely device goes last */
+        acdb_prefetch_snd_device_l(my_data,
+                                   prefetch->devices[prefetch->num_devices - 1 - i]);
+        pthread_mutex_unlock(&my_data->adev->lock);
+    }
+
+    /*
+     * selecting these has side effects (proxy channel mixer, dock and usb
+     * mixer writes) that must not happen for a stream that does not exist
+     */
+    if (connected == AUDIO_DEVICE_NONE ||
+        (connected & OUT_SND_CTX_UNCACHED_DEVICES))
+        return;
+    if (!acdb_prefetch_lock_adev(my_data))
+        return;
+
+    /* the snd device a default playback stream would get on the new output */
+    memset(&out, 0, sizeof(out));
+    list_init(&out.device_list);
+    reassign_device_list(&out.device_list, connected, "");
+    out.sample_rate = DEFAULT_OUTPUT_SAMPLING_RATE;
+    out.format = AUDIO_FORMAT_PCM_16_BIT;
+    out.usecase = USECASE_AUDIO_PLAYBACK_DEEP_BUFFER;
+    snd_device = platform_get_output_snd_device(my_data, &out, USECASE_TYPE_MAX);
+    clear_devices(&out.device_list);
+
+    acdb_prefetch_snd_device_l(my_data, snd_device);
+    pthread_mutex_unlock(&my_data->adev->lock);
+}
+
+static void *acdb_prefetch_thread_loop(void *context)
+{
+    struct platform_data *my_data = (struct platform_data *)context;
+    struct acdb_prefetch *prefetch = &my_data->acdb_prefetch;
+    audio_devices_t connected;
+    bool list;
+
+    setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND);
+    prctl(PR_SET_NAME, (unsigned long)"ACDB Prefetch", 0, 0, 0);
+
+    pthread_mutex_lock(&prefetch->lock);
+    while (!prefetch->exit) {
+        if (!prefetch->list_pending && prefetch->connected == AUDIO_DEVICE_NONE) {
+            pthread_cond_wait(&prefetch->cond, &prefetch->lock);
+            continue;
+        }
+        list = prefetch->list_pending;
+        connected = prefetch->connected;
+        prefetch->list_pending = false;
+        prefetch->connected = AUDIO_DEVICE_NONE;
+        pthread_mutex_unlock(&prefetch->lock);
+
+        acdb_prefetch_run(my_data, list, connected);
+
+        pthread_mutex_lock(&prefetch->lock);
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+    return NULL;
+}
+
+/* value is a list of snd device names, most likely first */
+static void set_acdb_prefetch_list(struct platform_data *my_data, char *value)
+{
+    struct acdb_prefetch *prefetch = &my_data->acdb_prefetch;
+    char *name, *saveptr = NULL;
+    int snd_device, num_devices = 0;
+
+    for (name = strtok_r(value, ", ", &saveptr); name != NULL;
+         name = strtok_r(NULL, ", ", &saveptr)) {
+        snd_device = platform_get_snd_device_index(name);
+        if (snd_device < 0) {
+            ALOGE("%s: unknown snd device %s", __func__, name);
+            continue;
+        }
+        if (num_devices == ACDB_PREFETCH_MAX_DEVICES) {
+            ALOGW("%s: only the first %d devices are prefetched",
+                  __func__, ACDB_PREFETCH_MAX_DEVICES);
+            break;
+        }
+        prefetch->devices[num_devices++] = snd_device;
+    }
+
+    pthread_mutex_lock(&prefetch->lock);
+    prefetch->num_devices = num_devices;
+    pthread_mutex_unlock(&prefetch->lock);
+}
+
+static void acdb_prefetch_request(struct platform_data *my_data,
+                                  bool list, audio_devices_t connected)
+{
+    struct acdb_prefetch *prefetch = &my_data->acdb_prefetch;
+
+    pthread_mutex_lock(&prefetch->lock);
+    if (list && prefetch->num_devices > 0)
+        prefetch->list_pending = true;
+    /* only the latest connect matters, it is where the next start goes */
+    if (connected != AUDIO_DEVICE_NONE)
+        prefetch->connected = connected;
+
+    if (prefetch->list_pending || prefetch->connected != AUDIO_DEVICE_NONE) {
+        if (!prefetch->thread_created && !prefetch->exit) {
+            if (pthread_create(&prefetch->thread, (const pthread_attr_t *) NULL,
+                               acdb_prefetch_thread_loop, my_data) == 0)
+                prefetch->thread_created = true;
+            else
+                ALOGE("%s: could not create prefetch thread", __func__);
+        }
+        pthread_cond_signal(&prefetch->cond);
+    }
+    pthread_mutex_unlock(&prefetch->lock);
+}
+
 int platform_send_audio_calibration_hfp(void *platform, snd_device_t snd_device)
 {
     struct platform_data *my_data = (struct platform_data *)platform;
@@ -5920,6 +6669,8 @@ int platform_send_audio_calibration_hfp(void *platform, snd_device_t snd_device)
     int sample_rate = CODEC_BACKEND_DEFAULT_SAMPLE_RATE;
     int app_type = 0;
 
+    invalidate_audio_cal_cache(my_data);
+
     acdb_dev_id = platform_get_snd_device_acdb_id(snd_device);
     if (acdb_dev_id < 0) {
         ALOGE("%s: Could not find acdb id for device(%d)",
@@ -6065,9 +6816,10 @@ int platform_switch_voice_call_device_post(void *platform,
         acdb_rx_id = platform_get_snd_device_acdb_id(out_snd_device);
         acdb_tx_id = platform_get_snd_device_acdb_id(in_snd_device);
 
-        if (acdb_rx_id > 0 && acdb_tx_id > 0)
+        if (acdb_rx_id > 0 && acdb_tx_id > 0) {
+            invalidate_audio_cal_cache(my_data);
             my_data->acdb_send_voice_cal(acdb_rx_id, acdb_tx_id);
-        else
+        } else
             ALOGE("%s: Incorrect ACDB IDs (rx: %d tx: %d)", __func__,
                   acdb_rx_id, acdb_tx_id);
     }
@@ -6759,8 +7511,8 @@ int platform_get_ext_disp_type_v2(void *platform, int controller, int stream)
     return disp_type;
 }
 
-snd_device_t platform_get_output_snd_device(void *platform, struct stream_out *out,
-                                            usecase_type_t uc_type)
+static snd_device_t select_output_snd_device(void *platform, struct stream_out *out,
+                                             usecase_type_t uc_type)
 {
     struct platform_data *my_data = (struct platform_data *)platform;
     struct audio_device *adev = my_data->adev;
@@ -7233,6 +7985,136 @@ exit:
     return snd_device;
 }
 
+/*
+ * Fills in the routing context of out. Returns false if the selection for
+ * it has side effects or depends on state outside of the context, in which
+ * case it must not be served from the cache.
+ */
+static bool get_out_snd_device_ctx(struct platform_data *my_data,
+                                   struct stream_out *out,
+                                   usecase_type_t uc_type,
+                                   struct out_snd_device_ctx *ctx)
+{
+    struct audio_device *adev = my_data->adev;
+    struct stream_in *in;
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->devices = get_device_types(&out->device_list);
+    ctx->num_devices = list_length(&out->device_list);
+    if (ctx->num_devices == 0 || ctx->num_devices > 2 ||
+        (ctx->devices & AUDIO_DEVICE_BIT_IN) ||
+        (ctx->devices & OUT_SND_CTX_UNCACHED_DEVICES) ||
+        audio_extn_get_anc_enabled())
+        return false;
+
+    ctx->controller = -1;
+    ctx->stream = -1;
+    ctx->disp_type = EXT_DISPLAY_TYPE_NONE;
+    if (ctx->devices & AUDIO_DEVICE_OUT_AUX_DIGITAL) {
+        ctx->controller = out->extconn.cs.controller;
+        ctx->stream = out->extconn.cs.stream;
+        if (ctx->controller < 0 || ctx->controller >= MAX_CONTROLLERS ||
+            ctx->stream < 0 || ctx->stream >= MAX_STREAMS_PER_CONTROLLER)
+            return false;
+        ctx->disp_type = my_data->ext_disp[ctx->controller][ctx->stream].type;
+    }
+
+    if (voice_check_voicecall_usecases_active(adev))
+        ctx->flags |= OUT_SND_CTX_VOICECALL_ACTIVE;
+    if (voice_extn_compress_voip_is_active(adev))
+        ctx->flags |= OUT_SND_CTX_VOIP_ACTIVE;
+    if (audio_extn_hfp_is_active(adev))
+        ctx->flags |= OUT_SND_CTX_HFP_ACTIVE;
+    if (adev->enable_voicerx)
+        ctx->flags |= OUT_SND_CTX_VOICERX;
+
+    /* the in call handset choice depends on the SIM operator */
+    if ((ctx->devices & AUDIO_DEVICE_OUT_EARPIECE) &&
+        (adev->mode == AUDIO_MODE_IN_CALL || (ctx->flags & OUT_SND_CTX_VOICE_PATH)))
+        return false;
+
+    if (adev->enable_hfp)
+        ctx->flags |= OUT_SND_CTX_ENABLE_HFP;
+    if (adev->dp_allowed_for_voice)
+        ctx->flags |= OUT_SND_CTX_DP_FOR_VOICE;
+    if (adev->bt_wb_speech_enabled)
+        ctx->flags |= OUT_SND_CTX_BT_WB;
+    if (adev->voice.hac)
+        ctx->flags |= OUT_SND_CTX_HAC;
+    if (adev->speaker_lr_swap)
+        ctx->flags |= OUT_SND_CTX_LR_SWAP;
+
+    in = adev_get_active_input(adev);
+    ctx->channel_count = popcount((in == NULL) ?
+                                  AUDIO_CHANNEL_IN_MONO : in->channel_mask);
+    if ((ctx->devices & (AUDIO_DEVICE_OUT_WIRED_HEADPHONE |
+                         AUDIO_DEVICE_OUT_WIRED_HEADSET |
+                         AUDIO_DEVICE_OUT_LINE)) &&
+        audio_extn_is_hifi_filter_enabled(adev, out, SND_DEVICE_NONE,
+                                          my_data->codec_variant,
+                                          ctx->channel_count, 1))
+        ctx->flags |= OUT_SND_CTX_HIFI_FILTER;
+
+    ctx->cfg_gen = snd_device_cfg_gen;
+    ctx->na_mode = platform_get_native_support();
+    ctx->tty_mode = adev->voice.tty_mode;
+    ctx->swb_speech_mode = adev->swb_speech_mode;
+    ctx->sample_rate = out->sample_rate;
+    ctx->format = out->format;
+    ctx->mode = adev->mode;
+    ctx->uc_type = uc_type;
+    return true;
+}
+
+/* called with adev->lock held, as the selection itself walks the usecases */
+snd_device_t platform_get_output_snd_device(void *platform, struct stream_out *out,
+                                            usecase_type_t uc_type)
+{
+    struct platform_data *my_data = (struct platform_data *)platform;
+    struct out_snd_device_cache *cache = &my_data->out_snd_cache;
+    struct out_snd_device_ctx ctx;
+    snd_device_t snd_device;
+    int i;
+
+    if (!get_out_snd_device_ctx(my_data, out, uc_type, &ctx)) {
+        cache->uncached++;
+        return select_output_snd_device(platform, out, uc_type);
+    }
+
+    for (i = 0; i < cache->count; i++) {
+        if (memcmp(&cache->ctx[i], &ctx, sizeof(ctx)) != 0)
+            continue;
+
+        cache->hits++;
+        snd_device = cache->snd_device[i];
+        if (cache->verify) {
+            snd_device_t selected = select_output_snd_device(platform, out, uc_type);
+            if (selected != snd_device) {
+                ALOGE("%s: cached snd_device %s for devices %#x, selected %s",
+                      __func__, platform_get_snd_device_name(snd_device),
+                      ctx.devices, platform_get_snd_device_name(selected));
+                cache->mismatches++;
+                cache->snd_device[i] = selected;
+                snd_device = selected;
+            }
+        }
+        return snd_device;
+    }
+
+    cache->misses++;
+    snd_device = select_output_snd_device(platform, out, uc_type);
+    if (snd_device == SND_DEVICE_NONE)
+        return snd_device;
+
+    i = cache->next;
+    cache->ctx[i] = ctx;
+    cache->snd_device[i] = snd_device;
+    cache->next = (i + 1) % OUT_SND_DEVICE_CACHE_SIZE;
+    if (cache->count < OUT_SND_DEVICE_CACHE_SIZE)
+        cache->count++;
+    return snd_device;
+}
+
 static snd_device_t get_snd_device_for_voice_comm_ecns_enabled(struct platform_data *my_data,
                                                   struct stream_in *in,
                                                   struct listnode *out_devices __unused,
@@ -8222,9 +9104,8 @@ int platform_edid_get_max_channels(void *platform) {
 
 int platform_edid_get_max_channels_v2(void *platform, int controller, int stream)
 {
-    int channel_count;
     int max_channels = 2;
-    int i = 0, ret = 0;
+    int ret = 0;
     struct platform_data *my_data = (struct platform_data *)platform;
     edid_audio_info *info = NULL;
 
@@ -8232,19 +9113,8 @@ int platform_edid_get_max_channels_v2(void *platform, int controller, int stream
     if(ret == 0)
         info = (edid_audio_info *)my_data->ext_disp[controller][stream].edid_info;
 
-    if(ret == 0 && info != NULL) {
-        for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
-            ALOGV("%s:format %d channel %d", __func__,
-                   info->audio_blocks_array[i].format_id,
-                   info->audio_blocks_array[i].channels);
-            if (info->audio_blocks_array[i].format_id == LPCM) {
-                channel_count = info->audio_blocks_array[i].channels;
-                if (channel_count > max_channels) {
-                   max_channels = channel_count;
-                }
-            }
-        }
-    }
+    if(ret == 0 && info != NULL && info->max_lpcm_channels > max_channels)
+        max_channels = info->max_lpcm_channels;
     return max_channels;
 }
 
@@ -8390,6 +9260,7 @@ static int platform_set_hfp_zone(struct platform_data *my_data, uint32_t zone)
     cal.param_id = fluence_mmsecns_config.param_id;
 
     if (my_data->acdb_set_audio_cal) {
+        invalidate_audio_cal_cache(my_data);
         ret = my_data->acdb_set_audio_cal((void *)&cal, (void *)&zone, sizeof(uint32_t));
     }
 
@@ -8621,6 +9492,7 @@ static void set_audiocal(void *platform, struct str_parms *parms, char *value, i
             goto done_key_audcal;
         }
         if(my_data->acdb_set_audio_cal) {
+            invalidate_audio_cal_cache(my_data);
             ret = my_data->acdb_set_audio_cal((void *)&cal, (void*)dptr, dlen);
         }
     }
@@ -8833,6 +9705,9 @@ int platform_set_parameters(void *platform, struct str_parms *parms)
     struct meta_key_list *key_info;
     int key = 0;
 
+    /* any of the keys below may change what output device selection reads */
+    snd_device_cfg_gen++;
+
     if(kv_pairs == NULL) {
         ret = -ENOMEM;
         ALOGE("[%s] key-value pair is NULL",__func__);
@@ -8912,6 +9787,7 @@ int platform_set_parameters(void *platform, struct str_parms *parms)
                             value, len);
     if (err >= 0) {
         str_parms_del(parms, AUDIO_PARAMETER_KEY_RELOAD_ACDB);
+        invalidate_audio_cal_cache(my_data);
 
         if (my_data->acdb_reload_v2) {
             my_data->acdb_reload_v2(value, my_data->snd_card_name,
@@ -8931,6 +9807,23 @@ int platform_set_parameters(void *platform, struct str_parms *parms)
         ALOGD("Updating afe_loopback as %d from platform XML" , my_data->afe_loopback);
     }
 
+    err = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_ACDB_PREFETCH, value, len);
+    if (err >= 0) {
+        set_acdb_prefetch_list(my_data, value);
+        str_parms_del(parms, AUDIO_PARAMETER_KEY_ACDB_PREFETCH);
+    }
+
+    err = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_LATENCY_MODEL, value, len);
+    if (err >= 0) {
+        set_latency_model_entry(value);
+        str_parms_del(parms, AUDIO_PARAMETER_KEY_LATENCY_MODEL);
+    }
+
+    /* the connect itself is handled by the caller, keep the key */
+    err = str_parms_get_str(parms, AUDIO_PARAMETER_DEVICE_CONNECT, value, len);
+    if (err >= 0 && audio_is_output_device(atoi(value)))
+        acdb_prefetch_request(my_data, false, (audio_devices_t)atoi(value));
+
     err = str_parms_get_str(parms, AUDIO_PARAMETER_KEY_MONO_SPEAKER, value, len);
     if (err >= 0) {
         if (!strncmp("left", value, sizeof("left")))
@@ -9456,6 +10349,147 @@ done:
     return NULL;
 }
 
+void platform_set_latency_model_entry(audio_usecase_t usecase, snd_device_t snd_device,
+                                      unsigned int sample_rate, int delay_us)
+{
+    struct latency_model_entry *entry;
+    int i;
+
+    if ((usecase < 0) || (usecase >= AUDIO_USECASE_MAX) ||
+            (snd_device < SND_DEVICE_NONE) || (snd_device >= SND_DEVICE_MAX) ||
+            (delay_us < 0)) {
+        ALOGE("%s: Invalid entry usecase %d snd_device %d delay %d",
+              __func__, usecase, snd_device, delay_us);
+        return;
+    }
+
+    for (i = 0; i < latency_model_cnt; i++) {
+        entry = &latency_model[i];
+        if ((entry->usecase == usecase) && (entry->snd_device == snd_device) &&
+                (entry->sample_rate == sample_rate))
+            break;
+    }
+    if (i == LATENCY_MODEL_MAX_ENTRIES) {
+        ALOGE("%s: latency model full, dropping %s", __func__,
+              use_case_table[usecase]);
+        return;
+    }
+
+    entry = &latency_model[i];
+    entry->usecase = usecase;
+    entry->snd_device = snd_device;
+    entry->sample_rate = sample_rate;
+    entry->delay_us = delay_us;
+    if (i == latency_model_cnt)
+        latency_model_cnt++;
+    ALOGV("%s: %s %s %u: %d us", __func__, use_case_table[usecase],
+          platform_get_snd_device_name(snd_device), sample_rate, delay_us);
+}
+
+static void latency_model_route(struct platform_data *my_data,
+                                audio_usecase_t usecase, snd_device_t snd_device)
+{
+    if ((usecase < 0) || (usecase >= AUDIO_USECASE_MAX))
+        return;
+
+    my_data->latency_route[usecase].backend_idx = platform_get_backend_index(snd_device);
+    my_data->latency_route[usecase].snd_device = snd_device;
+}
+
+/*
+ * Called without adev->lock from the position queries; the route and the
+ * backend rate are plain ints updated under it, a stale read only picks the
+ * entry of the previous route.
+ */
+static bool latency_model_lookup(struct platform_data *my_data,
+                                 audio_usecase_t usecase, int64_t *delay)
+{
+    struct latency_model_entry *entry;
+    struct latency_route *route;
+    unsigned int sample_rate = 0;
+    int i, score, best = -1;
+
+    if ((latency_model_cnt == 0) || (usecase < 0) || (usecase >= AUDIO_USECASE_MAX))
+        return false;
+
+    route = &my_data->latency_route[usecase];
+    if ((route->snd_device != SND_DEVICE_NONE) &&
+            (route->backend_idx >= 0) && (route->backend_idx < MAX_CODEC_BACKENDS))
+        sample_rate = my_data->current_backend_cfg[route->backend_idx].sample_rate;
+
+    for (i = 0; i < latency_model_cnt; i++) {
+        entry = &latency_model[i];
+        if ((entry->usecase != usecase) ||
+                ((entry->snd_device != SND_DEVICE_NONE) &&
+                 (entry->snd_device != route->snd_device)) ||
+                ((entry->sample_rate != 0) && (entry->sample_rate != sample_rate)))
+            continue;
+
+        score = ((entry->snd_device != SND_DEVICE_NONE) ? 2 : 0) +
+                ((entry->sample_rate != 0) ? 1 : 0);
+        if (score > best) {
+            best = score;
+            *delay = entry->delay_us;
+        }
+    }
+    return best >= 0;
+}
+
+/* in the XML form so a calibrated table can be copied into the platform info */
+static void log_latency_model(void)
+{
+    struct latency_model_entry *entry;
+    const char *usecase_name;
+    char snd_device_attr[128];
+    char sample_rate_attr[32];
+    int i;
+
+    for (i = 0; i < latency_model_cnt; i++) {
+        entry = &latency_model[i];
+        usecase_name = find_name(usecase_name_index, AUDIO_USECASE_MAX,
+                                 entry->usecase);
+        snd_device_attr[0] = '\0';
+        if (entry->snd_device != SND_DEVICE_NONE)
+            snprintf(snd_device_attr, sizeof(snd_device_attr), " snd_device=\"%s\"",
+                     find_name(snd_device_name_index, SND_DEVICE_MAX,
+                               entry->snd_device));
+        sample_rate_attr[0] = '\0';
+        if (entry->sample_rate != 0)
+            snprintf(sample_rate_attr, sizeof(sample_rate_attr), " sample_rate=\"%u\"",
+                     entry->sample_rate);
+        ALOGI("<latency usecase=\"%s\"%s%s delay_us=\"%d\"/>", usecase_name,
+              snd_device_attr, sample_rate_attr, entry->delay_us);
+    }
+}
+
+/* usecase,snd_device|any,sample_rate,delay_us */
+static void set_latency_model_entry(char *value)
+{
+    char *saveptr = NULL;
+    char *tok[4];
+    int usecase, snd_device = SND_DEVICE_NONE;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        tok[i] = strtok_r(i == 0 ? value : NULL, ",", &saveptr);
+        if (tok[i] == NULL) {
+            ALOGE("%s: expected usecase,snd_device,sample_rate,delay_us", __func__);
+            return;
+        }
+    }
+
+    usecase = platform_get_usecase_index(tok[0]);
+    if (strcmp(tok[1], "any") != 0)
+        snd_device = platform_get_snd_device_index(tok[1]);
+    if ((usecase < 0) || (snd_device < 0)) {
+        ALOGE("%s: unknown usecase %s or snd device %s", __func__, tok[0], tok[1]);
+        return;
+    }
+
+    platform_set_latency_model_entry(usecase, snd_device, atoi(tok[2]), atoi(tok[3]));
+    log_latency_model();
+}
+
 void platform_set_audio_source_delay(audio_source_t audio_source, int delay_ms)
 {
     if ((audio_source < AUDIO_SOURCE_DEFAULT) ||
@@ -9493,6 +10527,8 @@ int64_t platform_render_latency(struct stream_out *out)
 
     if (!out)
         return delay;
+    if (latency_model_lookup(out->dev->platform, out->usecase, &delay))
+        return delay;
     switch (out->usecase) {
         case USECASE_AUDIO_PLAYBACK_DEEP_BUFFER:
         case USECASE_AUDIO_PLAYBACK_MEDIA:
@@ -9536,6 +10572,8 @@ int64_t platform_capture_latency(struct stream_in *in)
 
     if (!in)
         return delay;
+    if (latency_model_lookup(in->dev->platform, in->usecase, &delay))
+        return delay;
 
     delay = platform_get_audio_source_delay(in->source);
 
@@ -9906,6 +10944,8 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
     int controller = -1;
     int stream = -1;
     const char *id_string = NULL;
+    bool reconfigured = false;
+    uint64_t start_ns = audio_cal_now_ns();
     int cfg_value = -1;
 
     if (usecase != NULL && usecase->stream.out &&
@@ -9939,8 +10979,9 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
         (bit_width != my_data->current_backend_cfg[backend_idx].bit_width)) {
 
         struct  mixer_ctl *ctl = NULL;
-        ctl = mixer_get_ctl_by_name(adev->mixer,
-                    my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl);
+        ctl = get_backend_mixer_ctl(my_data,
+                    my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl,
+                    &my_data->current_backend_cfg[backend_idx].bitwidth_ctl);
         if (!ctl) {
             ALOGE("%s:becf: afe: Could not get ctl for mixer command - %s",
                   __func__,
@@ -9950,37 +10991,34 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
 
         if (bit_width == 24) {
             if (format == AUDIO_FORMAT_PCM_24_BIT_PACKED)
-                 ret = mixer_ctl_set_enum_by_string(ctl, "S24_3LE");
+                 id_string = "S24_3LE";
             else
-                 ret = mixer_ctl_set_enum_by_string(ctl, "S24_LE");
+                 id_string = "S24_LE";
         } else if (bit_width == 32) {
-            ret = mixer_ctl_set_enum_by_string(ctl, "S32_LE");
+            id_string = "S32_LE";
         } else {
-            ret = mixer_ctl_set_enum_by_string(ctl, "S16_LE");
+            id_string = "S16_LE";
         }
+        ret = mixer_ctl_set_enum_by_string(ctl, id_string);
         if (ret < 0) {
             ALOGE("%s:becf: afe: fail for %s mixer set to %d bit for %x format", __func__,
                   my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl, bit_width, format);
         } else {
             ALOGD("%s:becf: afe: %s mixer set to %d bit for %x format", __func__,
                   my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl, bit_width, format);
+            /* backends sharing the control now run with what was just set */
+            cfg_value = audio_extn_utils_get_bit_width_from_string(id_string);
             for (int idx = 0; idx < MAX_CODEC_BACKENDS; idx++) {
                 if (my_data->current_backend_cfg[idx].bitwidth_mixer_ctl
                         && strcmp(my_data->current_backend_cfg[idx].bitwidth_mixer_ctl,
-                        my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl) == 0) {
-                    ctl = mixer_get_ctl_by_name(adev->mixer,
-                                 my_data->current_backend_cfg[idx].bitwidth_mixer_ctl);
-                    id_string = platform_get_mixer_control(ctl);
-                    if (id_string) {
-                        cfg_value = audio_extn_utils_get_bit_width_from_string(id_string);
-                        if (cfg_value > 0)
-                            my_data->current_backend_cfg[idx].bit_width = cfg_value;
-                    }
-                }
+                        my_data->current_backend_cfg[backend_idx].bitwidth_mixer_ctl) == 0
+                        && cfg_value > 0)
+                    my_data->current_backend_cfg[idx].bit_width = cfg_value;
             }
         }
         /* set the ret as 0 and not pass back to upper layer */
         ret = 0;
+        reconfigured = true;
     }
 
     if ((my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl) &&
@@ -10055,8 +11093,9 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
             }
         }
 
-        ctl = mixer_get_ctl_by_name(adev->mixer,
-            my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl);
+        ctl = get_backend_mixer_ctl(my_data,
+            my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl,
+            &my_data->current_backend_cfg[backend_idx].samplerate_ctl);
         if(!ctl) {
             ALOGE("%s:becf: afe: Could not get ctl for mixer command - %s",
                   __func__,
@@ -10071,22 +11110,17 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
         } else {
             ALOGD("%s:becf: afe: %s set to %s", __func__,
                   my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl, rate_str);
+            cfg_value = audio_extn_utils_get_sample_rate_from_string(rate_str);
             for (int idx = 0; idx < MAX_CODEC_BACKENDS; idx++) {
                 if (my_data->current_backend_cfg[idx].samplerate_mixer_ctl
                         && strcmp(my_data->current_backend_cfg[idx].samplerate_mixer_ctl,
-                        my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl) == 0) {
-                    ctl = mixer_get_ctl_by_name(adev->mixer,
-                                 my_data->current_backend_cfg[idx].samplerate_mixer_ctl);
-                    id_string = platform_get_mixer_control(ctl);
-                    if (id_string) {
-                        cfg_value = audio_extn_utils_get_sample_rate_from_string(id_string);
-                        if (cfg_value > 0)
-                            my_data->current_backend_cfg[idx].sample_rate = cfg_value;
-                    }
-                }
+                        my_data->current_backend_cfg[backend_idx].samplerate_mixer_ctl) == 0
+                        && cfg_value > 0)
+                    my_data->current_backend_cfg[idx].sample_rate = cfg_value;
             }
         }
         ret = 0;
+        reconfigured = true;
     }
     if ((my_data->current_backend_cfg[backend_idx].channels_mixer_ctl) &&
         (channels != my_data->current_backend_cfg[backend_idx].channels)) {
@@ -10113,8 +11147,9 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
             channel_cnt_str = "Two"; break;
         }
 
-        ctl = mixer_get_ctl_by_name(adev->mixer,
-           my_data->current_backend_cfg[backend_idx].channels_mixer_ctl);
+        ctl = get_backend_mixer_ctl(my_data,
+           my_data->current_backend_cfg[backend_idx].channels_mixer_ctl,
+           &my_data->current_backend_cfg[backend_idx].channels_ctl);
         if (!ctl) {
             ALOGE("%s:becf: afe: Could not get ctl for mixer command - %s",
                    __func__,
@@ -10128,22 +11163,17 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
         } else {
             ALOGD("%s:becf: afe: %s set to %s", __func__,
                   my_data->current_backend_cfg[backend_idx].channels_mixer_ctl, channel_cnt_str);
+            cfg_value = audio_extn_utils_get_channels_from_string(channel_cnt_str);
             for (int idx = 0; idx < MAX_CODEC_BACKENDS; idx++) {
                 if (my_data->current_backend_cfg[idx].channels_mixer_ctl &&
                         strcmp(my_data->current_backend_cfg[idx].channels_mixer_ctl,
-                        my_data->current_backend_cfg[backend_idx].channels_mixer_ctl) == 0) {
-                    ctl = mixer_get_ctl_by_name(adev->mixer,
-                                 my_data->current_backend_cfg[idx].channels_mixer_ctl);
-                    id_string = platform_get_mixer_control(ctl);
-                    if (id_string) {
-                        cfg_value = audio_extn_utils_get_channels_from_string(id_string);
-                        if (cfg_value > 0)
-                            my_data->current_backend_cfg[idx].channels = cfg_value;
-                    }
-                }
+                        my_data->current_backend_cfg[backend_idx].channels_mixer_ctl) == 0 &&
+                        cfg_value > 0)
+                    my_data->current_backend_cfg[idx].channels = cfg_value;
             }
         }
         ret = 0;
+        reconfigured = true;
 
         if ((backend_idx == HDMI_RX_BACKEND) ||
                 (backend_idx == DISP_PORT_RX_BACKEND) ||
@@ -10255,6 +11285,10 @@ static int platform_set_codec_backend_cfg(struct audio_device* adev,
         }
         ret = 0;
     }
+    if (reconfigured) {
+        my_data->backend_reconfigs++;
+        my_data->backend_reconfig_ns += audio_cal_now_ns() - start_ns;
+    }
     return ret;
 }
 
@@ -10808,6 +11842,7 @@ bool platform_check_and_set_codec_backend_cfg(struct audio_device* adev,
 
     backend_idx = platform_get_backend_index(snd_device);
     device_be_idx = platform_get_snd_device_backend_index(snd_device);
+    latency_model_route(my_data, usecase->id, snd_device);
 
     if (usecase->type == TRANSCODE_LOOPBACK_RX) {
         backend_cfg.bit_width = usecase->stream.inout->out_config.bit_width;
@@ -10993,6 +12028,7 @@ bool platform_check_and_set_capture_codec_backend_cfg(struct audio_device* adev,
     int i, num_devices = 1;
     struct platform_data *my_data = (struct platform_data *)adev->platform;
 
+    latency_model_route(my_data, usecase->id, snd_device);
     backend_cfg.passthrough_enabled = false;
 
     if (usecase->type == TRANSCODE_LOOPBACK_TX) {
@@ -11596,10 +12632,27 @@ int platform_get_edid_info_v2(void *platform, int controller, int stream)
 
     ALOGV("%s: received edid data: count %d", __func__, edid_data[0]);
 
+    /* the same sink plugged back in, reuse what was parsed for it */
+    if (state->edid_info && state->last_edid_info &&
+            state->last_edid_len == count + 1 &&
+            memcmp(state->last_edid, edid_data, count + 1) == 0) {
+        memcpy(state->edid_info, state->last_edid_info, sizeof(struct edid_audio_info));
+        state->valid = true;
+        return 0;
+    }
+
     if (!audio_extn_edid_get_sink_caps(state->edid_info, edid_data)) {
         ALOGE("%s: Failed to get extn disp sink capabilities", __func__);
         goto fail;
     }
+
+    if (state->last_edid_info == NULL)
+        state->last_edid_info = calloc(1, sizeof(struct edid_audio_info));
+    if (state->last_edid_info) {
+        memcpy(state->last_edid_info, state->edid_info, sizeof(struct edid_audio_info));
+        memcpy(state->last_edid, edid_data, count + 1);
+        state->last_edid_len = count + 1;
+    }
     state->valid = true;
     return 0;
 fail:
@@ -11875,7 +12928,7 @@ void platform_add_app_type(const char *uc_type,
     }
 
     ap->uc_type = -1;
-    for (int i=0; i<USECASE_TYPE_MAX; i++) {
+    for (size_t i=0; i<ARRAY_SIZE(usecase_type_index); i++) {
         if (!strcmp(uc_type, usecase_type_index[i].name)) {
             ap->uc_type = usecase_type_index[i].index;
             break;
@@ -11905,7 +12958,7 @@ bool platform_is_edid_supported_format_v2(void *platform,
 {
     struct platform_data *my_data = (struct platform_data *)platform;
     edid_audio_info *info = NULL;
-    int i, ret;
+    int ret;
     unsigned char format_id = platform_map_to_edid_format(format);
 
     if (format == AUDIO_FORMAT_IEC61937)
@@ -11919,19 +12972,16 @@ bool platform_is_edid_supported_format_v2(void *platform,
     ret = platform_get_edid_info_v2(platform, controller, stream);
     if (ret == 0)
         info = (edid_audio_info *)my_data->ext_disp[controller][stream].edid_info;
-    if (ret == 0 && info != NULL) {
-        for (i = 0; i < info->audio_blocks && i < MAX_EDID_BLOCKS; i++) {
-             /*
-              * To check
-              *  is there any special for CONFIG_HDMI_PASSTHROUGH_CONVERT
-              *  & DOLBY_DIGITAL_PLUS
-              */
-            if (info->audio_blocks_array[i].format_id == format_id) {
-                ALOGV("%s:returns true %x",
-                      __func__, format);
-                return true;
-            }
-        }
+    /*
+     * To check
+     *  is there any special for CONFIG_HDMI_PASSTHROUGH_CONVERT
+     *  & DOLBY_DIGITAL_PLUS
+     */
+    if (ret == 0 && info != NULL && format_id < 32 &&
+            (info->format_mask & BIT(format_id))) {
+        ALOGV("%s:returns true %x",
+              __func__, format);
+        return true;
     }
     ALOGV("%s:returns false %x",
            __func__, format);
@@ -12543,6 +13593,7 @@ int platform_send_audio_cal(void* platform, acdb_audio_cal_cfg_t* cal,
         audio_extn_ip_hdlr_copp_update_cal_info((void*)cal, data);
 
     if (my_data->acdb_set_audio_cal) {
+        invalidate_audio_cal_cache(my_data);
         // persist audio cal in local cache
         if (persist) {
             ret = my_data->acdb_set_audio_cal((void*)cal, data, (uint32_t)length);
@@ -12599,6 +13650,7 @@ int platform_store_audio_cal(void* platform, acdb_audio_cal_cfg_t* cal,
     }
 
     if (my_data->acdb_set_audio_cal) {
+        invalidate_audio_cal_cache(my_data);
         ret = my_data->acdb_set_audio_cal((void*)cal, data, (uint32_t)length);
     }
 
@@ -12984,13 +14036,20 @@ bool platform_set_microphone_map(void *platform, snd_device_t in_snd_device,
         ALOGE("%s: Sound device not valid", __func__);
         return false;
     }
-    size_t m_count = my_data->mic_map[in_snd_device].mic_count++;
+    struct snd_device_to_mic_map *map = my_data->mic_map[in_snd_device];
+    size_t m_count = map ? map->mic_count : 0;
     if (m_count >= AUDIO_MICROPHONE_MAX_COUNT) {
         ALOGE("%s: Microphone count is greater than max allowed value", __func__);
-        my_data->mic_map[in_snd_device].mic_count--;
         return false;
     }
-    my_data->mic_map[in_snd_device].microphones[m_count] = *info;
+    map = realloc(map, sizeof(*map) + (m_count + 1) * sizeof(struct mic_info));
+    if (!map) {
+        ALOGE("%s: failed to allocate microphone map", __func__);
+        return false;
+    }
+    map->microphones[m_count] = *info;
+    map->mic_count = m_count + 1;
+    my_data->mic_map[in_snd_device] = map;
     return true;
 }
 
@@ -13057,8 +14116,12 @@ int platform_get_active_microphones(void *platform, unsigned int channels,
         goto end;
     }
 
-    size_t  active_mic_count = my_data->mic_map[active_input_snd_device].mic_count;
-    struct mic_info *m_info = my_data->mic_map[active_input_snd_device].microphones;
+    if (my_data->mic_map[active_input_snd_device] == NULL) {
+        ALOGI("%s: No microphones mapped to %d", __func__, active_input_snd_device);
+        goto end;
+    }
+    size_t  active_mic_count = my_data->mic_map[active_input_snd_device]->mic_count;
+    struct mic_info *m_info = my_data->mic_map[active_input_snd_device]->microphones;
 
     for (size_t i = 0; i < active_mic_count; i++) {
         unsigned int channels_for_active_mic = channels;
@@ -119,6 +119,7 @@ typedef enum {
     CUSTOM_MTMX_PARAM_IN_CH_INFO,
     MMSECNS,
     AUDIO_SOURCE_DELAY,
+    LATENCY_MODEL,
 #ifdef SOFT_VOLUME
     SOFT_VOLUME_PARAMS,
 #endif
@@ -159,6 +160,7 @@ static void process_custom_mtmx_in_params(const XML_Char **attr);
 static void process_custom_mtmx_param_in_ch_info(const XML_Char **attr);
 static void process_fluence_mmsecns(const XML_Char **attr);
 static void process_audio_source_delay(const XML_Char **attr);
+static void process_latency_model(const XML_Char **attr);
 #ifdef SOFT_VOLUME
 static void process_soft_volume_params(const XML_Char **attr);
 #endif
@@ -187,6 +189,7 @@ static section_process_fn section_table[] = {
     [CUSTOM_MTMX_PARAM_IN_CH_INFO] = process_custom_mtmx_param_in_ch_info,
     [MMSECNS] = process_fluence_mmsecns,
     [AUDIO_SOURCE_DELAY] = process_audio_source_delay,
+    [LATENCY_MODEL] = process_latency_model,
 #ifdef SOFT_VOLUME
     [SOFT_VOLUME_PARAMS] = process_soft_volume_params,
 #endif
@@ -813,6 +816,49 @@ done:
     return;
 }
 
+/*
+ * <latency usecase="..." [snd_device="..."] [sample_rate="..."] delay_us="..."/>
+ * an omitted snd_device or sample_rate matches any route
+ */
+static void process_latency_model(const XML_Char **attr)
+{
+    int usecase = -1;
+    int snd_device = SND_DEVICE_NONE;
+    unsigned int sample_rate = 0;
+    int delay_us = -1;
+    int i;
+
+    for (i = 0; attr[i] != NULL && attr[i + 1] != NULL; i += 2) {
+        if (strcmp(attr[i], "usecase") == 0) {
+            usecase = platform_get_usecase_index((const char *)attr[i + 1]);
+            if (usecase < 0) {
+                ALOGE("%s: usecase %s is not defined", __func__, (char *)attr[i + 1]);
+                goto done;
+            }
+        } else if (strcmp(attr[i], "snd_device") == 0) {
+            snd_device = platform_get_snd_device_index((char *)attr[i + 1]);
+            if (snd_device < 0) {
+                ALOGE("%s: Device %s is not defined", __func__, (char *)attr[i + 1]);
+                goto done;
+            }
+        } else if (strcmp(attr[i], "sample_rate") == 0) {
+            sample_rate = atoi((char *)attr[i + 1]);
+        } else if (strcmp(attr[i], "delay_us") == 0) {
+            delay_us = atoi((char *)attr[i + 1]);
+        }
+    }
+
+    if (usecase < 0 || delay_us < 0) {
+        ALOGE("%s: 'usecase' or 'delay_us' not found", __func__);
+        goto done;
+    }
+
+    platform_set_latency_model_entry(usecase, snd_device, sample_rate, delay_us);
+
+done:
+    return;
+}
+
 static void process_config_params(const XML_Char **attr)
 {
     if (strcmp(attr[0], "key") != 0) {
@@ -1570,6 +1616,15 @@ static void start_tag(void *userdata __unused, const XML_Char *tag_name,
         } else if (strcmp(tag_name, "audio_source_delay") == 0) {
             section_process_fn fn = section_table[section];
             fn(attr);
+        } else if (strcmp(tag_name, "latency_model") == 0) {
+            section = LATENCY_MODEL;
+        } else if (strcmp(tag_name, "latency") == 0) {
+            if (section != LATENCY_MODEL) {
+                ALOGE("latency tag only supported with LATENCY_MODEL section");
+                return;
+            }
+            section_process_fn fn = section_table[section];
+            fn(attr);
 #ifdef SOFT_VOLUME
         } else if (strcmp(tag_name, "vol_params") == 0) {
             section = SOFT_VOLUME_PARAMS;
@@ -1645,6 +1700,8 @@ static void end_tag(void *userdata __unused, const XML_Char *tag_name)
         section = ROOT;
     } else if (strcmp(tag_name, "custom_mtmx_param_in_chs") == 0) {
         section = CUSTOM_MTMX_IN_PARAMS;
+    } else if (strcmp(tag_name, "latency_model") == 0) {
+        section = ROOT;
     }
 }
 
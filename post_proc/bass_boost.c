@@ -298,6 +298,25 @@ int bass_stop(effect_context_t *context, output_context_t *output)
     return 0;
 }
 
+int bass_process(effect_context_t *context, audio_buffer_t *in,
+                 audio_buffer_t *out)
+{
+    bass_context_t *bass_ctxt = (bass_context_t *)context;
+    bassboost_context_t *bassboost_ctxt = &(bass_ctxt->bassboost_ctxt);
+
+    /* PBE has no host implementation */
+    if (bass_ctxt->active_index != BASS_BOOST ||
+            !offload_bassboost_get_enable_flag(&(bassboost_ctxt->offload_bass)))
+        return host_fx_process(&context->host_io, &context->config, in, out,
+                               NULL, NULL);
+
+    host_bassboost_update(&bassboost_ctxt->host_bass,
+                          &bassboost_ctxt->offload_bass,
+                          context->config.inputCfg.samplingRate);
+    return host_fx_process(&context->host_io, &context->config, in, out,
+                           host_bassboost_process, &bassboost_ctxt->host_bass);
+}
+
 int bass_set_mode(effect_context_t *context,  int32_t hw_acc_fd)
 {
     bass_context_t *bass_ctxt = (bass_context_t *)context;
@@ -44,6 +44,8 @@ typedef struct bassboost_context_s {
     bool temp_disabled;
     uint32_t device;
     struct bass_boost_params offload_bass;
+
+    struct host_bassboost host_bass;
 } bassboost_context_t;
 
 typedef struct pbe_context_s {
@@ -86,6 +88,9 @@ int bass_start(effect_context_t *context, output_context_t *output);
 
 int bass_stop(effect_context_t *context, output_context_t *output);
 
+int bass_process(effect_context_t *context, audio_buffer_t *in,
+                 audio_buffer_t *out);
+
 
 int bassboost_get_strength(bassboost_context_t *context);
 
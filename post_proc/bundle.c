@@ -40,14 +40,19 @@
 #define LOG_TAG "offload_effect_bundle"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <stdlib.h>
 #include <cutils/list.h>
+#include <cutils/properties.h>
 #include <cutils/str_parms.h>
 #include <log/log.h>
 #include <system/thread_defs.h>
 #include <tinyalsa/asoundlib.h>
 #include <hardware/audio_effect.h>
 #include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "bundle.h"
@@ -97,17 +102,62 @@ struct listnode active_outputs_list;
  */
 pthread_mutex_t lock;
 
+/*
+ * Parameter updates sent through EFFECT_CMD_SET_PARAM are queued in
+ * effect_api and written by the commit thread OFFLOAD_PARAM_COMMIT_WINDOW_MS
+ * after the first of them was queued. Any other entry point
+ * flushes the queue first so ordering against device, volume and
+ * enable changes is preserved. Protected by lock.
+ */
+#define OFFLOAD_PARAM_COMMIT_WINDOW_MS 5
+static pthread_t commit_thread;
+static pthread_cond_t commit_cond;
+static bool commit_scheduled;
+static struct timespec commit_deadline;
+
+/*
+ * Outputs on which effects that are neither offloaded nor hw accelerated
+ * run on the host. vendor.audio.effects.host_fallback selects all outputs,
+ * "host_effects=<output>:<0|1>" overrides it per output. Protected by lock.
+ */
+#define BUNDLE_PARAMETER_HOST_EFFECTS "host_effects"
+#define HOST_FX_MAX_OUTPUTS 8
+struct host_fx_output {
+    audio_io_handle_t output;
+    bool enable;
+};
+static struct host_fx_output host_fx_outputs[HOST_FX_MAX_OUTPUTS];
+static int num_host_fx_outputs;
+static bool host_fx_default;
+
 
 /*
  *  Local functions
  */
+static void *commit_thread_loop(void *arg);
+
 static void init_once() {
+    pthread_condattr_t attr;
+
     list_init(&created_effects_list);
     list_init(&active_outputs_list);
 
     pthread_mutex_init(&lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&commit_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    host_fx_default = property_get_bool("vendor.audio.effects.host_fallback",
+                                        false);
 
     init_status = 0;
+    if (pthread_create(&commit_thread, NULL, commit_thread_loop, NULL)) {
+        ALOGE("%s: failed to create commit thread", __func__);
+        init_status = -ENOSYS;
+        return;
+    }
+    pthread_detach(commit_thread);
 }
 
 int lib_init()
@@ -204,6 +254,100 @@ bool effects_enabled()
     return false;
 }
 
+/* must be called with lock held */
+static bool host_fx_selected(audio_io_handle_t output)
+{
+    int i;
+
+    for (i = 0; i < num_host_fx_outputs; i++) {
+        if (host_fx_outputs[i].output == output)
+            return host_fx_outputs[i].enable;
+    }
+    return host_fx_default;
+}
+
+/* must be called with lock held */
+static void host_fx_select_output(audio_io_handle_t output, bool enable)
+{
+    int i;
+
+    for (i = 0; i < num_host_fx_outputs; i++) {
+        if (host_fx_outputs[i].output == output)
+            break;
+    }
+    if (i == num_host_fx_outputs) {
+        if (num_host_fx_outputs == HOST_FX_MAX_OUTPUTS) {
+            ALOGW("%s: no room to select output %d", __func__, output);
+            return;
+        }
+        num_host_fx_outputs++;
+    }
+    host_fx_outputs[i].output = output;
+    host_fx_outputs[i].enable = enable;
+    ALOGD("%s: output %d host effects %d", __func__, output, enable);
+}
+
+/* must be called with lock held */
+static bool host_fx_active(effect_context_t *context)
+{
+    return !context->offload_enabled && !context->hw_acc_enabled &&
+           host_fx_selected(context->out_handle);
+}
+
+/* must be called with lock held */
+static void commit_pending_params()
+{
+    struct listnode *node;
+
+    commit_scheduled = false;
+    if (!offload_effects_has_pending_sends())
+        return;
+
+    list_for_each(node, &active_outputs_list) {
+        output_context_t *out_ctxt = node_to_item(node,
+                                                  output_context_t,
+                                                  outputs_list_node);
+        if (out_ctxt->ctl)
+            offload_effects_commit(out_ctxt->ctl, &out_ctxt->commit_stats);
+    }
+    /* updates for a control no longer attached to an active output */
+    offload_effects_commit(NULL, NULL);
+}
+
+/* must be called with lock held */
+static void schedule_param_commit()
+{
+    if (commit_scheduled)
+        return;
+
+    /* window opens with the first queued update, bounding its latency */
+    clock_gettime(CLOCK_MONOTONIC, &commit_deadline);
+    commit_deadline.tv_nsec += OFFLOAD_PARAM_COMMIT_WINDOW_MS * 1000000L;
+    if (commit_deadline.tv_nsec >= 1000000000L) {
+        commit_deadline.tv_sec++;
+        commit_deadline.tv_nsec -= 1000000000L;
+    }
+    commit_scheduled = true;
+    pthread_cond_signal(&commit_cond);
+}
+
+static void *commit_thread_loop(void *arg __unused)
+{
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        if (!commit_scheduled) {
+            pthread_cond_wait(&commit_cond, &lock);
+            continue;
+        }
+        if (pthread_cond_timedwait(&commit_cond, &lock,
+                                   &commit_deadline) != ETIMEDOUT)
+            continue;
+        if (commit_scheduled)
+            commit_pending_params();
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
 
 /*
  * Interface from audio HAL
@@ -226,6 +370,7 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output, int pcm_id
         return init_status;
 
     pthread_mutex_lock(&lock);
+    commit_pending_params();
     if (get_output(output) != NULL) {
         ALOGW("%s output already started", __func__);
         ret = -ENOSYS;
@@ -241,6 +386,9 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output, int pcm_id
     }
     out_ctxt->handle = output;
     out_ctxt->pcm_device_id = pcm_id;
+    out_ctxt->device = AUDIO_DEVICE_NONE;
+    memset(&out_ctxt->commit_stats, 0, sizeof(out_ctxt->commit_stats));
+    memset(&out_ctxt->switch_stats, 0, sizeof(out_ctxt->switch_stats));
 
     /* populate the mixer control to send offload parameters */
     snprintf(mixer_string, sizeof(mixer_string),
@@ -264,6 +412,8 @@ int offload_effects_bundle_hal_start_output(audio_io_handle_t output, int pcm_id
             goto exit;
         }
         out_ctxt->ref_ctl = out_ctxt->ctl;
+        /* new DSP session, nothing has been sent to it yet */
+        offload_effects_reset_state(out_ctxt->ctl);
     }
 
     list_init(&out_ctxt->effects_list);
@@ -297,6 +447,7 @@ int offload_effects_bundle_hal_stop_output(audio_io_handle_t output, int pcm_id)
         return init_status;
 
     pthread_mutex_lock(&lock);
+    commit_pending_params();
 
     out_ctxt = get_output(output);
     if (out_ctxt == NULL) {
@@ -313,6 +464,14 @@ int offload_effects_bundle_hal_stop_output(audio_io_handle_t output, int pcm_id)
             fx_ctxt->ops.stop(fx_ctxt, out_ctxt);
     }
 
+    ALOGD("%s: output %d param commits %u writes %u bytes %u", __func__,
+          output, out_ctxt->commit_stats.commits,
+          out_ctxt->commit_stats.writes, out_ctxt->commit_stats.bytes);
+    ALOGD("%s: output %d device switches %u cmds requested %u sent %u bytes %u",
+          __func__, output, out_ctxt->switch_stats.switches,
+          out_ctxt->switch_stats.cmds_requested,
+          out_ctxt->switch_stats.cmds_sent, out_ctxt->switch_stats.bytes);
+    offload_effects_reset_state(out_ctxt->ref_ctl);
     list_remove(&out_ctxt->outputs_list_node);
 
 #ifdef DTS_EAGLE
@@ -338,6 +497,7 @@ int offload_effects_bundle_set_hpx_state(bool hpx_state)
         return init_status;
 
     pthread_mutex_lock(&lock);
+    commit_pending_params();
 
     if (hpx_state) {
         /* set ramp down */
@@ -461,8 +621,26 @@ void offload_effects_bundle_get_parameters(struct str_parms *query __unused,
 }
 
 __attribute__ ((visibility ("default")))
-void offload_effects_bundle_set_parameters(struct str_parms *parms __unused)
+void offload_effects_bundle_set_parameters(struct str_parms *parms)
 {
+    char value[32];
+    int output, enable;
+
+    if (lib_init() != 0)
+        return;
+
+    if (str_parms_get_str(parms, BUNDLE_PARAMETER_HOST_EFFECTS, value,
+                          sizeof(value)) < 0)
+        return;
+    if (sscanf(value, "%d:%d", &output, &enable) != 2) {
+        ALOGW("%s: invalid %s value %s", __func__,
+              BUNDLE_PARAMETER_HOST_EFFECTS, value);
+        return;
+    }
+
+    pthread_mutex_lock(&lock);
+    host_fx_select_output((audio_io_handle_t)output, enable != 0);
+    pthread_mutex_unlock(&lock);
 }
 
 /*
@@ -528,6 +706,7 @@ int effect_lib_create(const effect_uuid_t *uuid,
         context->ops.disable = equalizer_disable;
         context->ops.start = equalizer_start;
         context->ops.stop = equalizer_stop;
+        context->ops.process = equalizer_process;
 
         context->desc = &equalizer_descriptor;
         eq_ctxt->ctl = NULL;
@@ -549,6 +728,7 @@ int effect_lib_create(const effect_uuid_t *uuid,
         context->ops.disable = bass_disable;
         context->ops.start = bass_start;
         context->ops.stop = bass_stop;
+        context->ops.process = bass_process;
 
         context->desc = &bassboost_descriptor;
         bass_ctxt->bassboost_ctxt.ctl = NULL;
@@ -571,6 +751,7 @@ int effect_lib_create(const effect_uuid_t *uuid,
         context->ops.disable = virtualizer_disable;
         context->ops.start = virtualizer_start;
         context->ops.stop = virtualizer_stop;
+        context->ops.process = virtualizer_process;
 
         context->desc = &virtualizer_descriptor;
         virt_ctxt->ctl = NULL;
@@ -598,6 +779,8 @@ int effect_lib_create(const effect_uuid_t *uuid,
         context->ops.disable = reverb_disable;
         context->ops.start = reverb_start;
         context->ops.stop = reverb_stop;
+        context->ops.process = reverb_process;
+        context->ops.release = reverb_release;
 
         if (memcmp(uuid, &aux_env_reverb_descriptor.uuid,
                    sizeof(effect_uuid_t)) == 0) {
@@ -659,6 +842,7 @@ int effect_lib_release(effect_handle_t handle)
 
     ALOGV("%s context %p", __func__, handle);
     pthread_mutex_lock(&lock);
+    commit_pending_params();
     status = -EINVAL;
     if (effect_exists(context)) {
         output_context_t *out_ctxt = get_output(context->out_handle);
@@ -667,6 +851,7 @@ int effect_lib_release(effect_handle_t handle)
         list_remove(&context->effects_list_node);
         if (context->ops.release)
             context->ops.release(context);
+        host_fx_release(&context->host_io, context->desc->name);
         free(context);
         status = 0;
     }
@@ -706,8 +891,8 @@ int effect_lib_get_descriptor(const effect_uuid_t *uuid,
 /* Stub function for effect interface: never called for offloaded effects */
 /* called for hw accelerated effects */
 int effect_process(effect_handle_t self,
-                       audio_buffer_t *inBuffer __unused,
-                       audio_buffer_t *outBuffer __unused)
+                       audio_buffer_t *inBuffer,
+                       audio_buffer_t *outBuffer)
 {
     effect_context_t * context = (effect_context_t *)self;
     int status = 0;
@@ -725,7 +910,8 @@ int effect_process(effect_handle_t self,
         goto exit;
     }
 
-    if (context->ops.process)
+    /* offloaded and hw accelerated effects are applied outside */
+    if (context->ops.process && host_fx_active(context))
         status = context->ops.process(context, inBuffer, outBuffer);
 exit:
     pthread_mutex_unlock(&lock);
@@ -752,6 +938,9 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         goto exit;
     }
 
+    if (cmdCode != EFFECT_CMD_SET_PARAM)
+        commit_pending_params();
+
     switch (cmdCode) {
     case EFFECT_CMD_INIT:
         if (pReplyData == NULL || *replySize != sizeof(int)) {
@@ -777,7 +966,8 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             status = -EINVAL;
             goto exit;
         }
-        if (!context->offload_enabled && !context->hw_acc_enabled) {
+        if (!context->offload_enabled && !context->hw_acc_enabled &&
+                !host_fx_selected(context->out_handle)) {
             status = -EINVAL;
             goto exit;
         }
@@ -829,7 +1019,8 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
                   cmdSize, *replySize);
             goto exit;
         }
-        if (!context->offload_enabled && !context->hw_acc_enabled) {
+        if (!context->offload_enabled && !context->hw_acc_enabled &&
+                !host_fx_selected(context->out_handle)) {
             status = -EINVAL;
             goto exit;
         }
@@ -851,9 +1042,14 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         }
         *(int32_t *)pReplyData = 0;
         effect_param_t *p = (effect_param_t *)pCmdData;
-        if (context->ops.set_parameter)
+        if (context->ops.set_parameter) {
+            offload_effects_defer_sends(true);
             *(int32_t *)pReplyData = context->ops.set_parameter(context, p,
                                                                 *replySize);
+            offload_effects_defer_sends(false);
+            if (offload_effects_has_pending_sends())
+                schedule_param_commit();
+        }
 
         } break;
     case EFFECT_CMD_SET_DEVICE: {
@@ -865,8 +1061,26 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
             goto exit;
         }
         device = *(uint32_t *)pCmdData;
-        if (context->ops.set_device)
+        if (context->ops.set_device) {
+            struct offload_write_counters before, after;
+            output_context_t *out_ctxt = get_output(context->out_handle);
+
+            offload_effects_get_write_counters(&before);
             context->ops.set_device(context, device);
+            offload_effects_get_write_counters(&after);
+            if (out_ctxt != NULL) {
+                if (out_ctxt->device != device) {
+                    out_ctxt->device = device;
+                    out_ctxt->switch_stats.switches++;
+                }
+                out_ctxt->switch_stats.cmds_requested +=
+                        after.cmds_requested - before.cmds_requested;
+                out_ctxt->switch_stats.cmds_sent +=
+                        (after.cmds_requested - before.cmds_requested) -
+                        (after.cmds_skipped - before.cmds_skipped);
+                out_ctxt->switch_stats.bytes += after.bytes - before.bytes;
+            }
+        }
         } break;
     case EFFECT_CMD_SET_VOLUME: {
         // if pReplyData is NULL, VOL_CTRL is delegated to another effect
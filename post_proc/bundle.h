@@ -23,6 +23,7 @@
 #include <tinyalsa/asoundlib.h>
 #include <sound/audio_effects.h>
 #include "effect_api.h"
+#include "host_effects.h"
 
 /* Retry for delay for mixer open */
 #define RETRY_NUMBER 10
@@ -36,6 +37,14 @@ typedef struct output_context_s output_context_t;
 typedef struct effect_ops_s effect_ops_t;
 typedef struct effect_context_s effect_context_t;
 
+/* offload traffic caused by EFFECT_CMD_SET_DEVICE */
+struct offload_device_switch_stats {
+    uint32_t switches;
+    uint32_t cmds_requested;
+    uint32_t cmds_sent;
+    uint32_t bytes;
+};
+
 struct output_context_s {
     /* node in active_outputs_list */
     struct listnode outputs_list_node;
@@ -48,6 +57,11 @@ struct output_context_s {
     struct mixer *mixer;
     struct mixer_ctl *ctl;
     struct mixer_ctl *ref_ctl;
+    /* coalesced parameter writes issued on ctl */
+    struct offload_commit_stats commit_stats;
+    /* last device set on the effects of this output */
+    uint32_t device;
+    struct offload_device_switch_stats switch_stats;
 };
 
 /* effect specific operations.
@@ -85,6 +99,8 @@ struct effect_context_s {
     bool offload_enabled;
     bool hw_acc_enabled;
     effect_ops_t ops;
+    /* used when the effect runs on the host, see host_effects.h */
+    struct host_fx_io host_io;
 };
 
 int set_config(effect_context_t *context, effect_config_t *config);
@@ -63,7 +63,9 @@
 #include <linux/msm_audio.h>
 #include <errno.h>
 #include <unistd.h>
+#include <stddef.h>
 #include <stdio.h>
+#include <string.h>
 #include "effect_api.h"
 
 #ifdef DTS_EAGLE
@@ -188,6 +190,287 @@ static inline long get_config_set_param()
     return config_param;
 }
 
+/*
+ * Each "Audio Effects Config" write carries a single module, so coalescing
+ * can only happen per module: repeated updates of the same effect within a
+ * commit window are folded into one write carrying the union of their
+ * flags and the latest parameter values.
+ */
+#define OFFLOAD_MAX_PENDING_SENDS 16
+
+union offload_effect_params {
+    struct bass_boost_params bassboost;
+    struct pbe_params pbe;
+    struct virtualizer_params virtualizer;
+    struct eq_params eq;
+    struct reverb_params reverb;
+};
+
+struct offload_pending_send {
+    struct mixer_ctl *ctl;
+    const void *owner;
+    long module;
+    unsigned flags;
+    union offload_effect_params params;
+};
+
+static struct offload_pending_send pending_sends[OFFLOAD_MAX_PENDING_SENDS];
+static int num_pending_sends;
+static bool sends_deferred;
+static uint32_t total_writes;
+static uint32_t total_write_bytes;
+
+static void offload_write_params(struct mixer_ctl *ctl, long *param_values,
+                                 long *p_param_values)
+{
+    unsigned int num_values = p_param_values - param_values;
+
+    /* the control zero-fills the unused tail, only copy the used part */
+    mixer_ctl_set_array(ctl, param_values, num_values);
+    total_writes++;
+    total_write_bytes += num_values * sizeof(long);
+}
+
+static bool offload_defer_send(struct mixer_ctl *ctl, long module,
+                               const void *params, size_t size,
+                               unsigned flags)
+{
+    struct offload_pending_send *send = NULL;
+    int i;
+
+    if (!sends_deferred || !ctl || !flags)
+        return false;
+
+    for (i = 0; i < num_pending_sends; i++) {
+        if (pending_sends[i].ctl == ctl && pending_sends[i].owner == params &&
+                pending_sends[i].module == module) {
+            send = &pending_sends[i];
+            break;
+        }
+    }
+    if (!send) {
+        if (num_pending_sends == OFFLOAD_MAX_PENDING_SENDS)
+            offload_effects_commit(NULL, NULL);
+        send = &pending_sends[num_pending_sends++];
+        send->ctl = ctl;
+        send->owner = params;
+        send->module = module;
+        send->flags = 0;
+    }
+    /* preset and custom bands both program EQ_CONFIG, the latest one wins */
+    if ((module == EQ_MODULE) &&
+            (flags & (OFFLOAD_SEND_EQ_PRESET | OFFLOAD_SEND_EQ_BANDS_LEVEL)))
+        send->flags &= ~(OFFLOAD_SEND_EQ_PRESET | OFFLOAD_SEND_EQ_BANDS_LEVEL);
+    send->flags |= flags;
+    memcpy(&send->params, params, size);
+    ALOGV("%s: module 0x%lx flags 0x%x pending %d", __func__, module,
+          send->flags, num_pending_sends);
+
+    return true;
+}
+
+/*
+ * Last values written to the DSP per (control, module). The kernel keeps a
+ * single state per session whatever the device carried in the write
+ * header, so a send only needs the commands whose values differ from what
+ * the session already holds; anything else, including most of what is
+ * re-sent on device switches, is dropped here.
+ */
+#define OFFLOAD_MAX_COMMITTED_STATES 16
+
+struct offload_param_field {
+    unsigned flag;
+    size_t offset;
+    size_t size;
+};
+
+#define PARAM_FIELD(flag, type, member) \
+    { flag, offsetof(type, member), sizeof(((type *)0)->member) }
+
+static const struct offload_param_field bassboost_fields[] = {
+    PARAM_FIELD(OFFLOAD_SEND_BASSBOOST_ENABLE_FLAG, struct bass_boost_params,
+                enable_flag),
+    PARAM_FIELD(OFFLOAD_SEND_BASSBOOST_STRENGTH, struct bass_boost_params,
+                strength),
+    PARAM_FIELD(OFFLOAD_SEND_BASSBOOST_MODE, struct bass_boost_params, mode),
+};
+
+static const struct offload_param_field pbe_fields[] = {
+    PARAM_FIELD(OFFLOAD_SEND_PBE_ENABLE_FLAG, struct pbe_params, enable_flag),
+    PARAM_FIELD(OFFLOAD_SEND_PBE_CONFIG, struct pbe_params, cfg_len),
+    PARAM_FIELD(OFFLOAD_SEND_PBE_CONFIG, struct pbe_params, config),
+};
+
+static const struct offload_param_field virtualizer_fields[] = {
+    PARAM_FIELD(OFFLOAD_SEND_VIRTUALIZER_ENABLE_FLAG,
+                struct virtualizer_params, enable_flag),
+    PARAM_FIELD(OFFLOAD_SEND_VIRTUALIZER_STRENGTH,
+                struct virtualizer_params, strength),
+    PARAM_FIELD(OFFLOAD_SEND_VIRTUALIZER_OUT_TYPE,
+                struct virtualizer_params, out_type),
+    PARAM_FIELD(OFFLOAD_SEND_VIRTUALIZER_GAIN_ADJUST,
+                struct virtualizer_params, gain_adjust),
+};
+
+static const struct offload_param_field eq_fields[] = {
+    PARAM_FIELD(OFFLOAD_SEND_EQ_ENABLE_FLAG, struct eq_params, enable_flag),
+    PARAM_FIELD(OFFLOAD_SEND_EQ_PRESET, struct eq_params, config),
+    PARAM_FIELD(OFFLOAD_SEND_EQ_BANDS_LEVEL, struct eq_params, config),
+    PARAM_FIELD(OFFLOAD_SEND_EQ_BANDS_LEVEL, struct eq_params, per_band_cfg),
+};
+
+static const struct offload_param_field reverb_fields[] = {
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_ENABLE_FLAG, struct reverb_params,
+                enable_flag),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_MODE, struct reverb_params, mode),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_PRESET, struct reverb_params, preset),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_WET_MIX, struct reverb_params, wet_mix),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_GAIN_ADJUST, struct reverb_params,
+                gain_adjust),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_ROOM_LEVEL, struct reverb_params,
+                room_level),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_ROOM_HF_LEVEL, struct reverb_params,
+                room_hf_level),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_DECAY_TIME, struct reverb_params,
+                decay_time),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_DECAY_HF_RATIO, struct reverb_params,
+                decay_hf_ratio),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_REFLECTIONS_LEVEL, struct reverb_params,
+                reflections_level),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_REFLECTIONS_DELAY, struct reverb_params,
+                reflections_delay),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_LEVEL, struct reverb_params, level),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_DELAY, struct reverb_params, delay),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_DIFFUSION, struct reverb_params,
+                diffusion),
+    PARAM_FIELD(OFFLOAD_SEND_REVERB_DENSITY, struct reverb_params, density),
+};
+
+struct offload_module_fields {
+    long module;
+    const struct offload_param_field *fields;
+    size_t num_fields;
+};
+
+static const struct offload_module_fields module_fields[] = {
+    { BASS_BOOST_MODULE, bassboost_fields, ARRAY_SIZE(bassboost_fields) },
+    { PBE_MODULE, pbe_fields, ARRAY_SIZE(pbe_fields) },
+    { VIRTUALIZER_MODULE, virtualizer_fields, ARRAY_SIZE(virtualizer_fields) },
+    { EQ_MODULE, eq_fields, ARRAY_SIZE(eq_fields) },
+    { REVERB_MODULE, reverb_fields, ARRAY_SIZE(reverb_fields) },
+};
+
+struct offload_committed_state {
+    struct mixer_ctl *ctl;
+    long module;
+    /* flags whose fields in params match the DSP */
+    unsigned valid_flags;
+    union offload_effect_params params;
+};
+
+static struct offload_committed_state
+                    committed_states[OFFLOAD_MAX_COMMITTED_STATES];
+static uint32_t total_cmds_requested;
+static uint32_t total_cmds_skipped;
+
+static const struct offload_module_fields *offload_get_module_fields(long module)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(module_fields); i++) {
+        if (module_fields[i].module == module)
+            return &module_fields[i];
+    }
+    return NULL;
+}
+
+static struct offload_committed_state *offload_get_committed_state(
+                                                        struct mixer_ctl *ctl,
+                                                        long module,
+                                                        bool create)
+{
+    struct offload_committed_state *free_state = NULL;
+    int i;
+
+    for (i = 0; i < OFFLOAD_MAX_COMMITTED_STATES; i++) {
+        if (committed_states[i].ctl == ctl &&
+                committed_states[i].module == module)
+            return &committed_states[i];
+        if (!free_state && !committed_states[i].ctl)
+            free_state = &committed_states[i];
+    }
+    /* when full, sends for this module simply go out unfiltered */
+    if (!create || !free_state)
+        return NULL;
+
+    free_state->ctl = ctl;
+    free_state->module = module;
+    free_state->valid_flags = 0;
+    return free_state;
+}
+
+static unsigned offload_filter_sends(struct mixer_ctl *ctl, long module,
+                                     const void *params, unsigned flags)
+{
+    const struct offload_module_fields *mf;
+    struct offload_committed_state *state;
+    unsigned unchanged;
+    size_t i;
+
+    if (!ctl || !flags)
+        return flags;
+
+    total_cmds_requested += __builtin_popcount(flags);
+    mf = offload_get_module_fields(module);
+    state = offload_get_committed_state(ctl, module, false);
+    if (!mf || !state)
+        return flags;
+
+    unchanged = flags & state->valid_flags;
+    for (i = 0; i < mf->num_fields && unchanged; i++) {
+        const struct offload_param_field *field = &mf->fields[i];
+
+        if ((unchanged & field->flag) &&
+                memcmp((const char *)params + field->offset,
+                       (const char *)&state->params + field->offset,
+                       field->size))
+            unchanged &= ~field->flag;
+    }
+    if (unchanged) {
+        total_cmds_skipped += __builtin_popcount(unchanged);
+        ALOGV("%s: module 0x%lx skipping unchanged flags 0x%x", __func__,
+              module, unchanged);
+    }
+
+    return flags & ~unchanged;
+}
+
+static void offload_update_committed_state(struct mixer_ctl *ctl, long module,
+                                           const void *params, unsigned flags)
+{
+    const struct offload_module_fields *mf;
+    struct offload_committed_state *state;
+    size_t i;
+
+    mf = offload_get_module_fields(module);
+    state = offload_get_committed_state(ctl, module, true);
+    if (!mf || !state)
+        return;
+
+    for (i = 0; i < mf->num_fields; i++) {
+        const struct offload_param_field *field = &mf->fields[i];
+
+        if (flags & field->flag)
+            memcpy((char *)&state->params + field->offset,
+                   (const char *)params + field->offset, field->size);
+    }
+    /* preset and custom bands both program EQ_CONFIG */
+    if (module == EQ_MODULE)
+        state->valid_flags &= ~(OFFLOAD_SEND_EQ_PRESET |
+                                OFFLOAD_SEND_EQ_BANDS_LEVEL);
+    state->valid_flags |= flags;
+}
+
 static int bassboost_send_params(eff_mode_t mode, void *ctl,
                                   struct bass_boost_params *bassboost,
                                  unsigned param_send_flags)
@@ -196,6 +479,12 @@ static int bassboost_send_params(eff_mode_t mode, void *ctl,
     long *p_param_values = param_values;
 
     ALOGV("%s: flags 0x%x", __func__, param_send_flags);
+    if (mode == OFFLOAD) {
+        param_send_flags = offload_filter_sends((struct mixer_ctl *)ctl, BASS_BOOST_MODULE,
+                                                bassboost, param_send_flags);
+        if (!param_send_flags)
+            return 0;
+    }
     *p_param_values++ = BASS_BOOST_MODULE;
     *p_param_values++ = bassboost->device;
     *p_param_values++ = 0; /* num of commands*/
@@ -225,8 +514,10 @@ static int bassboost_send_params(eff_mode_t mode, void *ctl,
     }
 
     if ((mode == OFFLOAD) && param_values[2] && ctl) {
-        mixer_ctl_set_array((struct mixer_ctl *)ctl, param_values,
-                            ARRAY_SIZE(param_values));
+        offload_write_params((struct mixer_ctl *)ctl, param_values,
+                             p_param_values);
+        offload_update_committed_state((struct mixer_ctl *)ctl, BASS_BOOST_MODULE,
+                                       bassboost, param_send_flags);
     } else if ((mode == HW_ACCELERATOR) && param_values[2] &&
                ctl && *(int *)ctl) {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
@@ -240,6 +531,10 @@ int offload_bassboost_send_params(struct mixer_ctl *ctl,
                                   struct bass_boost_params *bassboost,
                                   unsigned param_send_flags)
 {
+    if (offload_defer_send(ctl, BASS_BOOST_MODULE, bassboost,
+                           sizeof(*bassboost), param_send_flags))
+        return 0;
+
     return bassboost_send_params(OFFLOAD, (void *)ctl, bassboost,
                                  param_send_flags);
 }
@@ -283,6 +578,12 @@ static int pbe_send_params(eff_mode_t mode, void *ctl,
     uint32_t bsf_len = 0, tsf_len = 0, total_coeffs_len = 0;
 
     ALOGV("%s: enabled=%d", __func__, pbe->enable_flag);
+    if (mode == OFFLOAD) {
+        param_send_flags = offload_filter_sends((struct mixer_ctl *)ctl, PBE_MODULE,
+                                                pbe, param_send_flags);
+        if (!param_send_flags)
+            return 0;
+    }
     *p_param_values++ = PBE_MODULE;
     *p_param_values++ = pbe->device;
     *p_param_values++ = 0; /* num of commands*/
@@ -339,8 +640,10 @@ static int pbe_send_params(eff_mode_t mode, void *ctl,
     }
 
     if ((mode == OFFLOAD) && param_values[2] && ctl) {
-        mixer_ctl_set_array((struct mixer_ctl *)ctl, param_values,
-                            ARRAY_SIZE(param_values));
+        offload_write_params((struct mixer_ctl *)ctl, param_values,
+                             p_param_values);
+        offload_update_committed_state((struct mixer_ctl *)ctl, PBE_MODULE,
+                                       pbe, param_send_flags);
     } else if ((mode == HW_ACCELERATOR) && param_values[2] &&
                ctl && *(int *)ctl) {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
@@ -354,6 +657,10 @@ int offload_pbe_send_params(struct mixer_ctl *ctl,
                                   struct pbe_params *pbe,
                                   unsigned param_send_flags)
 {
+    if (offload_defer_send(ctl, PBE_MODULE, pbe, sizeof(*pbe),
+                           param_send_flags))
+        return 0;
+
     return pbe_send_params(OFFLOAD, (void *)ctl, pbe,
                                  param_send_flags);
 }
@@ -422,6 +729,12 @@ static int virtualizer_send_params(eff_mode_t mode, void *ctl,
     long *p_param_values = param_values;
 
     ALOGV("%s: flags 0x%x", __func__, param_send_flags);
+    if (mode == OFFLOAD) {
+        param_send_flags = offload_filter_sends((struct mixer_ctl *)ctl, VIRTUALIZER_MODULE,
+                                                virtualizer, param_send_flags);
+        if (!param_send_flags)
+            return 0;
+    }
     *p_param_values++ = VIRTUALIZER_MODULE;
     *p_param_values++ = virtualizer->device;
     *p_param_values++ = 0; /* num of commands*/
@@ -459,8 +772,10 @@ static int virtualizer_send_params(eff_mode_t mode, void *ctl,
     }
 
     if ((mode == OFFLOAD) && param_values[2] && ctl) {
-        mixer_ctl_set_array((struct mixer_ctl *)ctl, param_values,
-                            ARRAY_SIZE(param_values));
+        offload_write_params((struct mixer_ctl *)ctl, param_values,
+                             p_param_values);
+        offload_update_committed_state((struct mixer_ctl *)ctl, VIRTUALIZER_MODULE,
+                                       virtualizer, param_send_flags);
     } else if ((mode == HW_ACCELERATOR) && param_values[2] &&
                ctl && *(int *)ctl) {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
@@ -474,6 +789,10 @@ int offload_virtualizer_send_params(struct mixer_ctl *ctl,
                                     struct virtualizer_params *virtualizer,
                                     unsigned param_send_flags)
 {
+    if (offload_defer_send(ctl, VIRTUALIZER_MODULE, virtualizer,
+                           sizeof(*virtualizer), param_send_flags))
+        return 0;
+
     return virtualizer_send_params(OFFLOAD, (void *)ctl, virtualizer,
                                    param_send_flags);
 }
@@ -548,6 +867,13 @@ static int eq_send_params(eff_mode_t mode, void *ctl, struct eq_params *eq,
         ALOGV("No Valid preset to set");
         return 0;
     }
+    if (mode == OFFLOAD) {
+        param_send_flags = offload_filter_sends((struct mixer_ctl *)ctl,
+                                                EQ_MODULE, eq,
+                                                param_send_flags);
+        if (!param_send_flags)
+            return 0;
+    }
     *p_param_values++ = EQ_MODULE;
     *p_param_values++ = eq->device;
     *p_param_values++ = 0; /* num of commands*/
@@ -590,8 +916,10 @@ static int eq_send_params(eff_mode_t mode, void *ctl, struct eq_params *eq,
     }
 
     if ((mode == OFFLOAD) && param_values[2] && ctl) {
-        mixer_ctl_set_array((struct mixer_ctl *)ctl, param_values,
-                            ARRAY_SIZE(param_values));
+        offload_write_params((struct mixer_ctl *)ctl, param_values,
+                             p_param_values);
+        offload_update_committed_state((struct mixer_ctl *)ctl, EQ_MODULE,
+                                       eq, param_send_flags);
     } else if ((mode == HW_ACCELERATOR) && param_values[2] &&
                ctl && *(int *)ctl) {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
@@ -604,6 +932,10 @@ static int eq_send_params(eff_mode_t mode, void *ctl, struct eq_params *eq,
 int offload_eq_send_params(struct mixer_ctl *ctl, struct eq_params *eq,
                            unsigned param_send_flags)
 {
+    if (offload_defer_send(ctl, EQ_MODULE, eq, sizeof(*eq),
+                           param_send_flags))
+        return 0;
+
     return eq_send_params(OFFLOAD, (void *)ctl, eq, param_send_flags);
 }
 
@@ -731,6 +1063,12 @@ static int reverb_send_params(eff_mode_t mode, void *ctl,
     long *p_param_values = param_values;
 
     ALOGV("%s: flags 0x%x", __func__, param_send_flags);
+    if (mode == OFFLOAD) {
+        param_send_flags = offload_filter_sends((struct mixer_ctl *)ctl, REVERB_MODULE,
+                                                reverb, param_send_flags);
+        if (!param_send_flags)
+            return 0;
+    }
     *p_param_values++ = REVERB_MODULE;
     *p_param_values++ = reverb->device;
     *p_param_values++ = 0; /* num of commands*/
@@ -857,8 +1195,10 @@ static int reverb_send_params(eff_mode_t mode, void *ctl,
     }
 
     if ((mode == OFFLOAD) && param_values[2] && ctl) {
-        mixer_ctl_set_array((struct mixer_ctl *)ctl, param_values,
-                            ARRAY_SIZE(param_values));
+        offload_write_params((struct mixer_ctl *)ctl, param_values,
+                             p_param_values);
+        offload_update_committed_state((struct mixer_ctl *)ctl, REVERB_MODULE,
+                                       reverb, param_send_flags);
     } else if ((mode == HW_ACCELERATOR) && param_values[2] &&
                ctl && *(int *)ctl) {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
@@ -872,6 +1212,10 @@ int offload_reverb_send_params(struct mixer_ctl *ctl,
                                struct reverb_params *reverb,
                                unsigned param_send_flags)
 {
+    if (offload_defer_send(ctl, REVERB_MODULE, reverb, sizeof(*reverb),
+                           param_send_flags))
+        return 0;
+
     return reverb_send_params(OFFLOAD, (void *)ctl, reverb,
                               param_send_flags);
 }
@@ -941,7 +1285,7 @@ int offload_soft_volume_send_params(struct mixer_ctl *ctl,
     }
 
     if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+        offload_write_params(ctl, param_values, p_param_values);
 
     return 0;
 }
@@ -1006,7 +1350,7 @@ int offload_transition_soft_volume_send_params(struct mixer_ctl *ctl,
     }
 
     if (param_values[2] && ctl)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+        offload_write_params(ctl, param_values, p_param_values);
 
     return 0;
 }
@@ -1032,7 +1376,7 @@ static int hpx_send_params(eff_mode_t mode, void *ctl,
     }
 
     if (mode == OFFLOAD)
-        mixer_ctl_set_array(ctl, param_values, ARRAY_SIZE(param_values));
+        offload_write_params(ctl, param_values, p_param_values);
     else {
         if (ioctl(*(int *)ctl, AUDIO_EFFECTS_SET_PP_PARAMS, param_values) < 0)
             ALOGE("%s: sending h/w acc hpx state params fail[%d]", __func__, errno);
@@ -1049,3 +1393,81 @@ int hw_acc_hpx_send_params(int fd, unsigned param_send_flags)
 {
     return hpx_send_params(HW_ACCELERATOR, (void *)&fd, param_send_flags);
 }
+
+void offload_effects_defer_sends(bool defer)
+{
+    sends_deferred = defer;
+}
+
+bool offload_effects_has_pending_sends()
+{
+    return num_pending_sends > 0;
+}
+
+void offload_effects_commit(struct mixer_ctl *ctl,
+                            struct offload_commit_stats *stats)
+{
+    struct offload_pending_send send;
+    uint32_t writes = total_writes;
+    uint32_t bytes = total_write_bytes;
+    int i = 0, j;
+
+    while (i < num_pending_sends) {
+        if (ctl && pending_sends[i].ctl != ctl) {
+            i++;
+            continue;
+        }
+        send = pending_sends[i];
+        for (j = i + 1; j < num_pending_sends; j++)
+            pending_sends[j - 1] = pending_sends[j];
+        num_pending_sends--;
+
+        switch (send.module) {
+        case BASS_BOOST_MODULE:
+            bassboost_send_params(OFFLOAD, send.ctl, &send.params.bassboost,
+                                  send.flags);
+            break;
+        case PBE_MODULE:
+            pbe_send_params(OFFLOAD, send.ctl, &send.params.pbe, send.flags);
+            break;
+        case VIRTUALIZER_MODULE:
+            virtualizer_send_params(OFFLOAD, send.ctl,
+                                    &send.params.virtualizer, send.flags);
+            break;
+        case EQ_MODULE:
+            eq_send_params(OFFLOAD, send.ctl, &send.params.eq, send.flags);
+            break;
+        case REVERB_MODULE:
+            reverb_send_params(OFFLOAD, send.ctl, &send.params.reverb,
+                               send.flags);
+            break;
+        default:
+            ALOGE("%s: unknown module 0x%lx", __func__, send.module);
+            break;
+        }
+    }
+
+    if (stats && (total_writes != writes)) {
+        stats->commits++;
+        stats->writes += total_writes - writes;
+        stats->bytes += total_write_bytes - bytes;
+    }
+}
+
+void offload_effects_reset_state(struct mixer_ctl *ctl)
+{
+    int i;
+
+    for (i = 0; i < OFFLOAD_MAX_COMMITTED_STATES; i++) {
+        if (committed_states[i].ctl == ctl)
+            memset(&committed_states[i], 0, sizeof(committed_states[i]));
+    }
+}
+
+void offload_effects_get_write_counters(struct offload_write_counters *counters)
+{
+    counters->writes = total_writes;
+    counters->bytes = total_write_bytes;
+    counters->cmds_requested = total_cmds_requested;
+    counters->cmds_skipped = total_cmds_skipped;
+}
@@ -39,6 +39,36 @@ int offload_update_mixer_and_effects_ctl(int card, int device_id,
                                          struct mixer_ctl **ctl);
 void offload_close_mixer(struct mixer **mixer);
 
+/*
+ * While deferral is on, offload_*_send_params() for bassboost, pbe,
+ * virtualizer, eq and reverb only queue their update; updates of the same
+ * effect are merged and written by offload_effects_commit(). Callers must
+ * serialize these with all other offload send calls.
+ */
+struct offload_commit_stats {
+    uint32_t commits;
+    uint32_t writes;
+    uint32_t bytes;
+};
+void offload_effects_defer_sends(bool defer);
+bool offload_effects_has_pending_sends();
+/* ctl NULL commits every pending update */
+void offload_effects_commit(struct mixer_ctl *ctl,
+                            struct offload_commit_stats *stats);
+
+/*
+ * Offload sends skip commands whose values the DSP session on ctl already
+ * holds. Reset when the session on ctl is (re)started.
+ */
+struct offload_write_counters {
+    uint32_t writes;
+    uint32_t bytes;
+    uint32_t cmds_requested;
+    uint32_t cmds_skipped;
+};
+void offload_effects_reset_state(struct mixer_ctl *ctl);
+void offload_effects_get_write_counters(struct offload_write_counters *counters);
+
 
 #define OFFLOAD_SEND_PBE_ENABLE_FLAG      (1 << 0)
 #define OFFLOAD_SEND_PBE_CONFIG           (OFFLOAD_SEND_PBE_ENABLE_FLAG << 1)
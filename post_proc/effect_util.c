@@ -21,6 +21,10 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <cutils/atomic.h>
 
 #ifdef LOG_TAG
 #undef LOG_TAG
@@ -35,7 +39,8 @@ enum {
     BASSBOOST,
 };
 
-static const char *paramList[10] = {
+#ifdef DTS_EAGLE
+static const char *paramList[EFFECT_STATE_NUM_PARAMS] = {
                               "eq_enable",
                               "virt_enable",
                               "bb_enable",
@@ -49,166 +54,287 @@ static const char *paramList[10] = {
 };
 
 #define EFFECT_FILE "/data/misc/dts/effect"
+#define EFFECT_STATE_FILE "/data/misc/dts/effect_state"
 #define MAX_LENGTH_OF_INTEGER_IN_STRING 13
+#define MAX_EFFECT_STATE_NODES 4
 
-#ifdef DTS_EAGLE
-void create_effect_state_node(int device_id)
+/*
+ * One mapped state block per device. Updates are a store into the block
+ * bracketed by sequence increments. The legacy text node is still rendered
+ * for older consumers unless vendor.audio.dts_eagle.text_state is false.
+ */
+struct effect_state_node {
+    int device_id;
+    struct effect_state_block *block;
+    bool text_state;
+    uint32_t updates;
+    uint64_t update_ns;
+};
+
+static struct effect_state_node state_nodes[MAX_EFFECT_STATE_NODES];
+static pthread_mutex_t state_nodes_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool dts_eagle_enabled()
 {
     char prop[PROPERTY_VALUE_MAX];
-    int fd;
-    char buf[1024];
-    char path[PATH_MAX];
-    char value[MAX_LENGTH_OF_INTEGER_IN_STRING];
 
     property_get("vendor.audio.use.dts_eagle", prop, "0");
-    if (!strncmp("true", prop, sizeof("true")) || atoi(prop)) {
-        ALOGV("create_effect_node for - device_id: %d", device_id);
-        strlcpy(path, EFFECT_FILE, sizeof(path));
-        snprintf(value, sizeof(value), "%d", device_id);
-        strlcat(path, value, sizeof(path));
-        if ((fd=open(path, O_RDONLY)) < 0) {
-            ALOGV("No File exist");
-        } else {
-            ALOGV("A file with the same name exist. So, not creating again");
-            return;
-        }
-        if ((fd=creat(path, S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) < 0) {
-            ALOGE("opening effect state node failed returned");
-            return;
-        }
-        chmod(path, S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH);
-        snprintf(buf, sizeof(buf), "eq_enable=%d;virt_enable=%d;bb_enable=%d;eq_param_level0=%d;eq_param_level1=%d;eq_param_level2=%d;eq_param_level3=%d;eq_param_level4=%d;virt_param_strength=%d;bassboost_param_strength=%d", 0,0,0,0,0,0,0,0,0,0);
-        int n = write(fd, buf, strlen(buf));
-        ALOGV("number of bytes written: %d", n);
-        close(fd);
+    return !strncmp("true", prop, sizeof("true")) || atoi(prop);
+}
+
+static void get_node_path(const char *base, int device_id, char *path,
+                          size_t size)
+{
+    char value[MAX_LENGTH_OF_INTEGER_IN_STRING];
+
+    strlcpy(path, base, size);
+    snprintf(value, sizeof(value), "%d", device_id);
+    strlcat(path, value, size);
+}
+
+static int64_t effect_util_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* must be called with state_nodes_lock held */
+static struct effect_state_node *get_state_node(int device_id)
+{
+    int i;
+
+    for (i = 0; i < MAX_EFFECT_STATE_NODES; i++) {
+        if (state_nodes[i].block && state_nodes[i].device_id == device_id)
+            return &state_nodes[i];
     }
+    return NULL;
 }
 
-void update_effects_node(int device_id, int effect_type, int enable_or_set, int enable_disable, int strength, int eq_band, int eq_level)
+static void write_text_node(int device_id,
+                            const struct effect_state_block *block)
 {
-    char prop[PROPERTY_VALUE_MAX];
+    char path[PATH_MAX];
     char buf[1024];
-    int fd = 0;
-    int paramValue = 0;
+    int len = 0, i, fd, n;
+
+    for (i = 0; i < EFFECT_STATE_NUM_PARAMS; i++)
+        len += snprintf(buf + len, sizeof(buf) - len, "%s%s=%d",
+                        i ? ";" : "", paramList[i], block->params[i]);
+
+    get_node_path(EFFECT_FILE, device_id, path, sizeof(path));
+    if ((fd = open(path, O_CREAT|O_TRUNC|O_WRONLY,
+                   S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) < 0) {
+        ALOGV("opening file for writing failed");
+        return;
+    }
+    n = write(fd, buf, len);
+    close(fd);
+    ALOGV("number of bytes written: %d", n);
+}
+
+/* seeds params from a text node left behind, returns false if there is none */
+static bool read_text_node(int device_id, struct effect_state_block *block)
+{
     char path[PATH_MAX];
-    char value[MAX_LENGTH_OF_INTEGER_IN_STRING];
-    char parameterValue[MAX_LENGTH_OF_INTEGER_IN_STRING];
-    int keyParamIndex = -1; //index in the paramlist array which has to be updated
-    char *s1, *s2;
-    char resultBuf[1024];
-    int index1 = -1;
-  //ALOGV("value of device_id and effect_type is %d and %d", device_id, effect_type);
-    property_get("vendor.audio.use.dts_eagle", prop, "0");
-    if (!strncmp("true", prop, sizeof("true")) || atoi(prop)) {
-        strlcpy(path, EFFECT_FILE, sizeof(path));
-        snprintf(value, sizeof(value), "%d", device_id);
-        strlcat(path, value, sizeof(path));
-        switch (effect_type)
-        {
-        case EQUALIZER:
-            if (enable_or_set) {
-                keyParamIndex = 0;
-                paramValue = enable_disable;
-        } else {
-            switch (eq_band) {
-            case 0:
-                keyParamIndex = 3;
-                break;
-            case 1:
-                keyParamIndex = 4;
-                break;
-            case 2:
-                keyParamIndex = 5;
-                break;
-            case 3:
-                keyParamIndex = 6;
-                break;
-            case 4:
-                keyParamIndex = 7;
-                break;
-            default:
+    char buf[1024];
+    char *pair, *value, *saveptr = NULL;
+    FILE *fp;
+    int i;
+
+    get_node_path(EFFECT_FILE, device_id, path, sizeof(path));
+    fp = fopen(path, "r");
+    if (fp == NULL)
+        return false;
+    if (fgets(buf, sizeof(buf), fp) == NULL) {
+        fclose(fp);
+        return false;
+    }
+    fclose(fp);
+
+    for (pair = strtok_r(buf, ";", &saveptr); pair;
+         pair = strtok_r(NULL, ";", &saveptr)) {
+        value = strchr(pair, '=');
+        if (!value)
+            continue;
+        *value++ = '\0';
+        for (i = 0; i < EFFECT_STATE_NUM_PARAMS; i++) {
+            if (!strcmp(pair, paramList[i])) {
+                block->params[i] = atoi(value);
                 break;
             }
-            paramValue = eq_level;
         }
-        break;
-        case VIRTUALIZER:
-            if(enable_or_set) {
-                keyParamIndex = 1;
-                paramValue = enable_disable;
-            } else {
-                 keyParamIndex = 8;
-                 paramValue = strength;
-            }
-            break;
-        case BASSBOOST:
-            if (enable_or_set) {
-                keyParamIndex = 2;
-                paramValue = enable_disable;
-            } else {
-                keyParamIndex = 9;
-                paramValue = strength;
-            }
-            break;
-         default:
+    }
+    return true;
+}
+
+void create_effect_state_node(int device_id)
+{
+    struct effect_state_node *node = NULL;
+    struct effect_state_block *block;
+    char path[PATH_MAX];
+    char prop[PROPERTY_VALUE_MAX];
+    int fd, i;
+
+    if (!dts_eagle_enabled())
+        return;
+
+    ALOGV("create_effect_node for - device_id: %d", device_id);
+    pthread_mutex_lock(&state_nodes_lock);
+    if (get_state_node(device_id)) {
+        ALOGV("state node already mapped, not creating again");
+        goto exit;
+    }
+    for (i = 0; i < MAX_EFFECT_STATE_NODES; i++) {
+        if (!state_nodes[i].block) {
+            node = &state_nodes[i];
             break;
         }
-        if(keyParamIndex !=-1) {
-            FILE *fp;
-            fp = fopen(path,"r");
-            if (fp != NULL) {
-                memset(buf, 0, 1024);
-                memset(resultBuf, 0, 1024);
-                if (fgets(buf, 1024, fp) != NULL) {
-                    s1 = strstr(buf, paramList[keyParamIndex]);
-                    s2 = strstr(s1,";");
-                    index1 = s1 - buf;
-                    strncpy(resultBuf, buf, index1);
-                    strncat(resultBuf, paramList[keyParamIndex], sizeof(resultBuf)-strlen(resultBuf)-1);
-                    strncat(resultBuf, "=", sizeof(resultBuf)-strlen(resultBuf)-1);
-                    snprintf(parameterValue, sizeof(parameterValue), "%d", paramValue);
-                    strncat(resultBuf, parameterValue, sizeof(resultBuf)-strlen(resultBuf)-1);
-                    if (s2)
-                        strncat(resultBuf, s2, sizeof(resultBuf)-strlen(resultBuf)-1);
-                    fclose(fp);
-                    if ((fd=open(path, O_TRUNC|O_WRONLY)) < 0) {
-                       ALOGV("opening file for writing failed");
-                       return;
-                    }
-                    int n = write(fd, resultBuf, strlen(resultBuf));
-                    close(fd);
-                    ALOGV("number of bytes written: %d", n);
-                } else {
-                    ALOGV("file could not be read");
-                    fclose(fp);
-                }
-            } else
-                ALOGV("file could not be opened");
-        }
     }
+    if (!node) {
+        ALOGE("%s: no free state node for device %d", __func__, device_id);
+        goto exit;
+    }
+
+    get_node_path(EFFECT_STATE_FILE, device_id, path, sizeof(path));
+    if ((fd = open(path, O_CREAT|O_RDWR,
+                   S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH)) < 0) {
+        ALOGE("opening effect state node failed returned");
+        goto exit;
+    }
+    if (ftruncate(fd, sizeof(struct effect_state_block)) < 0) {
+        ALOGE("%s: sizing effect state node failed", __func__);
+        close(fd);
+        goto exit;
+    }
+    block = (struct effect_state_block *)mmap(NULL,
+                                              sizeof(struct effect_state_block),
+                                              PROT_READ|PROT_WRITE, MAP_SHARED,
+                                              fd, 0);
+    close(fd);
+    if (block == MAP_FAILED) {
+        ALOGE("%s: mapping effect state node failed", __func__);
+        goto exit;
+    }
+
+    /*
+     * an existing node keeps its state like the text node always did, only
+     * a new or foreign block starts from the text node or from defaults
+     */
+    if (block->magic != EFFECT_STATE_MAGIC ||
+        block->layout_version != EFFECT_STATE_LAYOUT_VERSION ||
+        block->num_params != EFFECT_STATE_NUM_PARAMS) {
+        memset(block, 0, sizeof(*block));
+        read_text_node(device_id, block);
+        block->magic = EFFECT_STATE_MAGIC;
+        block->layout_version = EFFECT_STATE_LAYOUT_VERSION;
+        block->num_params = EFFECT_STATE_NUM_PARAMS;
+    } else if (block->sequence & 1) {
+        /* the previous owner died mid update */
+        android_atomic_inc(&block->sequence);
+    }
+
+    property_get("vendor.audio.dts_eagle.text_state", prop, "true");
+    node->device_id = device_id;
+    node->block = block;
+    node->text_state = !strncmp("true", prop, sizeof("true")) || atoi(prop);
+    node->updates = 0;
+    node->update_ns = 0;
+    if (node->text_state)
+        write_text_node(device_id, block);
+exit:
+    pthread_mutex_unlock(&state_nodes_lock);
+}
+
+static int get_param_index(int effect_type, int enable_or_set, int eq_band)
+{
+    switch (effect_type) {
+    case EQUALIZER:
+        if (enable_or_set)
+            return EFFECT_STATE_EQ_ENABLE;
+        if (eq_band >= 0 && eq_band < 5)
+            return EFFECT_STATE_EQ_LEVEL0 + eq_band;
+        break;
+    case VIRTUALIZER:
+        return enable_or_set ? EFFECT_STATE_VIRT_ENABLE :
+                               EFFECT_STATE_VIRT_STRENGTH;
+    case BASSBOOST:
+        return enable_or_set ? EFFECT_STATE_BB_ENABLE :
+                               EFFECT_STATE_BB_STRENGTH;
+    default:
+        break;
+    }
+    return -1;
+}
+
+void update_effects_node(int device_id, int effect_type, int enable_or_set, int enable_disable, int strength, int eq_band, int eq_level)
+{
+    struct effect_state_node *node;
+    struct effect_state_block *block;
+    int keyParamIndex; //index in the block params which has to be updated
+    int paramValue;
+    int64_t start_ns;
+
+    keyParamIndex = get_param_index(effect_type, enable_or_set, eq_band);
+    if (keyParamIndex == -1)
+        return;
+    if (enable_or_set)
+        paramValue = enable_disable;
+    else if (effect_type == EQUALIZER)
+        paramValue = eq_level;
+    else
+        paramValue = strength;
+
+    pthread_mutex_lock(&state_nodes_lock);
+    node = get_state_node(device_id);
+    if (!node) {
+        ALOGV("state node for device %d not created", device_id);
+        goto exit;
+    }
+    block = node->block;
+    if (block->params[keyParamIndex] == paramValue)
+        goto exit;
+
+    start_ns = effect_util_now_ns();
+    /* odd sequence tells readers an update is in flight */
+    android_atomic_inc(&block->sequence);
+    android_atomic_release_store(paramValue, &block->params[keyParamIndex]);
+    android_atomic_inc(&block->sequence);
+    if (node->text_state)
+        write_text_node(device_id, block);
+    node->update_ns += effect_util_now_ns() - start_ns;
+    node->updates++;
+exit:
+    pthread_mutex_unlock(&state_nodes_lock);
 }
 
 void remove_effect_state_node(int device_id)
 {
-    char prop[PROPERTY_VALUE_MAX];
-    int fd;
+    struct effect_state_node *node;
     char path[PATH_MAX];
-    char value[MAX_LENGTH_OF_INTEGER_IN_STRING];
 
-    property_get("vendor.audio.use.dts_eagle", prop, "0");
-    if (!strncmp("true", prop, sizeof("true")) || atoi(prop)) {
-        ALOGV("remove_state_notifier_node: device_id - %d", device_id);
-        strlcpy(path, EFFECT_FILE, sizeof(path));
-        snprintf(value, sizeof(value), "%d", device_id);
-        strlcat(path, value, sizeof(path));
-        if ((fd=open(path, O_RDONLY)) < 0) {
-            ALOGV("open effect state node failed");
-        } else {
-            ALOGV("open effect state node successful");
-            ALOGV("Remove the file");
-            close(fd);
-            remove(path);
-        }
+    pthread_mutex_lock(&state_nodes_lock);
+    node = get_state_node(device_id);
+    if (!node) {
+        ALOGV("open effect state node failed");
+        goto exit;
+    }
+
+    ALOGV("remove_state_notifier_node: device_id - %d", device_id);
+    if (node->updates)
+        ALOGD("%s: device %d %u updates, avg %" PRIu64 " ns", __func__,
+              device_id, node->updates, node->update_ns / node->updates);
+    munmap(node->block, sizeof(struct effect_state_block));
+    node->block = NULL;
+
+    get_node_path(EFFECT_STATE_FILE, device_id, path, sizeof(path));
+    remove(path);
+    if (node->text_state) {
+        get_node_path(EFFECT_FILE, device_id, path, sizeof(path));
+        remove(path);
     }
+exit:
+    pthread_mutex_unlock(&state_nodes_lock);
 }
 #endif
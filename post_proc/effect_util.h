@@ -20,6 +20,9 @@
 #ifdef DTS_EAGLE
 
 #include <cutils/properties.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
@@ -38,6 +41,37 @@ enum {
 #define EFFECT_NO_OP 0
 #define PCM_DEV_ID 9
 
+/* index of each parameter in effect_state_block.params */
+enum {
+    EFFECT_STATE_EQ_ENABLE = 0,
+    EFFECT_STATE_VIRT_ENABLE,
+    EFFECT_STATE_BB_ENABLE,
+    EFFECT_STATE_EQ_LEVEL0,
+    EFFECT_STATE_EQ_LEVEL1,
+    EFFECT_STATE_EQ_LEVEL2,
+    EFFECT_STATE_EQ_LEVEL3,
+    EFFECT_STATE_EQ_LEVEL4,
+    EFFECT_STATE_VIRT_STRENGTH,
+    EFFECT_STATE_BB_STRENGTH,
+    EFFECT_STATE_NUM_PARAMS,
+};
+
+#define EFFECT_STATE_MAGIC 0x45534654 /* "EFST" */
+#define EFFECT_STATE_LAYOUT_VERSION 1
+
+/*
+ * Layout of /data/misc/dts/effect_state<device>. sequence is odd while a
+ * parameter is being written and changes with every update; readers copy
+ * params and retry if sequence was odd or changed meanwhile.
+ */
+struct effect_state_block {
+    uint32_t magic;
+    uint32_t layout_version;
+    uint32_t num_params;
+    volatile int32_t sequence;
+    volatile int32_t params[EFFECT_STATE_NUM_PARAMS];
+};
+
 void create_effect_state_node(int device_id);
 void update_effects_node(int device_id, int effect_type, int enable_or_set, int enable_disable, int strength, int band, int level);
 void remove_effect_state_node(int device_id);
@@ -605,6 +605,21 @@ int equalizer_stop(effect_context_t *context, output_context_t *output __unused)
     return 0;
 }
 
+int equalizer_process(effect_context_t *context, audio_buffer_t *in,
+                      audio_buffer_t *out)
+{
+    equalizer_context_t *eq_ctxt = (equalizer_context_t *)context;
+
+    if (!offload_eq_get_enable_flag(&(eq_ctxt->offload_eq)))
+        return host_fx_process(&context->host_io, &context->config, in, out,
+                               NULL, NULL);
+
+    host_eq_update(&eq_ctxt->host_eq, &eq_ctxt->offload_eq,
+                   context->config.inputCfg.samplingRate);
+    return host_fx_process(&context->host_io, &context->config, in, out,
+                           host_eq_process, &eq_ctxt->host_eq);
+}
+
 int equalizer_set_mode(effect_context_t *context, int32_t hw_acc_fd)
 {
     equalizer_context_t *eq_ctxt = (equalizer_context_t *)context;
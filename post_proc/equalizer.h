@@ -41,6 +41,8 @@ typedef struct equalizer_context_s {
     int hw_acc_fd;
     uint32_t device;
     struct eq_params offload_eq;
+
+    struct host_eq host_eq;
 } equalizer_context_t;
 
 int equalizer_get_parameter(effect_context_t *context, effect_param_t *p,
@@ -65,4 +67,7 @@ int equalizer_start(effect_context_t *context, output_context_t *output);
 
 int equalizer_stop(effect_context_t *context, output_context_t *output);
 
+int equalizer_process(effect_context_t *context, audio_buffer_t *in,
+                      audio_buffer_t *out);
+
 #endif /*OFFLOAD_EQUALIZER_H_*/
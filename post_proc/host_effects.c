@@ -0,0 +1,589 @@
+/*
+ * Copyright (C) 2026 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "offload_effect_host"
+//#define LOG_NDEBUG 0
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <log/log.h>
+#include <system/audio.h>
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "host_effects.h"
+
+#define HOST_BASSBOOST_FREQ_HZ          100.0f
+#define HOST_BASSBOOST_MAX_GAIN_DB      15.0f
+#define HOST_REVERB_MIN_DECAY_MS        100
+#define HOST_REVERB_MAX_FEEDBACK        0.98f
+
+/* mutually prime line lengths at 44.1kHz, scaled to the stream rate */
+static const int reverb_line_lengths[HOST_FX_REVERB_LINES] = {
+    1557, 1617, 1491, 1422
+};
+
+static inline float millibel_to_gain(int millibel)
+{
+    return powf(10.0f, millibel / 2000.0f);
+}
+
+static inline int64_t host_fx_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*
+ * Biquads
+ */
+static void biquad_peaking(struct host_biquad_coefs *c, float freq, float q,
+                           float gain_db, uint32_t rate)
+{
+    float a = powf(10.0f, gain_db / 40.0f);
+    float w0 = 2.0f * (float)M_PI * freq / rate;
+    float cos_w0 = cosf(w0);
+    float alpha = sinf(w0) / (2.0f * q);
+    float a0 = 1.0f + alpha / a;
+
+    c->b0 = (1.0f + alpha * a) / a0;
+    c->b1 = (-2.0f * cos_w0) / a0;
+    c->b2 = (1.0f - alpha * a) / a0;
+    c->a1 = (-2.0f * cos_w0) / a0;
+    c->a2 = (1.0f - alpha / a) / a0;
+}
+
+static void biquad_low_shelf(struct host_biquad_coefs *c, float freq,
+                             float gain_db, uint32_t rate)
+{
+    float a = powf(10.0f, gain_db / 40.0f);
+    float w0 = 2.0f * (float)M_PI * freq / rate;
+    float cos_w0 = cosf(w0);
+    /* shelf slope S = 1 */
+    float alpha = sinf(w0) / 2.0f * sqrtf(2.0f);
+    float sqrt_a = 2.0f * sqrtf(a) * alpha;
+    float a0 = (a + 1.0f) + (a - 1.0f) * cos_w0 + sqrt_a;
+
+    c->b0 = a * ((a + 1.0f) - (a - 1.0f) * cos_w0 + sqrt_a) / a0;
+    c->b1 = 2.0f * a * ((a - 1.0f) - (a + 1.0f) * cos_w0) / a0;
+    c->b2 = a * ((a + 1.0f) - (a - 1.0f) * cos_w0 - sqrt_a) / a0;
+    c->a1 = -2.0f * ((a - 1.0f) + (a + 1.0f) * cos_w0) / a0;
+    c->a2 = ((a + 1.0f) + (a - 1.0f) * cos_w0 - sqrt_a) / a0;
+}
+
+static void biquad_stage_scalar(const struct host_biquad_coefs *c,
+                                float *z1, float *z2, float *buf,
+                                int channels, int first, int last,
+                                size_t frames)
+{
+    int ch;
+    size_t i;
+
+    for (ch = first; ch < last; ch++) {
+        float s1 = z1[ch], s2 = z2[ch];
+        float *p = buf + ch;
+
+        for (i = 0; i < frames; i++, p += channels) {
+            float x = *p;
+            float y = c->b0 * x + s1;
+
+            s1 = c->b1 * x - c->a1 * y + s2;
+            s2 = c->b2 * x - c->a2 * y;
+            *p = y;
+        }
+        z1[ch] = s1;
+        z2[ch] = s2;
+    }
+}
+
+/*
+ * Channels are independent, so a stage runs one channel per SIMD lane and
+ * walks the interleaved frames with the state kept in registers.
+ */
+static void biquad_cascade_process(struct host_biquad_cascade *bq,
+                                   float *buf, int channels, size_t frames)
+{
+    int s, ch;
+
+    for (s = 0; s < bq->num_stages; s++) {
+        const struct host_biquad_coefs *c = &bq->coefs[s];
+        float *z1 = bq->z1[s];
+        float *z2 = bq->z2[s];
+
+        ch = 0;
+#if defined(__ARM_NEON)
+        for (; ch + 4 <= channels; ch += 4) {
+            float32x4_t s1 = vld1q_f32(z1 + ch);
+            float32x4_t s2 = vld1q_f32(z2 + ch);
+            float *p = buf + ch;
+            size_t i;
+
+            for (i = 0; i < frames; i++, p += channels) {
+                float32x4_t x = vld1q_f32(p);
+                float32x4_t y = vmlaq_n_f32(s1, x, c->b0);
+
+                s1 = vmlsq_n_f32(vmlaq_n_f32(s2, x, c->b1), y, c->a1);
+                s2 = vmlsq_n_f32(vmulq_n_f32(x, c->b2), y, c->a2);
+                vst1q_f32(p, y);
+            }
+            vst1q_f32(z1 + ch, s1);
+            vst1q_f32(z2 + ch, s2);
+        }
+        for (; ch + 2 <= channels; ch += 2) {
+            float32x2_t s1 = vld1_f32(z1 + ch);
+            float32x2_t s2 = vld1_f32(z2 + ch);
+            float *p = buf + ch;
+            size_t i;
+
+            for (i = 0; i < frames; i++, p += channels) {
+                float32x2_t x = vld1_f32(p);
+                float32x2_t y = vmla_n_f32(s1, x, c->b0);
+
+                s1 = vmls_n_f32(vmla_n_f32(s2, x, c->b1), y, c->a1);
+                s2 = vmls_n_f32(vmul_n_f32(x, c->b2), y, c->a2);
+                vst1_f32(p, y);
+            }
+            vst1_f32(z1 + ch, s1);
+            vst1_f32(z2 + ch, s2);
+        }
+#endif
+        biquad_stage_scalar(c, z1, z2, buf, channels, ch, channels, frames);
+    }
+}
+
+static void biquad_cascade_set_stages(struct host_biquad_cascade *bq,
+                                      int num_stages)
+{
+    /* a stage taking a different role must not inherit old state */
+    if (num_stages != bq->num_stages) {
+        memset(bq->z1, 0, sizeof(bq->z1));
+        memset(bq->z2, 0, sizeof(bq->z2));
+    }
+    bq->num_stages = num_stages;
+}
+
+static void host_copy_frames(const float *in, int in_channels, float *out,
+                             int out_channels, size_t frames)
+{
+    size_t i;
+    int ch;
+
+    if (in_channels == out_channels) {
+        if (in != out)
+            memcpy(out, in, frames * in_channels * sizeof(float));
+        return;
+    }
+    for (i = 0; i < frames; i++, in += in_channels, out += out_channels) {
+        for (ch = 0; ch < out_channels; ch++)
+            out[ch] = ch < in_channels ? in[ch] : 0.0f;
+    }
+}
+
+/*
+ * Equalizer
+ */
+void host_eq_update(struct host_eq *eq, const struct eq_params *params,
+                    uint32_t rate)
+{
+    int i, num_stages = 0;
+
+    if (eq->configured && eq->rate == rate &&
+            !memcmp(&eq->params.config, &params->config,
+                    sizeof(params->config)) &&
+            !memcmp(eq->params.per_band_cfg, params->per_band_cfg,
+                    sizeof(params->per_band_cfg)))
+        return;
+
+    for (i = 0; i < (int)params->config.num_bands &&
+                num_stages < HOST_FX_MAX_BIQUADS; i++) {
+        const struct eq_per_band_config *band = &params->per_band_cfg[i];
+        float freq = band->freq_millihertz / 1000.0f;
+        float q = band->quality_factor ?
+                  (float)band->quality_factor / Q8_UNITY : 1.0f;
+
+        if (!band->gain_millibels || freq <= 0.0f)
+            continue;
+        if (freq > 0.45f * rate)
+            freq = 0.45f * rate;
+        biquad_peaking(&eq->cascade.coefs[num_stages++], freq, q,
+                       band->gain_millibels / 100.0f, rate);
+    }
+    biquad_cascade_set_stages(&eq->cascade, num_stages);
+
+    eq->params = *params;
+    eq->rate = rate;
+    eq->configured = true;
+    ALOGV("%s: %d stages at %u Hz", __func__, num_stages, rate);
+}
+
+void host_eq_process(void *engine, const float *in, int in_channels,
+                     float *out, int out_channels, size_t frames)
+{
+    struct host_eq *eq = (struct host_eq *)engine;
+
+    host_copy_frames(in, in_channels, out, out_channels, frames);
+    biquad_cascade_process(&eq->cascade, out, out_channels, frames);
+}
+
+/*
+ * Bass boost
+ */
+void host_bassboost_update(struct host_bassboost *bassboost,
+                           const struct bass_boost_params *params,
+                           uint32_t rate)
+{
+    float gain_db;
+
+    if (bassboost->configured && bassboost->rate == rate &&
+            bassboost->params.strength == params->strength)
+        return;
+
+    gain_db = HOST_BASSBOOST_MAX_GAIN_DB * params->strength / 1000.0f;
+    if (gain_db > 0.0f) {
+        biquad_low_shelf(&bassboost->cascade.coefs[0],
+                         HOST_BASSBOOST_FREQ_HZ, gain_db, rate);
+        biquad_cascade_set_stages(&bassboost->cascade, 1);
+    } else {
+        biquad_cascade_set_stages(&bassboost->cascade, 0);
+    }
+
+    bassboost->params = *params;
+    bassboost->rate = rate;
+    bassboost->configured = true;
+}
+
+void host_bassboost_process(void *engine, const float *in, int in_channels,
+                            float *out, int out_channels, size_t frames)
+{
+    struct host_bassboost *bassboost = (struct host_bassboost *)engine;
+
+    host_copy_frames(in, in_channels, out, out_channels, frames);
+    biquad_cascade_process(&bassboost->cascade, out, out_channels, frames);
+}
+
+/*
+ * Virtualizer: mid/side widening of the front pair
+ */
+void host_virtualizer_update(struct host_virtualizer *virtualizer,
+                             const struct virtualizer_params *params)
+{
+    float width, norm;
+
+    if (virtualizer->configured &&
+            virtualizer->params.strength == params->strength)
+        return;
+
+    width = 1.0f + params->strength / 1000.0f;
+    norm = sqrtf(2.0f / (1.0f + width * width));
+    virtualizer->mid_gain = norm;
+    virtualizer->side_gain = width * norm;
+    virtualizer->params = *params;
+    virtualizer->configured = true;
+}
+
+void host_virtualizer_process(void *engine, const float *in, int in_channels,
+                              float *out, int out_channels, size_t frames)
+{
+    struct host_virtualizer *virtualizer = (struct host_virtualizer *)engine;
+    const float mid_gain = virtualizer->mid_gain * 0.5f;
+    const float side_gain = virtualizer->side_gain * 0.5f;
+    float *p;
+    size_t i;
+
+    host_copy_frames(in, in_channels, out, out_channels, frames);
+    if (out_channels < 2)
+        return;
+
+    for (i = 0, p = out; i < frames; i++, p += out_channels) {
+        float mid = (p[0] + p[1]) * mid_gain;
+        float side = (p[0] - p[1]) * side_gain;
+
+        p[0] = mid + side;
+        p[1] = mid - side;
+    }
+}
+
+/*
+ * Reverb: four line feedback delay network with a Hadamard mixing matrix
+ * and one pole damping in the loop.
+ */
+void host_reverb_release(struct host_reverb *reverb)
+{
+    int i;
+
+    for (i = 0; i < HOST_FX_REVERB_LINES; i++) {
+        free(reverb->lines[i]);
+        reverb->lines[i] = NULL;
+    }
+    reverb->configured = false;
+}
+
+int host_reverb_update(struct host_reverb *reverb,
+                       const struct reverb_params *params, uint32_t rate)
+{
+    float decay_s, damping;
+    int i;
+
+    if (reverb->configured && reverb->rate == rate &&
+            !memcmp(&reverb->params, params, sizeof(*params)))
+        return 0;
+
+    if (!reverb->configured || reverb->rate != rate) {
+        host_reverb_release(reverb);
+        for (i = 0; i < HOST_FX_REVERB_LINES; i++) {
+            reverb->length[i] = (int)((int64_t)reverb_line_lengths[i] *
+                                      rate / 44100);
+            reverb->pos[i] = 0;
+            reverb->damp_state[i] = 0.0f;
+            reverb->lines[i] = (float *)calloc(reverb->length[i],
+                                               sizeof(float));
+            if (!reverb->lines[i]) {
+                host_reverb_release(reverb);
+                return -ENOMEM;
+            }
+        }
+    }
+
+    decay_s = (params->decay_time > HOST_REVERB_MIN_DECAY_MS ?
+               params->decay_time : HOST_REVERB_MIN_DECAY_MS) / 1000.0f;
+    for (i = 0; i < HOST_FX_REVERB_LINES; i++) {
+        /* -60dB after decay_time for a signal circulating in line i */
+        float g = powf(10.0f, -3.0f * reverb->length[i] / (decay_s * rate));
+
+        reverb->feedback[i] = g < HOST_REVERB_MAX_FEEDBACK ?
+                              g : HOST_REVERB_MAX_FEEDBACK;
+    }
+    /* decay_hf_ratio is in permille, 1000 leaves highs undamped */
+    damping = 1.0f - params->decay_hf_ratio / 1000.0f;
+    reverb->damping = damping < 0.0f ? 0.0f : (damping > 0.9f ? 0.9f : damping);
+    reverb->input_gain = millibel_to_gain(params->room_level);
+    reverb->wet_gain = millibel_to_gain(params->level) * 0.5f;
+
+    reverb->params = *params;
+    reverb->rate = rate;
+    reverb->configured = true;
+    return 0;
+}
+
+static inline void reverb_tick(struct host_reverb *reverb, float x,
+                               float *wet_l, float *wet_r)
+{
+    const float damping = reverb->damping;
+    float d[HOST_FX_REVERB_LINES], o[HOST_FX_REVERB_LINES];
+    int i;
+
+    for (i = 0; i < HOST_FX_REVERB_LINES; i++) {
+        o[i] = reverb->lines[i][reverb->pos[i]];
+        d[i] = o[i] + (reverb->damp_state[i] - o[i]) * damping;
+        reverb->damp_state[i] = d[i];
+    }
+    {
+        float h0 = 0.5f * (d[0] + d[1] + d[2] + d[3]);
+        float h1 = 0.5f * (d[0] - d[1] + d[2] - d[3]);
+        float h2 = 0.5f * (d[0] + d[1] - d[2] - d[3]);
+        float h3 = 0.5f * (d[0] - d[1] - d[2] + d[3]);
+
+        reverb->lines[0][reverb->pos[0]] = x + reverb->feedback[0] * h0;
+        reverb->lines[1][reverb->pos[1]] = x + reverb->feedback[1] * h1;
+        reverb->lines[2][reverb->pos[2]] = x + reverb->feedback[2] * h2;
+        reverb->lines[3][reverb->pos[3]] = x + reverb->feedback[3] * h3;
+    }
+    for (i = 0; i < HOST_FX_REVERB_LINES; i++) {
+        if (++reverb->pos[i] == reverb->length[i])
+            reverb->pos[i] = 0;
+    }
+    *wet_l = (o[0] + o[2]) * reverb->wet_gain;
+    *wet_r = (o[1] + o[3]) * reverb->wet_gain;
+}
+
+static void reverb_run(struct host_reverb *reverb, const float *in,
+                       int in_channels, float *out, int out_channels,
+                       size_t frames, bool insert)
+{
+    const int send_channels = in_channels < 2 ? in_channels : 2;
+    const float send_gain = reverb->input_gain / send_channels;
+    size_t i;
+    int ch;
+
+    for (i = 0; i < frames; i++, in += in_channels, out += out_channels) {
+        float x = 0.0f, wet_l, wet_r;
+
+        for (ch = 0; ch < send_channels; ch++)
+            x += in[ch];
+        reverb_tick(reverb, x * send_gain, &wet_l, &wet_r);
+
+        if (insert) {
+            /* in and out may alias, read before writing */
+            for (ch = 0; ch < out_channels; ch++)
+                out[ch] = in[ch];
+        } else {
+            for (ch = 0; ch < out_channels; ch++)
+                out[ch] = 0.0f;
+        }
+        if (out_channels == 1) {
+            out[0] += 0.5f * (wet_l + wet_r);
+        } else {
+            out[0] += wet_l;
+            out[1] += wet_r;
+        }
+    }
+}
+
+void host_reverb_process(void *engine, const float *in, int in_channels,
+                         float *out, int out_channels, size_t frames)
+{
+    reverb_run((struct host_reverb *)engine, in, in_channels, out,
+               out_channels, frames, true);
+}
+
+void host_aux_reverb_process(void *engine, const float *in, int in_channels,
+                             float *out, int out_channels, size_t frames)
+{
+    reverb_run((struct host_reverb *)engine, in, in_channels, out,
+               out_channels, frames, false);
+}
+
+/*
+ * Buffer handling
+ */
+static void host_fx_to_float(const audio_buffer_t *buf, audio_format_t format,
+                             float *dst, size_t samples)
+{
+    size_t i;
+
+    if (format == AUDIO_FORMAT_PCM_FLOAT) {
+        memcpy(dst, buf->f32, samples * sizeof(float));
+        return;
+    }
+    for (i = 0; i < samples; i++)
+        dst[i] = buf->s16[i] * (1.0f / 32768.0f);
+}
+
+static inline int16_t host_fx_clamp16(float sample)
+{
+    int32_t s = (int32_t)lrintf(sample * 32768.0f);
+
+    return s > INT16_MAX ? INT16_MAX : (s < INT16_MIN ? INT16_MIN : s);
+}
+
+static void host_fx_from_float(audio_buffer_t *buf, audio_format_t format,
+                               const float *src, size_t samples,
+                               bool accumulate)
+{
+    size_t i;
+
+    if (format == AUDIO_FORMAT_PCM_FLOAT) {
+        if (accumulate) {
+            for (i = 0; i < samples; i++)
+                buf->f32[i] += src[i];
+        } else {
+            memcpy(buf->f32, src, samples * sizeof(float));
+        }
+        return;
+    }
+    for (i = 0; i < samples; i++) {
+        float sample = src[i];
+
+        if (accumulate)
+            sample += buf->s16[i] * (1.0f / 32768.0f);
+        buf->s16[i] = host_fx_clamp16(sample);
+    }
+}
+
+int host_fx_process(struct host_fx_io *io, const effect_config_t *config,
+                    audio_buffer_t *in, audio_buffer_t *out,
+                    host_fx_process_fn fn, void *engine)
+{
+    int in_channels, out_channels;
+    audio_format_t format = config->inputCfg.format;
+    bool accumulate;
+    size_t frames, samples;
+    int64_t start_ns;
+
+    if (in == NULL || out == NULL || in->raw == NULL || out->raw == NULL ||
+            in->frameCount != out->frameCount)
+        return -EINVAL;
+    if ((format != AUDIO_FORMAT_PCM_16_BIT &&
+            format != AUDIO_FORMAT_PCM_FLOAT) ||
+            config->outputCfg.format != format)
+        return -EINVAL;
+
+    in_channels = audio_channel_count_from_out_mask(config->inputCfg.channels);
+    out_channels = audio_channel_count_from_out_mask(config->outputCfg.channels);
+    if (in_channels < 1 || in_channels > HOST_FX_MAX_CHANNELS ||
+            out_channels < 1 || out_channels > HOST_FX_MAX_CHANNELS)
+        return -EINVAL;
+
+    frames = in->frameCount;
+    samples = frames * (in_channels > out_channels ? in_channels : out_channels);
+    if (samples > io->buf_samples) {
+        /* grows to the largest buffer the thread uses, then stays */
+        float *in_buf = (float *)realloc(io->in_buf, samples * sizeof(float));
+        float *out_buf;
+
+        if (!in_buf)
+            return -ENOMEM;
+        io->in_buf = in_buf;
+        out_buf = (float *)realloc(io->out_buf, samples * sizeof(float));
+        if (!out_buf)
+            return -ENOMEM;
+        io->out_buf = out_buf;
+        io->buf_samples = samples;
+    }
+
+    host_fx_to_float(in, format, io->in_buf, frames * in_channels);
+    if (fn) {
+        start_ns = host_fx_now_ns();
+        fn(engine, io->in_buf, in_channels, io->out_buf, out_channels, frames);
+        io->process_ns += host_fx_now_ns() - start_ns;
+        io->frames += frames;
+    } else if (in_channels == out_channels) {
+        memcpy(io->out_buf, io->in_buf, frames * in_channels * sizeof(float));
+    } else {
+        memset(io->out_buf, 0, frames * out_channels * sizeof(float));
+    }
+
+    accumulate = config->outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE;
+    host_fx_from_float(out, format, io->out_buf, frames * out_channels,
+                       accumulate);
+
+    io->rate = config->inputCfg.samplingRate;
+    io->in_channels = in_channels;
+    io->out_channels = out_channels;
+    return 0;
+}
+
+void host_fx_release(struct host_fx_io *io, const char *name)
+{
+    if (io->frames && io->rate) {
+        double ns_per_frame = (double)io->process_ns / io->frames;
+
+        ALOGD("%s: %s %d->%d ch @ %u Hz, %" PRIu64 " frames, %.1f ns/frame "
+              "(%.2f%% of realtime)", __func__, name, io->in_channels,
+              io->out_channels, io->rate, io->frames, ns_per_frame,
+              ns_per_frame * io->rate / 1e7);
+    }
+    free(io->in_buf);
+    free(io->out_buf);
+    memset(io, 0, sizeof(*io));
+}
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2026 The LineageOS Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OFFLOAD_EFFECT_HOST_EFFECTS_H_
+#define OFFLOAD_EFFECT_HOST_EFFECTS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <hardware/audio_effect.h>
+#include <sound/audio_effects.h>
+
+/*
+ * Host side implementation of the bundle effects, driven by the same
+ * parameter structs that are sent to the DSP. Used on outputs that are not
+ * offloaded when host processing is selected for them.
+ */
+
+#define HOST_FX_MAX_CHANNELS    8
+#define HOST_FX_MAX_BIQUADS     8
+#define HOST_FX_REVERB_LINES    4
+
+struct host_biquad_coefs {
+    float b0, b1, b2, a1, a2;
+};
+
+struct host_biquad_cascade {
+    int num_stages;
+    struct host_biquad_coefs coefs[HOST_FX_MAX_BIQUADS];
+    /* transposed direct form II state, one lane per channel */
+    float z1[HOST_FX_MAX_BIQUADS][HOST_FX_MAX_CHANNELS];
+    float z2[HOST_FX_MAX_BIQUADS][HOST_FX_MAX_CHANNELS];
+};
+
+struct host_eq {
+    struct eq_params params;
+    uint32_t rate;
+    bool configured;
+    struct host_biquad_cascade cascade;
+};
+
+struct host_bassboost {
+    struct bass_boost_params params;
+    uint32_t rate;
+    bool configured;
+    struct host_biquad_cascade cascade;
+};
+
+struct host_virtualizer {
+    struct virtualizer_params params;
+    bool configured;
+    float mid_gain;
+    float side_gain;
+};
+
+struct host_reverb {
+    struct reverb_params params;
+    uint32_t rate;
+    bool configured;
+    float *lines[HOST_FX_REVERB_LINES];
+    int length[HOST_FX_REVERB_LINES];
+    int pos[HOST_FX_REVERB_LINES];
+    float feedback[HOST_FX_REVERB_LINES];
+    float damp_state[HOST_FX_REVERB_LINES];
+    float damping;
+    float input_gain;
+    float wet_gain;
+};
+
+/* format conversion, scratch buffers and cost accounting of one effect */
+struct host_fx_io {
+    float *in_buf;
+    float *out_buf;
+    size_t buf_samples;
+    uint64_t frames;
+    uint64_t process_ns;
+    uint32_t rate;
+    int in_channels;
+    int out_channels;
+};
+
+typedef void (*host_fx_process_fn)(void *engine,
+                                   const float *in, int in_channels,
+                                   float *out, int out_channels,
+                                   size_t frames);
+
+/* pick up parameter or rate changes, keeping the filter state */
+void host_eq_update(struct host_eq *eq, const struct eq_params *params,
+                    uint32_t rate);
+void host_bassboost_update(struct host_bassboost *bassboost,
+                           const struct bass_boost_params *params,
+                           uint32_t rate);
+void host_virtualizer_update(struct host_virtualizer *virtualizer,
+                             const struct virtualizer_params *params);
+int host_reverb_update(struct host_reverb *reverb,
+                       const struct reverb_params *params, uint32_t rate);
+void host_reverb_release(struct host_reverb *reverb);
+
+void host_eq_process(void *engine, const float *in, int in_channels,
+                     float *out, int out_channels, size_t frames);
+void host_bassboost_process(void *engine, const float *in, int in_channels,
+                            float *out, int out_channels, size_t frames);
+void host_virtualizer_process(void *engine, const float *in, int in_channels,
+                              float *out, int out_channels, size_t frames);
+/* insert reverb mixes dry and wet, auxiliary reverb outputs wet only */
+void host_reverb_process(void *engine, const float *in, int in_channels,
+                         float *out, int out_channels, size_t frames);
+void host_aux_reverb_process(void *engine, const float *in, int in_channels,
+                             float *out, int out_channels, size_t frames);
+
+/*
+ * Runs fn on the buffers of an effect with the given config. fn NULL copies
+ * the input through, which is what a temporarily disabled effect does.
+ */
+int host_fx_process(struct host_fx_io *io, const effect_config_t *config,
+                    audio_buffer_t *in, audio_buffer_t *out,
+                    host_fx_process_fn fn, void *engine);
+void host_fx_release(struct host_fx_io *io, const char *name);
+
+#endif /* OFFLOAD_EFFECT_HOST_EFFECTS_H_ */
@@ -824,6 +824,32 @@ int reverb_stop(effect_context_t *context, output_context_t *output __unused)
     return 0;
 }
 
+int reverb_process(effect_context_t *context, audio_buffer_t *in,
+                   audio_buffer_t *out)
+{
+    reverb_context_t *reverb_ctxt = (reverb_context_t *)context;
+
+    if (!offload_reverb_get_enable_flag(&(reverb_ctxt->offload_reverb)) ||
+            host_reverb_update(&reverb_ctxt->host_reverb,
+                               &reverb_ctxt->offload_reverb,
+                               context->config.inputCfg.samplingRate) < 0)
+        return host_fx_process(&context->host_io, &context->config, in, out,
+                               NULL, NULL);
+
+    return host_fx_process(&context->host_io, &context->config, in, out,
+                           reverb_ctxt->auxiliary ? host_aux_reverb_process :
+                                                    host_reverb_process,
+                           &reverb_ctxt->host_reverb);
+}
+
+int reverb_release(effect_context_t *context)
+{
+    reverb_context_t *reverb_ctxt = (reverb_context_t *)context;
+
+    host_reverb_release(&reverb_ctxt->host_reverb);
+    return 0;
+}
+
 int reverb_set_mode(effect_context_t *context, int32_t hw_acc_fd)
 {
     reverb_context_t *reverb_ctxt = (reverb_context_t *)context;
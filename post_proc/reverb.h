@@ -58,6 +58,8 @@ typedef struct reverb_context_s {
     reverb_settings_t reverb_settings;
     uint32_t device;
     struct reverb_params offload_reverb;
+
+    struct host_reverb host_reverb;
 } reverb_context_t;
 
 
@@ -89,4 +91,9 @@ int reverb_start(effect_context_t *context, output_context_t *output);
 
 int reverb_stop(effect_context_t *context, output_context_t *output);
 
+int reverb_process(effect_context_t *context, audio_buffer_t *in,
+                   audio_buffer_t *out);
+
+int reverb_release(effect_context_t *context);
+
 #endif /* OFFLOAD_REVERB_H_ */
@@ -586,6 +586,21 @@ int virtualizer_stop(effect_context_t *context, output_context_t *output __unuse
     return 0;
 }
 
+int virtualizer_process(effect_context_t *context, audio_buffer_t *in,
+                        audio_buffer_t *out)
+{
+    virtualizer_context_t *virt_ctxt = (virtualizer_context_t *)context;
+
+    /* also passes through while temporarily disabled for the device */
+    if (!offload_virtualizer_get_enable_flag(&(virt_ctxt->offload_virt)))
+        return host_fx_process(&context->host_io, &context->config, in, out,
+                               NULL, NULL);
+
+    host_virtualizer_update(&virt_ctxt->host_virt, &virt_ctxt->offload_virt);
+    return host_fx_process(&context->host_io, &context->config, in, out,
+                           host_virtualizer_process, &virt_ctxt->host_virt);
+}
+
 int virtualizer_set_mode(effect_context_t *context, int32_t hw_acc_fd)
 {
     virtualizer_context_t *virt_ctxt = (virtualizer_context_t *)context;
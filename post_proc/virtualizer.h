@@ -39,6 +39,8 @@ typedef struct virtualizer_context_s {
     audio_devices_t forced_device;
     audio_devices_t device;
     struct virtualizer_params offload_virt;
+
+    struct host_virtualizer host_virt;
 } virtualizer_context_t;
 
 int virtualizer_get_parameter(effect_context_t *context, effect_param_t *p,
@@ -63,4 +65,7 @@ int virtualizer_start(effect_context_t *context, output_context_t *output);
 
 int virtualizer_stop(effect_context_t *context, output_context_t *output);
 
+int virtualizer_process(effect_context_t *context, audio_buffer_t *in,
+                        audio_buffer_t *out);
+
 #endif /* OFFLOAD_VIRTUALIZER_H_ */
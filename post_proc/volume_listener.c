@@ -33,16 +33,23 @@
 //#define LOG_NDEBUG 0
 #include <stdlib.h>
 #include <dlfcn.h>
+#include <inttypes.h>
 #include <math.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <time.h>
 
+#include <cutils/atomic.h>
 #include <cutils/list.h>
 #include <log/log.h>
 #include <hardware/audio_effect.h>
 #include <cutils/properties.h>
 #include <platform_api.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #ifdef __LP64__
 #define PRIMARY_HAL_PATH XSTR(LIB64_AUDIO_HAL)
 #else
@@ -72,6 +79,11 @@
 #define AHAL_GAIN_GET_MAPPING_TABLE "audio_hw_get_gain_level_mapping"
 #define DEFAULT_CAL_STEP 0
 
+/* coalescing window for gain dep cal updates, and retry policy on failure */
+#define DEFAULT_GAIN_DEP_CAL_DEBOUNCE_MS 50
+#define GAIN_DEP_CAL_RETRY_MS 100
+#define GAIN_DEP_CAL_MAX_RETRIES 3
+
 #ifdef AUDIO_FEATURE_ENABLED_GCOV
 extern void  __gcov_flush();
 static void enable_gcov()
@@ -90,6 +102,10 @@ enum {
     VOL_LISTENER_STATE_ACTIVE,
 };
 
+/* process_mode bits, published by the command path for vol_effect_process */
+#define VOL_PROCESS_ACTIVE      (1 << 0)
+#define VOL_PROCESS_ACCUMULATE  (1 << 1)
+
 typedef struct vol_listener_context_s vol_listener_context_t;
 static const struct effect_interface_s effect_interface;
 
@@ -119,6 +135,11 @@ struct vol_listener_context_s {
     uint32_t dev_id;
     float left_vol;
     float right_vol;
+    volatile int32_t process_mode;
+    /* written by the process thread only */
+    uint64_t process_calls;
+    uint64_t process_frames;
+    uint64_t process_ns;
 };
 
 /* volume listener, music UUID: 08b8b058-0590-11e5-ac71-0025b32654a0 */
@@ -235,6 +256,33 @@ pthread_mutex_t vol_listner_init_lock;
 
 static bool headset_cal_enabled;
 
+/*
+ * Gain dep cal levels are computed under vol_listner_init_lock and handed
+ * to gain_cal_thread, which sends the latest one once the debounce window
+ * expires. Falls back to sending inline if the thread could not be created.
+ */
+static pthread_t gain_cal_thread;
+static pthread_cond_t gain_cal_cond;
+static bool gain_cal_thread_running;
+static int gain_cal_debounce_ms = DEFAULT_GAIN_DEP_CAL_DEBOUNCE_MS;
+static bool gain_cal_pending;
+static int pending_gain_dep_cal_level = -1;
+static float pending_vol;
+/* level being sent with the lock dropped, -1 when no send is in progress */
+static int inflight_gain_dep_cal_level = -1;
+static float inflight_vol;
+/* bumped when the last stream is released and the cal state is reset */
+static uint32_t gain_cal_generation;
+static int gain_cal_retries;
+static struct timespec gain_cal_deadline;
+
+static struct {
+    uint32_t requests;
+    uint32_t sends;
+    uint32_t avoided;
+    uint32_t failures;
+} gain_cal_stats;
+
 /*
  *  Local functions
  */
@@ -278,18 +326,165 @@ static void dump_list_l()
     ALOGW("DUMP_END :: ===========");
 }
 
+static int get_gain_dep_cal_level(float new_vol)
+{
+    int gain_dep_cal_level = -1;
+    int max_level = 0;
+
+    if (new_vol >= 1 && total_volume_cal_step > 0) { // max amplitude, use highest DRC level
+        gain_dep_cal_level = volume_curve_gain_mapping_table[total_volume_cal_step - 1].level;
+    } else if (new_vol == -1) {
+        gain_dep_cal_level = DEFAULT_CAL_STEP;
+    } else if (new_vol == 0) {
+        gain_dep_cal_level = volume_curve_gain_mapping_table[0].level;
+    } else {
+        for (max_level = 0; max_level + 1 < total_volume_cal_step; max_level++) {
+            if (new_vol < volume_curve_gain_mapping_table[max_level + 1].amp &&
+                new_vol >= volume_curve_gain_mapping_table[max_level].amp) {
+                gain_dep_cal_level = volume_curve_gain_mapping_table[max_level].level;
+                ALOGV("%s: volume(%f), gain dep cal selcetd %d ",
+                      __func__, new_vol, gain_dep_cal_level);
+                break;
+            }
+        }
+    }
+    return gain_dep_cal_level;
+}
+
+/* volume of the newest level requested, queued, in flight or applied */
+static float latest_vol_l()
+{
+    if (gain_cal_pending)
+        return pending_vol;
+    if (inflight_gain_dep_cal_level != -1)
+        return inflight_vol;
+    return current_vol;
+}
+
+static void set_latest_vol_l(float vol)
+{
+    if (gain_cal_pending)
+        pending_vol = vol;
+    else if (inflight_gain_dep_cal_level != -1)
+        inflight_vol = vol;
+    else
+        current_vol = vol;
+}
+
+/* must be called with vol_listner_init_lock held */
+static void schedule_gain_dep_cal_l(int delay_ms)
+{
+    if (gain_cal_pending)
+        return;
+
+    /* window opens with the first request, bounding its latency */
+    clock_gettime(CLOCK_MONOTONIC, &gain_cal_deadline);
+    gain_cal_deadline.tv_sec += delay_ms / 1000;
+    gain_cal_deadline.tv_nsec += (delay_ms % 1000) * 1000000L;
+    if (gain_cal_deadline.tv_nsec >= 1000000000L) {
+        gain_cal_deadline.tv_sec++;
+        gain_cal_deadline.tv_nsec -= 1000000000L;
+    }
+    gain_cal_pending = true;
+    pthread_cond_signal(&gain_cal_cond);
+}
+
+/*
+ * Sends the pending level with vol_listner_init_lock dropped, the HAL takes
+ * its own locks and may block on the DSP. Must be called with the lock held.
+ */
+static void send_pending_gain_dep_cal_l()
+{
+    int gain_dep_cal_level = pending_gain_dep_cal_level;
+    float new_vol;
+    uint32_t generation = gain_cal_generation;
+    bool sent;
+
+    gain_cal_pending = false;
+    gain_cal_stats.sends++;
+    inflight_gain_dep_cal_level = gain_dep_cal_level;
+    inflight_vol = pending_vol;
+    if (gain_cal_thread_running)
+        pthread_mutex_unlock(&vol_listner_init_lock);
+    sent = send_gain_dep_cal(gain_dep_cal_level);
+    if (gain_cal_thread_running)
+        pthread_mutex_lock(&vol_listner_init_lock);
+
+    if (generation != gain_cal_generation) {
+        // all streams were released while sending, the state was reset
+        ALOGV("%s: level %d sent across a reset, dropped", __func__,
+              gain_dep_cal_level);
+        return;
+    }
+    // requests made while sending may have updated the volume of this level
+    new_vol = inflight_vol;
+    inflight_gain_dep_cal_level = -1;
+
+    if (sent) {
+        // Success in setting the gain dep cal level, store new level and Volume
+        if (dumping_enabled) {
+            ALOGW("%s: (old/new) Volume (%f/%f) (old/new) level (%d/%d)",
+                  __func__, current_vol, new_vol, current_gain_dep_cal_level,
+                  gain_dep_cal_level);
+        } else {
+            ALOGV("%s: Change in Cal::(old/new) Volume (%f/%f) (old/new) level (%d/%d)",
+                  __func__, current_vol, new_vol, current_gain_dep_cal_level,
+                  gain_dep_cal_level);
+        }
+        current_gain_dep_cal_level = gain_dep_cal_level;
+        current_vol = new_vol;
+        gain_cal_retries = 0;
+        return;
+    }
+
+    ALOGE("%s: Failed to set gain dep cal level", __func__);
+    gain_cal_stats.failures++;
+    // a newer level was requested while sending, it replaces the retry
+    if (gain_cal_pending || !gain_cal_thread_running)
+        return;
+    if (gain_cal_retries++ < GAIN_DEP_CAL_MAX_RETRIES) {
+        pending_gain_dep_cal_level = gain_dep_cal_level;
+        pending_vol = new_vol;
+        schedule_gain_dep_cal_l(GAIN_DEP_CAL_RETRY_MS);
+    } else {
+        // the HAL applies the last requested level when the next stream starts
+        ALOGE("%s: giving up on level %d after %d retries", __func__,
+              gain_dep_cal_level, GAIN_DEP_CAL_MAX_RETRIES);
+        gain_cal_retries = 0;
+    }
+}
+
+static void *gain_cal_thread_loop(void *arg __unused)
+{
+    pthread_mutex_lock(&vol_listner_init_lock);
+    for (;;) {
+        if (!gain_cal_pending) {
+            pthread_cond_wait(&gain_cal_cond, &vol_listner_init_lock);
+            continue;
+        }
+        if (pthread_cond_timedwait(&gain_cal_cond, &vol_listner_init_lock,
+                                   &gain_cal_deadline) != ETIMEDOUT)
+            continue;
+        if (gain_cal_pending)
+            send_pending_gain_dep_cal_l();
+    }
+    pthread_mutex_unlock(&vol_listner_init_lock);
+    return NULL;
+}
+
 static void check_and_set_gain_dep_cal()
 {
     // iterate through list and make decision to set new gain dep cal level for speaker device
     // 1. find all usecase active on speaker
     // 2. find energy sum for each usecase
     // 3. find the highest of all the active usecase
-    // 4. if new value is different than the current value then load new calibration
+    // 4. if new value is different than the latest requested level then
+    //    queue it for gain_cal_thread
 
     struct listnode *node = NULL;
     float new_vol = -1.0, sum_energy = 0.0, temp_vol = 0.0;
     bool sum_energy_used = false;
-    int max_level = 0;
+    int gain_dep_cal_level, target_level, sent_level;
     vol_listener_context_t *context = NULL;
     if (dumping_enabled) {
         dump_list_l();
@@ -312,71 +507,62 @@ static void check_and_set_gain_dep_cal()
         new_vol = fmin(sqrt(sum_energy), 1.0);
     }
 
-    if (new_vol != current_vol) {
-        ALOGV("%s:: Change in decision :: current volume is %f new volume is %f",
-              __func__, current_vol, new_vol);
+    if (new_vol == latest_vol_l()) {
+        ALOGV("%s:: volume not changed, stick to same config ..... ", __func__);
+        return;
+    }
 
-        if (send_gain_dep_cal != NULL) {
-            // send Gain dep cal level
-            int gain_dep_cal_level = -1;
+    ALOGV("%s:: Change in decision :: current volume is %f new volume is %f",
+          __func__, current_vol, new_vol);
+    if (send_gain_dep_cal == NULL) {
+        ALOGE("%s: not able to send calibration, NULL function pointer",
+              __func__);
+        return;
+    }
 
-            if (new_vol >= 1 && total_volume_cal_step > 0) { // max amplitude, use highest DRC level
-                gain_dep_cal_level = volume_curve_gain_mapping_table[total_volume_cal_step - 1].level;
-            } else if (new_vol == -1) {
-                gain_dep_cal_level = DEFAULT_CAL_STEP;
-            } else if (new_vol == 0) {
-                gain_dep_cal_level = volume_curve_gain_mapping_table[0].level;
-            } else {
-                for (max_level = 0; max_level + 1 < total_volume_cal_step; max_level++) {
-                    if (new_vol < volume_curve_gain_mapping_table[max_level + 1].amp &&
-                        new_vol >= volume_curve_gain_mapping_table[max_level].amp) {
-                        gain_dep_cal_level = volume_curve_gain_mapping_table[max_level].level;
-                        ALOGV("%s: volume(%f), gain dep cal selcetd %d ",
-                              __func__, current_vol, gain_dep_cal_level);
-                        break;
-                    }
-                }
-            }
+    gain_dep_cal_level = get_gain_dep_cal_level(new_vol);
+    if (gain_dep_cal_level == -1) {
+        ALOGW("%s: Failed to find gain dep cal level for volume %f", __func__, new_vol);
+        return;
+    }
 
-            // check here if previous gain dep cal level was not same
-            if (gain_dep_cal_level != -1) {
-                if (gain_dep_cal_level != current_gain_dep_cal_level) {
-                    // decision made .. send new level now
-                    if (!send_gain_dep_cal(gain_dep_cal_level)) {
-                        ALOGE("%s: Failed to set gain dep cal level", __func__);
-                    } else {
-                        // Success in setting the gain dep cal level, store new level and Volume
-                        if (dumping_enabled) {
-                            ALOGW("%s: (old/new) Volume (%f/%f) (old/new) level (%d/%d)",
-                                  __func__, current_vol, new_vol, current_gain_dep_cal_level,
-                                  gain_dep_cal_level);
-                        } else {
-                            ALOGV("%s: Change in Cal::(old/new) Volume (%f/%f) (old/new) level (%d/%d)",
-                                  __func__, current_vol, new_vol, current_gain_dep_cal_level,
-                                  gain_dep_cal_level);
-                        }
-                        current_gain_dep_cal_level = gain_dep_cal_level;
-                        current_vol = new_vol;
-                    }
-                } else {
-                    if (dumping_enabled) {
-                        ALOGW("%s: volume changed but gain dep cal level is still the same: (old/new) Volume (%f/%f) (old/new) level (%d)",
-                              __func__,current_vol, new_vol, current_gain_dep_cal_level);
-                    } else {
-                        ALOGV("%s: volume changed but gain dep cal level is still the same",
-                              __func__);
-                    }
-                }
-            } else {
-                ALOGW("%s: Failed to find gain dep cal level for volume %f", __func__, new_vol);
-            }
+    gain_cal_stats.requests++;
+    sent_level = inflight_gain_dep_cal_level != -1 ?
+            inflight_gain_dep_cal_level : current_gain_dep_cal_level;
+    target_level = gain_cal_pending ? pending_gain_dep_cal_level : sent_level;
+    if (gain_dep_cal_level == target_level) {
+        if (dumping_enabled) {
+            ALOGW("%s: volume changed but gain dep cal level is still the same: (old/new) Volume (%f/%f) (old/new) level (%d)",
+                  __func__, current_vol, new_vol, current_gain_dep_cal_level);
         } else {
-            ALOGE("%s: not able to send calibration, NULL function pointer",
+            ALOGV("%s: volume changed but gain dep cal level is still the same",
                   __func__);
         }
-    } else {
-        ALOGV("%s:: volume not changed, stick to same config ..... ", __func__);
+        set_latest_vol_l(new_vol);
+        gain_cal_stats.avoided++;
+        return;
+    }
+
+    if (gain_cal_pending) {
+        // replaces the queued level before it was sent
+        gain_cal_stats.avoided++;
+        if (gain_dep_cal_level == sent_level) {
+            // back at the level the DSP has or is being sent
+            gain_cal_pending = false;
+            gain_cal_retries = 0;
+            set_latest_vol_l(new_vol);
+            return;
+        }
+    }
+    pending_gain_dep_cal_level = gain_dep_cal_level;
+    pending_vol = new_vol;
+    gain_cal_retries = 0;
+
+    if (!gain_cal_thread_running) {
+        send_pending_gain_dep_cal_l();
+        return;
     }
+    schedule_gain_dep_cal_l(gain_cal_debounce_ms);
 
     ALOGV("check_and_set_gain_dep_cal ==> End ");
 }
@@ -392,40 +578,76 @@ static inline int16_t clamp16(int32_t sample)
     return sample;
 }
 
+static inline int64_t vol_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void accumulate16(int16_t *out, const int16_t *in, size_t samples)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    for (; i + 16 <= samples; i += 16) {
+        vst1q_s16(out + i, vqaddq_s16(vld1q_s16(out + i), vld1q_s16(in + i)));
+        vst1q_s16(out + i + 8, vqaddq_s16(vld1q_s16(out + i + 8),
+                                          vld1q_s16(in + i + 8)));
+    }
+#endif
+    for (; i < samples; i++)
+        out[i] = clamp16(out[i] + in[i]);
+}
+
+/* must be called with vol_listner_init_lock held */
+static void publish_process_mode_l(vol_listener_context_t *context)
+{
+    int32_t mode = 0;
+
+    if (context->state == VOL_LISTENER_STATE_ACTIVE)
+        mode |= VOL_PROCESS_ACTIVE;
+    if (context->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE)
+        mode |= VOL_PROCESS_ACCUMULATE;
+    android_atomic_release_store(mode, &context->process_mode);
+}
+
+/*
+ * Runs on the playback thread without vol_listner_init_lock, the command
+ * path publishes everything needed here through process_mode.
+ */
 static int vol_effect_process(effect_handle_t self,
                               audio_buffer_t *in_buffer,
                               audio_buffer_t *out_buffer)
 {
-    int status = 0;
-    ALOGV("%s Called ", __func__);
-
     vol_listener_context_t *context = (vol_listener_context_t *)self;
-    pthread_mutex_lock(&vol_listner_init_lock);
+    int32_t mode;
+    int64_t start_ns;
+
+    ALOGV("%s Called ", __func__);
 
-    if (context->state != VOL_LISTENER_STATE_ACTIVE) {
+    mode = android_atomic_acquire_load(&context->process_mode);
+    if (!(mode & VOL_PROCESS_ACTIVE)) {
         ALOGE("%s: state is not active .. return error", __func__);
-        status = -EINVAL;
-        goto exit;
+        return -EINVAL;
     }
 
-    // calculation based on channel count 2
-    if (in_buffer->raw != out_buffer->raw) {
-        if (context->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
-            size_t i;
-            for (i = 0; i < out_buffer->frameCount*2; i++) {
-                out_buffer->s16[i] = clamp16(out_buffer->s16[i] + in_buffer->s16[i]);
-            }
-        } else {
-            memcpy(out_buffer->raw, in_buffer->raw, out_buffer->frameCount * 2 * sizeof(int16_t));
-        }
-    } else {
-        ALOGV("%s: something wrong, didn't handle in_buffer and out_buffer same address case",
-              __func__);
-    }
+    // in place the buffer already holds the output
+    if (in_buffer->raw == out_buffer->raw)
+        return 0;
 
-exit:
-    pthread_mutex_unlock(&vol_listner_init_lock);
-    return status;
+    start_ns = vol_now_ns();
+    // calculation based on channel count 2
+    if (mode & VOL_PROCESS_ACCUMULATE)
+        accumulate16(out_buffer->s16, in_buffer->s16, out_buffer->frameCount * 2);
+    else
+        memcpy(out_buffer->raw, in_buffer->raw, out_buffer->frameCount * 2 * sizeof(int16_t));
+
+    context->process_ns += vol_now_ns() - start_ns;
+    context->process_frames += out_buffer->frameCount;
+    context->process_calls++;
+    return 0;
 }
 
 
@@ -470,6 +692,7 @@ static int vol_effect_command(effect_handle_t self,
             goto exit;
         }
         context->config = *(effect_config_t *)p_cmd_data;
+        publish_process_mode_l(context);
         *(int *)p_reply_data = 0;
         break;
 
@@ -515,6 +738,7 @@ static int vol_effect_command(effect_handle_t self,
         }
 
         context->state = VOL_LISTENER_STATE_ACTIVE;
+        publish_process_mode_l(context);
         *(int *)p_reply_data = 0;
 
         // After changing the state and if device is speaker
@@ -542,6 +766,7 @@ static int vol_effect_command(effect_handle_t self,
         }
 
         context->state = VOL_LISTENER_STATE_INITIALIZED;
+        publish_process_mode_l(context);
         *(int *)p_reply_data = 0;
 
         // After changing the state and if device is speaker
@@ -725,6 +950,25 @@ static void init_once()
     headset_cal_enabled = property_get_bool(
                             "vendor.audio.volume.headset.gain.depcal", false);
 
+    gain_cal_debounce_ms = property_get_int32(
+                            "vendor.audio.volume.listener.cal_debounce_ms",
+                            DEFAULT_GAIN_DEP_CAL_DEBOUNCE_MS);
+    if (gain_cal_debounce_ms < 0)
+        gain_cal_debounce_ms = 0;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&gain_cal_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&gain_cal_thread, NULL, gain_cal_thread_loop, NULL)) {
+        ALOGE("%s: failed to create gain dep cal thread, sending inline",
+              __func__);
+    } else {
+        pthread_detach(gain_cal_thread);
+        gain_cal_thread_running = true;
+    }
+
     init_status = 0;
     list_init(&vol_effect_list);
     initialized = true;
@@ -825,6 +1069,12 @@ static int vol_prc_lib_release(effect_handle_t handle)
             if (verify_context(context)) {
                 recompute_flag = true;
             }
+            if (context->process_calls)
+                ALOGD("%s: stream %d processed %" PRIu64 " buffers, %" PRIu64
+                      " frames, avg %" PRIu64 " ns per buffer", __func__,
+                      context->stream_type, context->process_calls,
+                      context->process_frames,
+                      context->process_ns / context->process_calls);
             list_remove(&context->effect_list_node);
             free(context);
             status = 0;
@@ -842,8 +1092,15 @@ static int vol_prc_lib_release(effect_handle_t handle)
 
     // if there are no active streams, reset cal and volume level
     if (active_stream_count == 0) {
+        ALOGD("%s: gain dep cal requests %u sends %u avoided %u failures %u",
+              __func__, gain_cal_stats.requests, gain_cal_stats.sends,
+              gain_cal_stats.avoided, gain_cal_stats.failures);
         current_gain_dep_cal_level = -1;
         current_vol = 0.0;
+        gain_cal_pending = false;
+        gain_cal_retries = 0;
+        inflight_gain_dep_cal_level = -1;
+        gain_cal_generation++;
     }
 
     if (recompute_flag) {
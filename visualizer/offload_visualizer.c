@@ -18,6 +18,7 @@
 #define LOG_TAG "offload_visualizer"
 /*#define LOG_NDEBUG 0*/
 #include <assert.h>
+#include <inttypes.h>
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
@@ -27,12 +28,17 @@
 #include <pthread.h>
 #include <unistd.h>
 
+#include <cutils/atomic.h>
 #include <cutils/list.h>
 #include <log/log.h>
 #include <system/thread_defs.h>
 #include <tinyalsa/asoundlib.h>
 #include <audio_effects/effect_visualizer.h>
 
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 #define LIB_ACDB_LOADER "libacdbloader.so"
 #define ACDB_DEV_TYPE_OUT 1
 #define AFE_PROXY_ACDB_ID 45
@@ -114,6 +120,37 @@ typedef struct output_context_s {
 
 #define CAPTURE_BUF_SIZE 65536 /* "64k should be enough for everyone" */
 
+/* Proxy port supports only MMAP read and those fixed parameters*/
+#define AUDIO_CAPTURE_CHANNEL_COUNT 2
+#define AUDIO_CAPTURE_SMP_RATE 48000
+#define AUDIO_CAPTURE_PERIOD_SIZE (768)
+#define AUDIO_CAPTURE_PERIOD_COUNT 32
+
+#define CAPTURE_PERIOD_SAMPLES (AUDIO_CAPTURE_PERIOD_SIZE * AUDIO_CAPTURE_CHANNEL_COUNT)
+
+/* number of captured periods kept for the effects, about half a second */
+#define CAPTURE_RING_PERIODS 32
+
+#define CAPTURE_PERIOD_MS (AUDIO_CAPTURE_PERIOD_SIZE * 1000 / AUDIO_CAPTURE_SMP_RATE)
+/* longest sleep between proxy reads, well within the AUDIO_CAPTURE_PERIOD_COUNT periods the
+ * kernel buffers */
+#define CAPTURE_MAX_WAKE_INTERVAL_MS 200
+/* polls further apart than this are treated as an idle client */
+#define CAPTURE_MAX_POLL_INTERVAL_MS 1000
+
+typedef struct capture_period_s {
+    int16_t data[CAPTURE_PERIOD_SAMPLES];
+    struct timespec time; /* when the period was read */
+} capture_period_t;
+
+/* Written by the capture thread only and without lock. write_seq counts the published periods,
+ * period n is in periods[n % CAPTURE_RING_PERIODS]. Readers copy a period out and then check
+ * that it was not lapped while copying. */
+typedef struct capture_ring_s {
+    volatile int32_t write_seq;
+    capture_period_t periods[CAPTURE_RING_PERIODS];
+} capture_ring_t;
+
 #define DISCARD_MEASUREMENTS_TIME_MS 2000 /* discard measurements older than this number of ms */
 
 /* maximum number of buffers for which we keep track of the measurements */
@@ -141,6 +178,16 @@ typedef struct visualizer_context_s {
     uint8_t meas_wndw_size_in_buffers;
     uint8_t meas_buffer_idx;
     buffer_stats_t past_meas[MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS];
+    /* next capture ring period to consume and where it is copied to */
+    uint32_t read_seq;
+    int16_t period_buf[CAPTURE_PERIOD_SAMPLES];
+    /* how often the client asks for capture data, 0 until known */
+    int64_t last_poll_ns;
+    uint32_t poll_interval_ms;
+    /* cost of visualizer_process() */
+    uint32_t process_calls;
+    uint64_t process_frames;
+    uint64_t process_ns;
 } visualizer_context_t;
 
 
@@ -174,9 +221,10 @@ struct listnode created_effects_list;
  * and visualizer_hal_stop_output() */
 struct listnode active_outputs_list;
 
-/* thread capturing PCM from Proxy port and calling the process function on each enabled effect
- * attached to an active output stream */
+/* thread capturing PCM from Proxy port into capture_ring. Effects attached to an active output
+ * stream consume the ring when a command needs their capture data */
 pthread_t capture_thread;
+capture_ring_t *capture_ring;
 /* lock must be held when modifying or accessing created_effects_list or active_outputs_list */
 pthread_mutex_t lock;
 /* thread_lock must be held when starting or stopping the capture thread.
@@ -185,6 +233,36 @@ pthread_mutex_t thread_lock;
 /* cond is signaled when an output is started or stopped or an effect is enabled or disable: the
  * capture thread will reevaluate the capture and effect rocess conditions. */
 pthread_cond_t cond;
+/* incremented whenever cond is signaled: the capture thread keeps reading without lock as long
+ * as it does not change */
+volatile int32_t capture_gen;
+
+/* What the consumers need from the capture thread. The capture thread only ever takes
+ * demand_lock, which it also sleeps on between batched reads.
+ * Locking order: lock -> demand_lock */
+typedef struct capture_demand_s {
+    bool continuous; /* some consumer needs every period or its poll rate is not known yet */
+    uint32_t poll_interval_ms; /* shortest polling interval of the consumers */
+    int64_t last_poll_ns; /* most recent poll of any consumer */
+} capture_demand_t;
+
+pthread_mutex_t demand_lock;
+pthread_cond_t demand_cond;
+capture_demand_t capture_demand;
+
+enum capture_mode {
+    CAPTURE_MODE_CONTINUOUS,
+    CAPTURE_MODE_BATCHED,
+    CAPTURE_MODE_CNT
+};
+
+/* wakeup and CPU accounting of the capture thread in each mode */
+typedef struct capture_stats_s {
+    uint32_t wakeups;
+    uint32_t periods;
+    int64_t wall_ns;
+    int64_t cpu_ns;
+} capture_stats_t;
 /* true when requesting the capture thread to exit */
 bool exit_thread;
 /* 0 if the capture thread was created successfully */
@@ -199,12 +277,6 @@ int thread_status;
 #define CAPTURE_DEVICE 7
 #endif
 
-/* Proxy port supports only MMAP read and those fixed parameters*/
-#define AUDIO_CAPTURE_CHANNEL_COUNT 2
-#define AUDIO_CAPTURE_SMP_RATE 48000
-#define AUDIO_CAPTURE_PERIOD_SIZE (768)
-#define AUDIO_CAPTURE_PERIOD_COUNT 32
-
 struct pcm_config pcm_config_capture = {
     .channels = AUDIO_CAPTURE_CHANNEL_COUNT,
     .rate = AUDIO_CAPTURE_SMP_RATE,
@@ -222,15 +294,30 @@ struct pcm_config pcm_config_capture = {
  */
 
 static void init_once() {
+    pthread_condattr_t attr;
+
     list_init(&created_effects_list);
     list_init(&active_outputs_list);
 
     pthread_mutex_init(&lock, NULL);
     pthread_mutex_init(&thread_lock, NULL);
     pthread_cond_init(&cond, NULL);
+    pthread_mutex_init(&demand_lock, NULL);
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&demand_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    capture_demand.continuous = true;
     exit_thread = false;
     thread_status = -1;
 
+    capture_ring = (capture_ring_t *)calloc(1, sizeof(capture_ring_t));
+    if (capture_ring == NULL) {
+        ALOGE("%s fail to allocate capture ring", __func__);
+        init_status = -ENOMEM;
+        return;
+    }
+
     init_status = 0;
 }
 
@@ -299,6 +386,87 @@ void remove_effect_from_output(output_context_t * output, effect_context_t *cont
     }
 }
 
+static inline int64_t visualizer_now_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Recomputes capture_demand from the enabled visualizers on active outputs. Must be called
+ * with lock held */
+static void update_capture_demand_l() {
+    struct listnode *node;
+    bool continuous = false;
+    uint32_t poll_interval_ms = 0;
+    int64_t last_poll_ns = 0;
+
+    list_for_each(node, &created_effects_list) {
+        visualizer_context_t *visu_ctxt = node_to_item(node, visualizer_context_t,
+                                                       common.effects_list_node);
+        effect_context_t *context = &visu_ctxt->common;
+
+        if (context->state != EFFECT_STATE_ACTIVE || get_output(context->out_handle) == NULL)
+            continue;
+        if ((visu_ctxt->meas_mode & MEASUREMENT_MODE_PEAK_RMS) ||
+                visu_ctxt->poll_interval_ms == 0)
+            continuous = true;
+        if (poll_interval_ms == 0 || visu_ctxt->poll_interval_ms < poll_interval_ms)
+            poll_interval_ms = visu_ctxt->poll_interval_ms;
+        if (visu_ctxt->last_poll_ns > last_poll_ns)
+            last_poll_ns = visu_ctxt->last_poll_ns;
+    }
+
+    pthread_mutex_lock(&demand_lock);
+    /* wake a batching capture thread early if consumers now want data sooner */
+    if ((continuous && !capture_demand.continuous) ||
+            poll_interval_ms < capture_demand.poll_interval_ms)
+        pthread_cond_signal(&demand_cond);
+    capture_demand.continuous = continuous;
+    capture_demand.poll_interval_ms = poll_interval_ms;
+    capture_demand.last_poll_ns = last_poll_ns;
+    pthread_mutex_unlock(&demand_lock);
+}
+
+/* must be called with lock held */
+static void signal_capture_thread_l() {
+    android_atomic_inc(&capture_gen);
+    pthread_cond_signal(&cond);
+    update_capture_demand_l();
+    pthread_mutex_lock(&demand_lock);
+    pthread_cond_signal(&demand_cond);
+    pthread_mutex_unlock(&demand_lock);
+}
+
+/* How long the capture thread may sleep before its next batch of reads, 0 to read period by
+ * period. Half the polling interval keeps the latest window at most half a poll old, and a
+ * client that stopped polling stretches it up to CAPTURE_MAX_WAKE_INTERVAL_MS. Must be called
+ * with demand_lock held */
+static uint32_t capture_wake_interval_ms_l(int64_t now_ns) {
+    int64_t idle_ms;
+    uint32_t interval_ms;
+
+    if (capture_demand.continuous || capture_demand.poll_interval_ms == 0)
+        return 0;
+    interval_ms = capture_demand.poll_interval_ms;
+    idle_ms = (now_ns - capture_demand.last_poll_ns) / 1000000;
+    if (idle_ms > interval_ms)
+        interval_ms = idle_ms > CAPTURE_MAX_POLL_INTERVAL_MS ?
+                CAPTURE_MAX_POLL_INTERVAL_MS : (uint32_t)idle_ms;
+    interval_ms /= 2;
+    if (interval_ms > CAPTURE_MAX_WAKE_INTERVAL_MS)
+        interval_ms = CAPTURE_MAX_WAKE_INTERVAL_MS;
+    return interval_ms <= CAPTURE_PERIOD_MS ? 0 : interval_ms;
+}
+
+static int64_t capture_thread_cpu_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
 bool effects_enabled() {
     struct listnode *out_node;
 
@@ -449,10 +617,7 @@ int parse_pcm_device(char *descriptor, int param)
 
 void *capture_thread_loop(void *arg)
 {
-    int16_t data[AUDIO_CAPTURE_PERIOD_SIZE * AUDIO_CAPTURE_CHANNEL_COUNT * sizeof(int16_t)];
-    audio_buffer_t buf;
-    buf.frameCount = AUDIO_CAPTURE_PERIOD_SIZE;
-    buf.s16 = data;
+    capture_period_t *period;
     bool capture_enabled = false;
     struct mixer *mixer;
     struct pcm *pcm = NULL;
@@ -460,8 +625,17 @@ void *capture_thread_loop(void *arg)
     int retry_num = 0;
     int sound_card = SOUND_CARD;
     int capture_device = CAPTURE_DEVICE;
+    int32_t gen;
+    uint32_t seq;
+    capture_stats_t stats[CAPTURE_MODE_CNT];
+    const char *mode_names[CAPTURE_MODE_CNT] = { "continuous", "batched" };
+    uint32_t interval_ms;
+    int periods;
+    int mode;
+    int i;
 
     ALOGD("thread enter");
+    memset(stats, 0, sizeof(stats));
 
     prctl(PR_SET_NAME, (unsigned long)"visualizer capture", 0, 0, 0);
 
@@ -478,7 +652,11 @@ void *capture_thread_loop(void *arg)
         return NULL;
     }
 
+    /* readers ahead of the restarted ring resync on their next command */
+    android_atomic_release_store(0, &capture_ring->write_seq);
+
     for (;;) {
+        gen = capture_gen;
         if (exit_thread) {
             break;
         }
@@ -517,30 +695,54 @@ void *capture_thread_loop(void *arg)
         if (!capture_enabled)
             continue;
 
+        /* read straight into the ring until an output or effect changes state */
         pthread_mutex_unlock(&lock);
-        ret = pcm_mmap_read(pcm, data, sizeof(data));
-        pthread_mutex_lock(&lock);
+        do {
+            int64_t start_ns = visualizer_now_ns();
+            int64_t start_cpu_ns = capture_thread_cpu_ns();
+
+            /* when the consumers only poll now and then, sleep and catch up in one batch */
+            pthread_mutex_lock(&demand_lock);
+            interval_ms = capture_wake_interval_ms_l(start_ns);
+            if (interval_ms && android_atomic_acquire_load(&capture_gen) == gen) {
+                struct timespec deadline;
+                int64_t deadline_ns = start_ns + interval_ms * 1000000LL;
+
+                deadline.tv_sec = deadline_ns / 1000000000LL;
+                deadline.tv_nsec = deadline_ns % 1000000000LL;
+                pthread_cond_timedwait(&demand_cond, &demand_lock, &deadline);
+            }
+            pthread_mutex_unlock(&demand_lock);
+
+            mode = interval_ms ? CAPTURE_MODE_BATCHED : CAPTURE_MODE_CONTINUOUS;
+            periods = 1;
+            if (interval_ms) {
+                ret = pcm_mmap_avail(pcm);
+                if (ret > AUDIO_CAPTURE_PERIOD_SIZE)
+                    periods = ret / AUDIO_CAPTURE_PERIOD_SIZE;
+            }
 
-        if (ret == 0) {
-            struct listnode *out_node;
-
-            list_for_each(out_node, &active_outputs_list) {
-                output_context_t *out_ctxt = node_to_item(out_node,
-                                                          output_context_t,
-                                                          outputs_list_node);
-                struct listnode *fx_node;
-
-                list_for_each(fx_node, &out_ctxt->effects_list) {
-                    effect_context_t *fx_ctxt = node_to_item(fx_node,
-                                                                effect_context_t,
-                                                                output_node);
-                    if (fx_ctxt->ops.process != NULL)
-                        fx_ctxt->ops.process(fx_ctxt, &buf, &buf);
+            for (i = 0; i < periods; i++) {
+                seq = (uint32_t)capture_ring->write_seq;
+                period = &capture_ring->periods[seq % CAPTURE_RING_PERIODS];
+                ret = pcm_mmap_read(pcm, period->data, sizeof(period->data));
+                if (ret == 0) {
+                    clock_gettime(CLOCK_MONOTONIC, &period->time);
+                    android_atomic_release_store((int32_t)(seq + 1), &capture_ring->write_seq);
+                    /* keep the writes of the next period after this publication */
+                    android_memory_barrier();
+                    stats[mode].periods++;
+                } else {
+                    ALOGW("%s: read status %d %s", __func__, ret, pcm_get_error(pcm));
+                    break;
                 }
             }
-        } else {
-            ALOGW("%s: read status %d %s", __func__, ret, pcm_get_error(pcm));
-        }
+
+            stats[mode].wakeups++;
+            stats[mode].wall_ns += visualizer_now_ns() - start_ns;
+            stats[mode].cpu_ns += capture_thread_cpu_ns() - start_cpu_ns;
+        } while (android_atomic_acquire_load(&capture_gen) == gen);
+        pthread_mutex_lock(&lock);
     }
 
     if (capture_enabled) {
@@ -551,6 +753,16 @@ void *capture_thread_loop(void *arg)
     mixer_close(mixer);
     pthread_mutex_unlock(&lock);
 
+    for (i = 0; i < CAPTURE_MODE_CNT; i++) {
+        if (stats[i].wall_ns <= 0)
+            continue;
+        ALOGD("%s: %s capture %" PRId64 " ms, %u periods, %" PRId64 " wakeups/s, cpu %" PRId64
+              ".%02" PRId64 "%%", __func__, mode_names[i], stats[i].wall_ns / 1000000,
+              stats[i].periods, stats[i].wakeups * 1000000000LL / stats[i].wall_ns,
+              stats[i].cpu_ns * 100 / stats[i].wall_ns,
+              stats[i].cpu_ns * 10000 / stats[i].wall_ns % 100);
+    }
+
     ALOGD("thread exit");
 
     return NULL;
@@ -603,7 +815,7 @@ int visualizer_hal_start_output(audio_io_handle_t output, int pcm_id) {
                         capture_thread_loop, NULL);
     }
     list_add_tail(&active_outputs_list, &out_ctxt->outputs_list_node);
-    pthread_cond_signal(&cond);
+    signal_capture_thread_l();
 
 exit:
     pthread_mutex_unlock(&lock);
@@ -640,12 +852,12 @@ int visualizer_hal_stop_output(audio_io_handle_t output, int pcm_id) {
             fx_ctxt->ops.stop(fx_ctxt, out_ctxt);
     }
     list_remove(&out_ctxt->outputs_list_node);
-    pthread_cond_signal(&cond);
+    signal_capture_thread_l();
 
     if (list_empty(&active_outputs_list)) {
         if (thread_status == 0) {
             exit_thread = true;
-            pthread_cond_signal(&cond);
+            signal_capture_thread_l();
             pthread_mutex_unlock(&lock);
             pthread_join(capture_thread, (void **) NULL);
             pthread_mutex_lock(&lock);
@@ -722,6 +934,18 @@ int visualizer_reset(effect_context_t *context)
     return 0;
 }
 
+int visualizer_release(effect_context_t *context)
+{
+    visualizer_context_t *visu_ctxt = (visualizer_context_t *)context;
+
+    if (visu_ctxt->process_calls)
+        ALOGD("%s processed %u periods of %d frames, avg %" PRIu64 " ns (%" PRIu64
+              " ns per 100 frames)", __func__, visu_ctxt->process_calls,
+              AUDIO_CAPTURE_PERIOD_SIZE, visu_ctxt->process_ns / visu_ctxt->process_calls,
+              visu_ctxt->process_ns * 100 / visu_ctxt->process_frames);
+    return 0;
+}
+
 int visualizer_init(effect_context_t *context)
 {
     int32_t i;
@@ -836,6 +1060,7 @@ int visualizer_set_parameter(effect_context_t *context, effect_param_t *p, uint3
     case VISUALIZER_PARAM_MEASUREMENT_MODE:
         visu_ctxt->meas_mode = *((uint32_t *)p->data + 1);
         ALOGV("%s set meas_mode = %d", __func__, visu_ctxt->meas_mode);
+        update_capture_demand_l();
         break;
     default:
         return -EINVAL;
@@ -843,7 +1068,106 @@ int visualizer_set_parameter(effect_context_t *context, effect_param_t *p, uint3
     return 0;
 }
 
-/* Real process function called from capture thread. Called with lock held */
+/* Peak of the absolute sample values and sum of their squares */
+static void visualizer_peak_and_energy(const int16_t *in, size_t samples,
+                                       uint16_t *peak, uint64_t *energy)
+{
+    size_t i = 0;
+    uint32_t max_abs = 0;
+    uint64_t sum = 0;
+
+#if defined(__ARM_NEON)
+    uint16x8_t vmax = vdupq_n_u16(0);
+    uint64x2_t vsum = vdupq_n_u64(0);
+    uint16x4_t m;
+
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        int32x4_t sq;
+
+        /* abs of -32768 wraps to itself, which is 32768 read as unsigned */
+        vmax = vmaxq_u16(vmax, vreinterpretq_u16_s16(vabsq_s16(x)));
+        /* two squares add up to at most 2^31, exact as unsigned */
+        sq = vmull_s16(vget_low_s16(x), vget_low_s16(x));
+        sq = vmlal_s16(sq, vget_high_s16(x), vget_high_s16(x));
+        vsum = vpadalq_u32(vsum, vreinterpretq_u32_s32(sq));
+    }
+    m = vmax_u16(vget_low_u16(vmax), vget_high_u16(vmax));
+    m = vpmax_u16(m, m);
+    m = vpmax_u16(m, m);
+    max_abs = vget_lane_u16(m, 0);
+    sum = vgetq_lane_u64(vsum, 0) + vgetq_lane_u64(vsum, 1);
+#endif
+    for (; i < samples; i++) {
+        int32_t smp = in[i];
+        uint32_t abs_smp = smp < 0 ? -smp : smp;
+
+        if (abs_smp > max_abs)
+            max_abs = abs_smp;
+        sum += (uint32_t)(smp * smp);
+    }
+    *peak = (uint16_t)max_abs;
+    *energy = sum;
+}
+
+/* Largest magnitude in the buffer, negative samples counted as -smp - 1 to keep the max
+ * negative in range */
+static uint32_t visualizer_max_magnitude(const int16_t *in, size_t samples)
+{
+    size_t i = 0;
+    int32_t max_mag = 0;
+
+#if defined(__ARM_NEON)
+    int16x8_t vmax = vdupq_n_s16(0);
+    int16x4_t m;
+
+    for (; i + 8 <= samples; i += 8) {
+        int16x8_t x = vld1q_s16(in + i);
+        vmax = vmaxq_s16(vmax, veorq_s16(x, vshrq_n_s16(x, 15)));
+    }
+    m = vpmax_s16(vget_low_s16(vmax), vget_high_s16(vmax));
+    m = vpmax_s16(m, m);
+    m = vpmax_s16(m, m);
+    max_mag = vget_lane_s16(m, 0);
+#endif
+    for (; i < samples; i++) {
+        int32_t smp = in[i];
+        smp ^= smp >> 31;
+        if (smp > max_mag)
+            max_mag = smp;
+    }
+    return max_mag;
+}
+
+/* Sums each stereo frame, scales it down by shift and stores it as offset 8 bit */
+static void visualizer_capture_u8(const int16_t *in, size_t frames, int32_t shift,
+                                  uint8_t *out)
+{
+    size_t i = 0;
+
+#if defined(__ARM_NEON)
+    const int32x4_t vshift = vdupq_n_s32(-shift);
+    const uint8x8_t bias = vdup_n_u8(0x80);
+
+    for (; i + 8 <= frames; i += 8) {
+        int16x8x2_t lr = vld2q_s16(in + 2 * i);
+        int32x4_t lo = vaddl_s16(vget_low_s16(lr.val[0]), vget_low_s16(lr.val[1]));
+        int32x4_t hi = vaddl_s16(vget_high_s16(lr.val[0]), vget_high_s16(lr.val[1]));
+        int16x8_t smp = vcombine_s16(vmovn_s32(vshlq_s32(lo, vshift)),
+                                     vmovn_s32(vshlq_s32(hi, vshift)));
+
+        vst1_u8(out + i, veor_u8(vreinterpret_u8_s8(vmovn_s16(smp)), bias));
+    }
+#endif
+    for (; i < frames; i++) {
+        int32_t smp = in[2 * i] + in[2 * i + 1];
+        smp = smp >> shift;
+        out[i] = ((uint8_t)smp)^0x80;
+    }
+}
+
+/* Real process function, called for each captured period when the effect consumes the
+ * capture ring. Called with lock held */
 int visualizer_process(effect_context_t *context,
                        audio_buffer_t *inBuffer,
                        audio_buffer_t *outBuffer)
@@ -860,24 +1184,20 @@ int visualizer_process(effect_context_t *context,
         return -EINVAL;
     }
 
+    int64_t start_ns = visualizer_now_ns();
+
     // perform measurements if needed
     if (visu_ctxt->meas_mode & MEASUREMENT_MODE_PEAK_RMS) {
         // find the peak and RMS squared for the new buffer
-        uint32_t inIdx;
-        int16_t max_sample = 0;
-        float rms_squared_acc = 0;
-        for (inIdx = 0 ; inIdx < inBuffer->frameCount * visu_ctxt->channel_count ; inIdx++) {
-            if (inBuffer->s16[inIdx] > max_sample) {
-                max_sample = inBuffer->s16[inIdx];
-            } else if (-inBuffer->s16[inIdx] > max_sample) {
-                max_sample = -inBuffer->s16[inIdx];
-            }
-            rms_squared_acc += (inBuffer->s16[inIdx] * inBuffer->s16[inIdx]);
-        }
+        const size_t samples = inBuffer->frameCount * visu_ctxt->channel_count;
+        uint16_t peak_u16;
+        uint64_t energy;
+
+        visualizer_peak_and_energy(inBuffer->s16, samples, &peak_u16, &energy);
         // store the measurement
-        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].peak_u16 = (uint16_t)max_sample;
+        visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].peak_u16 = peak_u16;
         visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].rms_squared =
-                rms_squared_acc / (inBuffer->frameCount * visu_ctxt->channel_count);
+                (float)energy / samples;
         visu_ctxt->past_meas[visu_ctxt->meas_buffer_idx].is_valid = true;
         if (++visu_ctxt->meas_buffer_idx >= visu_ctxt->meas_wndw_size_in_buffers) {
             visu_ctxt->meas_buffer_idx = 0;
@@ -890,15 +1210,9 @@ int visualizer_process(effect_context_t *context,
     if (visu_ctxt->scaling_mode == VISUALIZER_SCALING_MODE_NORMALIZED) {
         /* derive capture scaling factor from peak value in current buffer
          * this gives more interesting captures for display. */
-        shift = 32;
-        int len = inBuffer->frameCount * 2;
-        int i;
-        for (i = 0; i < len; i++) {
-            int32_t smp = inBuffer->s16[i];
-            if (smp < 0) smp = -smp - 1; /* take care to keep the max negative in range */
-            int32_t clz = __builtin_clz(smp);
-            if (shift > clz) shift = clz;
-        }
+        uint32_t max_mag = visualizer_max_magnitude(inBuffer->s16, inBuffer->frameCount * 2);
+
+        shift = max_mag ? __builtin_clz(max_mag) : 32;
         /* A maximum amplitude signal will have 17 leading zeros, which we want to
          * translate to a shift of 8 (for converting 16 bit to 8 bit) */
         shift = 25 - shift;
@@ -914,21 +1228,26 @@ int visualizer_process(effect_context_t *context,
         shift = 9;
     }
 
-    uint32_t capt_idx;
-    uint32_t in_idx;
-    uint8_t *buf = visu_ctxt->capture_buf;
-    for (in_idx = 0, capt_idx = visu_ctxt->capture_idx;
-         in_idx < inBuffer->frameCount;
-         in_idx++, capt_idx++) {
+    uint32_t capt_idx = visu_ctxt->capture_idx;
+    size_t done = 0;
+    while (done < inBuffer->frameCount) {
+        size_t frames = inBuffer->frameCount - done;
         if (capt_idx >= CAPTURE_BUF_SIZE) {
             /* wrap around */
             capt_idx = 0;
         }
-        int32_t smp = inBuffer->s16[2 * in_idx] + inBuffer->s16[2 * in_idx + 1];
-        smp = smp >> shift;
-        buf[capt_idx] = ((uint8_t)smp)^0x80;
+        if (frames > CAPTURE_BUF_SIZE - capt_idx)
+            frames = CAPTURE_BUF_SIZE - capt_idx;
+        visualizer_capture_u8(inBuffer->s16 + 2 * done, frames, shift,
+                              visu_ctxt->capture_buf + capt_idx);
+        done += frames;
+        capt_idx += frames;
     }
 
+    visu_ctxt->process_ns += visualizer_now_ns() - start_ns;
+    visu_ctxt->process_frames += inBuffer->frameCount;
+    visu_ctxt->process_calls++;
+
     /* XXX the following two should really be atomic, though it probably doesn't
      * matter much for visualization purposes */
     visu_ctxt->capture_idx = capt_idx;
@@ -945,6 +1264,75 @@ int visualizer_process(effect_context_t *context,
     return 0;
 }
 
+/* Tracks how often the client polls so the capture thread can match it. Called with lock
+ * held */
+void visualizer_note_poll(visualizer_context_t *visu_ctxt)
+{
+    int64_t now_ns = visualizer_now_ns();
+
+    if (visu_ctxt->last_poll_ns != 0) {
+        int64_t delta_ms = (now_ns - visu_ctxt->last_poll_ns) / 1000000;
+
+        if (delta_ms > CAPTURE_MAX_POLL_INTERVAL_MS)
+            delta_ms = CAPTURE_MAX_POLL_INTERVAL_MS;
+        if (delta_ms < 1)
+            delta_ms = 1;
+        visu_ctxt->poll_interval_ms = visu_ctxt->poll_interval_ms == 0 ? (uint32_t)delta_ms :
+                (3 * visu_ctxt->poll_interval_ms + (uint32_t)delta_ms) / 4;
+    }
+    visu_ctxt->last_poll_ns = now_ns;
+    update_capture_demand_l();
+}
+
+/* Processes the periods captured since the last call. Called with lock held */
+void visualizer_consume_capture(visualizer_context_t *visu_ctxt)
+{
+    effect_context_t *context = (effect_context_t *)visu_ctxt;
+    audio_buffer_t buf;
+    struct timespec time;
+    uint32_t write_seq;
+    uint32_t seq;
+
+    write_seq = (uint32_t)android_atomic_acquire_load(&capture_ring->write_seq);
+    if (get_output(context->out_handle) == NULL || visu_ctxt->read_seq > write_seq) {
+        /* not attached to an active output or the ring restarted */
+        visu_ctxt->read_seq = write_seq;
+        return;
+    }
+    /* the period being written next shares a slot with the oldest one */
+    if (write_seq - visu_ctxt->read_seq >= CAPTURE_RING_PERIODS)
+        visu_ctxt->read_seq = write_seq - (CAPTURE_RING_PERIODS - 1);
+    /*
+     * without measurements only the periods covering the capture window
+     * matter, which CAPTURE reads up to the output latency back in time
+     */
+    if (!(visu_ctxt->meas_mode & MEASUREMENT_MODE_PEAK_RMS)) {
+        uint32_t latency_frames = context->config.inputCfg.samplingRate *
+                visu_ctxt->latency / 1000;
+        uint32_t needed = (visu_ctxt->capture_size + latency_frames +
+                AUDIO_CAPTURE_PERIOD_SIZE - 1) / AUDIO_CAPTURE_PERIOD_SIZE + 1;
+
+        if (write_seq - visu_ctxt->read_seq > needed)
+            visu_ctxt->read_seq = write_seq - needed;
+    }
+
+    buf.frameCount = AUDIO_CAPTURE_PERIOD_SIZE;
+    buf.s16 = visu_ctxt->period_buf;
+    for (seq = visu_ctxt->read_seq; seq != write_seq; seq++) {
+        const capture_period_t *period = &capture_ring->periods[seq % CAPTURE_RING_PERIODS];
+
+        memcpy(visu_ctxt->period_buf, period->data, sizeof(period->data));
+        time = period->time;
+        android_memory_barrier();
+        if ((uint32_t)capture_ring->write_seq - seq >= CAPTURE_RING_PERIODS)
+            continue; /* overwritten while copying */
+
+        context->ops.process(context, &buf, &buf);
+        visu_ctxt->buffer_update_time = time;
+    }
+    visu_ctxt->read_seq = write_seq;
+}
+
 int visualizer_command(effect_context_t * context, uint32_t cmdCode, uint32_t cmdSize,
         void *pCmdData, uint32_t *replySize, void *pReplyData)
 {
@@ -961,6 +1349,8 @@ int visualizer_command(effect_context_t * context, uint32_t cmdCode, uint32_t cm
         if (!context->offload_enabled)
             break;
 
+        visualizer_note_poll(visu_ctxt);
+        visualizer_consume_capture(visu_ctxt);
         if (context->state == EFFECT_STATE_ACTIVE) {
             int32_t latency_ms = visu_ctxt->latency;
             const int32_t delta_ms = visualizer_get_delta_time_ms_from_updated_time(visu_ctxt);
@@ -1020,6 +1410,8 @@ int visualizer_command(effect_context_t * context, uint32_t cmdCode, uint32_t cm
             android_errorWriteLog(0x534e4554, "30229821");
             return -EINVAL;
         }
+        visualizer_note_poll(visu_ctxt);
+        visualizer_consume_capture(visu_ctxt);
         uint16_t peak_u16 = 0;
         float sum_rms_squared = 0.0f;
         uint8_t nb_valid_meas = 0;
@@ -1113,6 +1505,7 @@ int effect_lib_create(const effect_uuid_t *uuid,
         context = (effect_context_t *)visu_ctxt;
         context->ops.init = visualizer_init;
         context->ops.reset = visualizer_reset;
+        context->ops.release = visualizer_release;
         context->ops.process = visualizer_process;
         context->ops.set_parameter = visualizer_set_parameter;
         context->ops.get_parameter = visualizer_get_parameter;
@@ -1168,6 +1561,7 @@ int effect_lib_release(effect_handle_t handle) {
         if (context->ops.release)
             context->ops.release(context);
         free(context);
+        update_capture_demand_l();
         status = 0;
     }
     pthread_mutex_unlock(&lock);
@@ -1298,7 +1692,7 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         context->state = EFFECT_STATE_ACTIVE;
         if (context->ops.enable)
             context->ops.enable(context);
-        pthread_cond_signal(&cond);
+        signal_capture_thread_l();
         ALOGV("%s EFFECT_CMD_ENABLE", __func__);
         *(int *)pReplyData = 0;
         break;
@@ -1314,7 +1708,7 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         context->state = EFFECT_STATE_INITIALIZED;
         if (context->ops.disable)
             context->ops.disable(context);
-        pthread_cond_signal(&cond);
+        signal_capture_thread_l();
         ALOGV("%s EFFECT_CMD_DISABLE", __func__);
         *(int *)pReplyData = 0;
         break;
@@ -1385,6 +1779,7 @@ int effect_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
         out_ctxt = get_output(offload_param->ioHandle);
         if (out_ctxt != NULL)
             add_effect_to_output(out_ctxt, context);
+        update_capture_demand_l();
 
         } break;
 
@@ -21,7 +21,6 @@
 #include <dlfcn.h>
 #include <stdlib.h>
 #include <log/log.h>
-#include <cutils/list.h>
 #include <unistd.h>
 #include <hardware/audio_effect.h>
 #include <audio_effects/effect_aec.h>
@@ -44,6 +43,11 @@ enum effect_id
     NUM_ID
 };
 
+// sessions are taken from a fixed pool and looked up through a hash of their ID
+#define MAX_SESSIONS 32
+#define SESSION_HASH_BUCKETS 64     // power of 2
+#define SESSION_NONE (-1)
+
 #ifdef AUDIO_FEATURE_ENABLED_GCOV
 extern void  __gcov_flush();
 static void enable_gcov()
@@ -80,7 +84,9 @@ struct effect_s {
 
 // Session context
 struct session_s {
-    struct listnode node;
+    int next;                        // next session in the same hash bucket, or in the free
+                                     // list when not in use
+    bool in_use;
     effect_config_t config;
     struct effect_s effects[NUM_ID]; // effects in this session
     uint32_t state;                  // current state (enum session_state)
@@ -147,7 +153,9 @@ const effect_descriptor_t *descriptors[NUM_ID] = {
 
 
 static int init_status = 1;
-struct listnode session_list;
+static struct session_s sessions[MAX_SESSIONS];
+static int session_buckets[SESSION_HASH_BUCKETS];  // first session of each hash bucket
+static int free_sessions;                          // first unused session
 static const struct effect_interface_s effect_interface;
 static const effect_uuid_t * uuid_to_id_table[NUM_ID];
 
@@ -178,6 +186,7 @@ static uint32_t uuid_to_id(const effect_uuid_t * uuid)
 //------------------------------------------------------------------------------
 
 static void session_set_fx_enabled(struct session_s *session, uint32_t id, bool enabled);
+static void free_session(struct session_s *session);
 
 #define BAD_STATE_ABORT(from, to) \
         LOG_ALWAYS_FATAL("Bad state transition from %d to %d", from, to);
@@ -339,8 +348,7 @@ static int session_release_effect(struct session_s *session,
     if (session->created_msk == 0)
     {
         ALOGV("session_release_effect() last effect: removing session");
-        list_remove(&session->node);
-        free(session);
+        free_session(session);
     }
 
     return 0;
@@ -406,34 +414,93 @@ static void session_set_fx_enabled(struct session_s *session, uint32_t id, bool
 // Global functions
 //------------------------------------------------------------------------------
 
+static uint32_t session_hash(int32_t sessionId)
+{
+    // audio session IDs are unique IDs: a counter above a few bits of ID use
+    uint32_t key = (uint32_t)sessionId;
+
+    return (key ^ (key >> 3) ^ (key >> 9)) & (SESSION_HASH_BUCKETS - 1);
+}
+
+static struct session_s *find_session(int32_t sessionId)
+{
+    int i;
+
+    for (i = session_buckets[session_hash(sessionId)]; i != SESSION_NONE; i = sessions[i].next)
+        if (sessions[i].id == sessionId)
+            return &sessions[i];
+
+    return NULL;
+}
+
+static struct session_s *alloc_session(int32_t sessionId, int32_t ioId)
+{
+    struct session_s *session;
+    uint32_t bucket = session_hash(sessionId);
+    int i = free_sessions;
+
+    if (i == SESSION_NONE)
+        return NULL;
+
+    session = &sessions[i];
+    free_sessions = session->next;
+    memset(session, 0, sizeof(*session));
+    session_init(session);
+    session->id = sessionId;
+    session->io = ioId;
+    session->in_use = true;
+    session->next = session_buckets[bucket];
+    session_buckets[bucket] = i;
+
+    return session;
+}
+
+static void free_session(struct session_s *session)
+{
+    int *link = &session_buckets[session_hash(session->id)];
+    int i = session - sessions;
+
+    while (*link != i)
+        link = &sessions[*link].next;
+    *link = session->next;
+
+    session->in_use = false;
+    session->next = free_sessions;
+    free_sessions = i;
+}
+
+// returns the session an effect handle belongs to if that handle is live
+static struct session_s *get_fx_session(struct effect_s *fx)
+{
+    struct session_s *session = fx->session;
+
+    if (session < sessions || session >= sessions + MAX_SESSIONS || !session->in_use ||
+            fx->id >= NUM_ID || fx != &session->effects[fx->id] ||
+            fx->state == EFFECT_STATE_INIT)
+        return NULL;
+
+    return session;
+}
+
 static struct session_s *get_session(int32_t id, int32_t  sessionId, int32_t  ioId)
 {
-    size_t i;
-    int free = -1;
-    struct listnode *node;
     struct session_s *session;
 
-    list_for_each(node, &session_list) {
-        session = node_to_item(node, struct session_s, node);
-        if (session->id == sessionId) {
-            if (session->created_msk & (1 << id)) {
-                ALOGV("get_session() effect %d already created", id);
-                return NULL;
-            }
-            ALOGV("get_session() found session %p", session);
-            return session;
+    session = find_session(sessionId);
+    if (session != NULL) {
+        if (session->created_msk & (1 << id)) {
+            ALOGV("get_session() effect %d already created", id);
+            return NULL;
         }
+        ALOGV("get_session() found session %p", session);
+        return session;
     }
 
-    session = (struct session_s *)calloc(1, sizeof(struct session_s));
+    session = alloc_session(sessionId, ioId);
     if (session == NULL) {
-        ALOGE("get_session() fail to allocate memory");
+        ALOGE("get_session() all %d sessions in use", MAX_SESSIONS);
         return NULL;
     }
-    session_init(session);
-    session->id = sessionId;
-    session->io = ioId;
-    list_add_tail(&session_list, &session->node);
 
     ALOGV("get_session() created session %p", session);
 
@@ -443,6 +510,7 @@ static struct session_s *get_session(int32_t id, int32_t  sessionId, int32_t  io
 static int init() {
     void *lib_handle;
     const effect_descriptor_t *desc;
+    int i;
 
     if (init_status <= 0)
         return init_status;
@@ -475,7 +543,13 @@ static int init() {
     uuid_to_id_table[NS_ID] = FX_IID_NS;
 //ENABLE_AGC uuid_to_id_table[AGC_ID] = FX_IID_AGC;
 
-    list_init(&session_list);
+    for (i = 0; i < SESSION_HASH_BUCKETS; i++)
+        session_buckets[i] = SESSION_NONE;
+    for (i = 0; i < MAX_SESSIONS; i++) {
+        sessions[i].in_use = false;
+        sessions[i].next = i + 1 < MAX_SESSIONS ? i + 1 : SESSION_NONE;
+    }
+    free_sessions = 0;
 
     init_status = 0;
     return init_status;
@@ -721,17 +795,14 @@ static int lib_create(const effect_uuid_t *uuid,
 
     status = session_create_effect(session, id, pInterface);
 
-    if (status < 0 && session->created_msk == 0) {
-        list_remove(&session->node);
-        free(session);
-    }
+    if (status < 0 && session->created_msk == 0)
+        free_session(session);
     enable_gcov();
     return status;
 }
 
 static int lib_release(effect_handle_t interface)
 {
-    struct listnode *node;
     struct session_s *session;
 
     ALOGV("lib_release %p", interface);
@@ -740,12 +811,10 @@ static int lib_release(effect_handle_t interface)
 
     struct effect_s *fx = (struct effect_s *)interface;
 
-    list_for_each(node, &session_list) {
-        session = node_to_item(node, struct session_s, node);
-        if (session == fx->session) {
-            session_release_effect(fx->session, fx);
-            return 0;
-        }
+    session = get_fx_session(fx);
+    if (session != NULL) {
+        session_release_effect(session, fx);
+        return 0;
     }
     enable_gcov();
     return -EINVAL;